@@ -14,23 +14,32 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-extern crate test;
+extern crate yucon_core;
 
+#[macro_use]
+mod trace;
 mod runtime;
 mod utils;
 
 use std::env;
 use std::io::stdin;
 use std::io::stdout;
+use std::io::stderr;
+use std::io::Write as IoWrite;
 use std::fmt::Write;
-
-use ::runtime::{Interpreter, InterpretErr};
+use std::process::ExitCode;
+
+use ::runtime::{Boostrapper, Interpreter, InterpretErr};
+use ::runtime::batch;
+use ::runtime::follow;
+use ::runtime::json;
+use ::runtime::integer;
+use ::runtime::serve;
+use ::runtime::verify;
 use ::runtime::parse::to_conv_primitive;
 use ::runtime::convert::{convert_all, ConversionFmt};
-use ::runtime::units::UnitDatabase;
-use ::runtime::units::config::load_units_list;
 use ::utils::TokenType;
-use test::Options;
+use ::runtime::state::Options;
 
 static PROGRAM_NAME: &'static str = "\
 YUCON - General Purpose Unit Converter - v0.3";
@@ -47,6 +56,50 @@ Usage:
   In second form, perform conversion given on the command line
 
 Options:
+  -b         : batch mode. convert each line of standard input to
+               standard output without prompts
+  --input <file>
+             : batch mode. read from file instead of standard input
+  --output <file>
+             : batch mode. write to file instead of standard output
+  --resume   : batch mode. resume an interrupted job from its last
+               checkpoint. needs both --input and --output
+  --progress : batch mode. report throughput and progress to stderr
+  --window <#>
+             : batch mode. hold about <#> lines at a time and convert
+               them grouped by pair of units. output is unchanged
+  --follow <file>
+             : convert lines as they are appended to file, as 'tail -f',
+               to --output or standard output. truncated and rotated
+               files are followed
+  --json --field <path> --from <unit> --to <unit>
+             : convert the numeric fields at path, eg '$.a[*].b', in
+               JSON or NDJSON read from --input or standard input
+  --int <i32|i64> --from <unit> --to <unit> [--scale <#>] [--round <mode>]
+             : convert integer counts of <#> units exactly, one or more
+               per line. mode is even (default), away, floor, ceil, or zero
+  --autoscale
+             : give output units without a metric prefix the one that
+               puts the value in [1, 1000), eg 1500 m becomes 1.5 km
+  --fold-names
+             : also find units spelled with other case, punctuation, or
+               symbols, eg N·m or KWH, when not found as given
+  --serve <addr> [--hotset <file>] [--hotset-size <#>]
+             : daemon mode. convert lines sent to the TCP address, eg
+               127.0.0.1:7070, as batch mode would. the most used unit
+               pairs are saved in the hot set file and resolved again
+               before the daemon takes connections when it restarts
+  --tenant <name>=<file>
+             : daemon mode. also serve the units database in file as
+               name. clients choose one with '@db <name>' and reload
+               one with '@reload <name>'
+  --verify <#>
+             : check every fast conversion path against the reference
+               for every pair of units and prefixes, with edge cases and
+               <#> random values each, and report how far they differ
+  --bench-cache <#>
+             : look up <#> unit pairs on each of 1 to 64 threads in the
+               daemon's plan cache and report lookups per second
   -s         : simple output format. value only
   -l         : long output format. input / output values and units
   --help     : show this help message
@@ -60,6 +113,12 @@ Examples:
   Interactive session with long formatting:
     $ yucon -l
 
+  Batch conversion of a file:
+    $ yucon -b < measurements.txt > converted.txt
+
+  Conversion of fields in JSON:
+    $ yucon --json --field '$.readings[*].temp' --from F --to C < log.json
+
 This is free software licensed under the GNU General Public License v3
 Use \'--version\' for more details";
 
@@ -90,9 +149,17 @@ Commands:
   exit            - exit the program
   help            - print this help message
   version         - print version and license info
+  history         - list the conversions that may be recalled by index
+  replay <#> <output_unit> ...
+                  - convert the values of the last # conversions again into
+                    the output units
   <var> [<state>] - view or set program variables. view if no state is specified
                     set the variable to given state otherwise
 
+Recall:
+  ;  :            - the value or unit of the last conversion
+  ;<#>  :<#>      - the value or unit of the conversion # back in the history
+
 Program Variables:
   format          - output format. may be \'s\', \'d\', or \'l\'
   value           - recall value for conversions
@@ -106,13 +173,15 @@ Type \'version\' for more details";
 
 
 
-fn line_interpreter(units: &UnitDatabase, opts: &Options)
+// runs an interactive session. fails only if the units database could not be loaded
+fn line_interpreter(boot: &mut Boostrapper, opts: &Options) -> ExitCode
 {
     let prompt = "> ".to_string();
     let mut interpreter: Interpreter<_, _> =
         Interpreter::using_streams(stdin(), stdout());
 
     interpreter.format = opts.format;
+    interpreter.autoscale = opts.autoscale;
     interpreter.publish(&PROGRAM_NAME, &None);
     interpreter.newline();
     interpreter.publish(&GREETING_MSG, &None);
@@ -155,6 +224,27 @@ fn line_interpreter(units: &UnitDatabase, opts: &Options)
                     interpreter.publish(&cmd_mesg, &None);
                     interpreter.newline();
                 }
+                InterpretErr::ReplaySig(prims) => {
+                    let units = match boot.units()
+                    {
+                    Some(units) => units,
+                    None => {
+                        println!("Failed to load units database from file.");
+                        return ExitCode::FAILURE;
+                    },
+                    };
+
+                    // replayed conversions are not recalled
+                    for prim in prims
+                    {
+                        for mut conversion in convert_all(prim, units)
+                        {
+                            conversion.format = interpreter.format;
+                            interpreter.publish(&conversion, &None);
+                            interpreter.newline();
+                        }
+                    }
+                },
                 _ => {
                     interpreter.publish(&cmd_mesg, &Some("Error: ".to_string()));
                     interpreter.newline();
@@ -188,6 +278,16 @@ fn line_interpreter(units: &UnitDatabase, opts: &Options)
         },
         };
 
+        // the units are still loading while the greeting is shown and the first line read
+        let units = match boot.units()
+        {
+        Some(units) => units,
+        None => {
+            println!("Failed to load units database from file.");
+            return ExitCode::FAILURE;
+        },
+        };
+
         let mut conversions = convert_all(conv_primitive, units);
 
         for mut conversion in &mut conversions
@@ -199,19 +299,17 @@ fn line_interpreter(units: &UnitDatabase, opts: &Options)
 
         interpreter.update_recall(&conversions);
     }
+
+    ExitCode::SUCCESS
 }
 
-fn main() {
-    let units = match load_units_list()
-    {
-    Some(new_units) => new_units,
-    None => {
-        println!("Failed to load units database from file.");
-        return;
-    },
-    };
+fn main() -> ExitCode {
+    trace_until_exit!();
+
+    let mut boot = Boostrapper::create();
+    boot.start();
 
-    let (opts, mut args) = match Options::get_opts()
+    let (opts, mut args) = match boot.parse_opts()
     {
         Ok(results) => results,
         Err(err) => {
@@ -230,15 +328,79 @@ fn main() {
             _ => {
                 println!("Error: {}", err);
                 println!("Use \'--help \' for assistance");
+                return ExitCode::FAILURE;
             },
             }
-            return;
+            return ExitCode::SUCCESS;
         },
     };
 
-    if opts.interactive
+    if opts.interactive && !opts.batch && !opts.json && opts.int_bits.is_none()
+        && opts.serve_addr.is_none() && opts.verify_samples.is_none() && opts.bench_lookups.is_none()
+        && opts.follow_path.is_none()
     {
-        line_interpreter(&units, &opts);
+        return line_interpreter(&mut boot, &opts);
+    }
+
+    let units = match boot.units()
+    {
+    Some(units) => units,
+    None => {
+        println!("Failed to load units database from file.");
+        return ExitCode::FAILURE;
+    },
+    };
+
+    if opts.verify_samples.is_some()
+    {
+        if let Err(err) = verify::run_job(&opts, units)
+        {
+            writeln!(stderr(), "Error: verification failed: {}", err).ok();
+            // returned rather than exiting so that the trace is still written
+            return ExitCode::FAILURE;
+        }
+    }
+    else if opts.bench_lookups.is_some()
+    {
+        if let Err(err) = serve::bench::run_job(&opts, units)
+        {
+            writeln!(stderr(), "Error: benchmark stopped: {}", err).ok();
+        }
+    }
+    else if opts.int_bits.is_some()
+    {
+        if let Err(err) = integer::run_job(&opts, units)
+        {
+            writeln!(stderr(), "Error: integer conversion stopped: {}", err).ok();
+        }
+    }
+    else if opts.serve_addr.is_some()
+    {
+        if let Err(err) = serve::run_job(&opts, units)
+        {
+            writeln!(stderr(), "Error: daemon stopped: {}", err).ok();
+        }
+    }
+    else if opts.follow_path.is_some()
+    {
+        if let Err(err) = follow::run_job(&opts, units)
+        {
+            writeln!(stderr(), "Error: follow stopped: {}", err).ok();
+        }
+    }
+    else if opts.json
+    {
+        if let Err(err) = json::run_job(&opts, units)
+        {
+            writeln!(stderr(), "Error: JSON conversion stopped: {}", err).ok();
+        }
+    }
+    else if opts.batch
+    {
+        if let Err(err) = batch::run_job(&opts, units)
+        {
+            writeln!(stderr(), "Error: batch stopped: {}", err).ok();
+        }
     }
     else
     {
@@ -246,6 +408,7 @@ fn main() {
                 Interpreter::using_streams(stdin(), stdout());
 
         interpreter.format = opts.format;
+        interpreter.autoscale = opts.autoscale;
         let mut args_wrapped: Vec<TokenType> = Vec::with_capacity(3);
 
         for arg in args.drain(..)
@@ -258,7 +421,7 @@ fn main() {
             Ok(results) => results,
             Err(err) => {
                 println!("In token \'{}\': {}", args_wrapped[err.failed_at].peek(), err);
-                return;
+                return ExitCode::SUCCESS;
             },
         };
 
@@ -267,11 +430,11 @@ fn main() {
         None => {},
         Some(err) => {
             println!("Error: {}", err);
-            return;
+            return ExitCode::SUCCESS;
         },
         };
 
-        let mut conversions = convert_all(conv_primitive, &units);
+        let mut conversions = convert_all(conv_primitive, units);
 
         for mut conversion in &mut conversions
         {
@@ -279,4 +442,6 @@ fn main() {
             println!("{}", conversion);
         }
     }
+
+    ExitCode::SUCCESS
 }
@@ -0,0 +1,251 @@
+/* runtime/batch/checkpoint.rs
+ * ===
+ * Checkpoints for resuming long batch jobs. A checkpoint records how far into the input and
+ * output a batch had durably progressed together with the interpreter state at that point so
+ * that a resumed job continues exactly where the last checkpoint left off.
+ *
+ * This file is a part of:
+ *
+ * Yucon - General Purpose Unit Converter
+ * Copyright (C) 2016-2017  Blaine Murphy
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use std::fs;
+use std::fs::File;
+use std::io;
+use std::io::{BufRead, BufReader};
+use std::io::Write;
+use std::path::{Path, PathBuf};
+use std::time::{Duration, Instant};
+
+use ::runtime::convert::ConversionFmt;
+
+// minimum time between two checkpoints. keeps the cost of syncing negligible
+const CHECKPOINT_INTERVAL: Duration = Duration::from_secs(5);
+
+/* struct Checkpoint
+ *
+ * Description: state of a batch job as of the end of some line of input.
+ *
+ * Fields:
+ *   - input_offset  : bytes of input consumed, up to and including that line
+ *   - output_offset : bytes of output written for everything before it
+ *   - lines         : lines of input processed
+ *   - errors        : lines that produced an error of any kind
+ *   - format, input_value, input_unit, output_unit : interpreter state
+ *   - default_from, default_to : units set by '@from' and '@to' directives
+ *   - autoscale     : the --autoscale option. taken from the command line and
+ *                     never stored
+ */
+#[derive(Debug, Clone)]
+pub struct Checkpoint
+{
+    pub input_offset: u64,
+    pub output_offset: u64,
+    pub lines: u64,
+    pub errors: u64,
+    pub format: ConversionFmt,
+    pub input_value: Option<f64>,
+    pub input_unit: Option<String>,
+    pub output_unit: Option<String>,
+    pub default_from: Option<String>,
+    pub default_to: Vec<String>,
+    pub autoscale: bool,
+}
+
+impl Checkpoint
+{
+    // state of a job that has not started yet
+    pub fn new(format: ConversionFmt) -> Checkpoint
+    {
+        Checkpoint {
+            input_offset: 0,
+            output_offset: 0,
+            lines: 0,
+            errors: 0,
+            format: format,
+            input_value: None,
+            input_unit: None,
+            output_unit: None,
+            default_from: None,
+            default_to: Vec::new(),
+            autoscale: false,
+        }
+    }
+
+    /* Returns the checkpoint file used for the given output file. Lives beside
+     * it as '<output>.ckpt'.
+     */
+    pub fn path_for(output_path: &str) -> PathBuf
+    {
+        let mut path = output_path.to_string();
+        path.push_str(".ckpt");
+        PathBuf::from(path)
+    }
+
+    /* Reads a checkpoint previously written by fn store. The format is one
+     * 'key value' pair per line. Unset recall variables are simply absent.
+     */
+    pub fn load(path: &Path) -> io::Result<Checkpoint>
+    {
+        let file = BufReader::new(try!(File::open(path)));
+        let mut checkpoint = Checkpoint::new(ConversionFmt::Desc);
+
+        for line in file.lines()
+        {
+            let line = try!(line);
+            let mut fields = line.splitn(2, ' ');
+            let key = fields.next().unwrap_or("");
+            let value = fields.next().unwrap_or("");
+
+            match key
+            {
+            "input_offset" => checkpoint.input_offset = try!(parse_field(key, value)),
+            "output_offset" => checkpoint.output_offset = try!(parse_field(key, value)),
+            "lines" => checkpoint.lines = try!(parse_field(key, value)),
+            "errors" => checkpoint.errors = try!(parse_field(key, value)),
+            "format" => {
+                checkpoint.format = match value
+                {
+                "s" => ConversionFmt::Short,
+                "d" => ConversionFmt::Desc,
+                "l" => ConversionFmt::Long,
+                _ => return Err(bad_field(key, value)),
+                };
+            },
+            "value" => checkpoint.input_value = Some(try!(parse_field(key, value))),
+            "input_unit" => checkpoint.input_unit = Some(value.to_string()),
+            "output_unit" => checkpoint.output_unit = Some(value.to_string()),
+            "default_from" => checkpoint.default_from = Some(value.to_string()),
+            "default_to" => checkpoint.default_to.push(value.to_string()),
+            "" => {},
+            _ => return Err(bad_field(key, value)),
+            };
+        }
+
+        Ok(checkpoint)
+    }
+
+    /* Durably replaces the checkpoint at the given path. Written to a temporary
+     * file first and renamed into place so a crash never leaves a torn checkpoint.
+     */
+    pub fn store(&self, path: &Path) -> io::Result<()>
+    {
+        let mut tmp_path = path.as_os_str().to_os_string();
+        tmp_path.push(".tmp");
+
+        {
+            let mut file = try!(File::create(&tmp_path));
+
+            try!(write!(file, "input_offset {}\n", self.input_offset));
+            try!(write!(file, "output_offset {}\n", self.output_offset));
+            try!(write!(file, "lines {}\n", self.lines));
+            try!(write!(file, "errors {}\n", self.errors));
+            try!(write!(file, "format {}\n", match self.format
+            {
+                ConversionFmt::Short => "s",
+                ConversionFmt::Desc => "d",
+                ConversionFmt::Long => "l",
+            }));
+            if let Some(value) = self.input_value
+            {
+                try!(write!(file, "value {:e}\n", value));
+            }
+            if let Some(ref unit) = self.input_unit
+            {
+                try!(write!(file, "input_unit {}\n", unit));
+            }
+            if let Some(ref unit) = self.output_unit
+            {
+                try!(write!(file, "output_unit {}\n", unit));
+            }
+            if let Some(ref unit) = self.default_from
+            {
+                try!(write!(file, "default_from {}\n", unit));
+            }
+            for unit in self.default_to.iter()
+            {
+                try!(write!(file, "default_to {}\n", unit));
+            }
+
+            try!(file.sync_all());
+        }
+
+        fs::rename(&tmp_path, path)
+    }
+}
+
+fn parse_field<T: ::std::str::FromStr>(key: &str, value: &str) -> io::Result<T>
+{
+    value.parse::<T>().map_err(|_| bad_field(key, value))
+}
+
+fn bad_field(key: &str, value: &str) -> io::Error
+{
+    io::Error::new(io::ErrorKind::InvalidData,
+                   format!("corrupt checkpoint: bad field \'{} {}\'", key, value))
+}
+
+/* struct Checkpointer
+ *
+ * Description: records checkpoints for a job whose output is a file. Holds its
+ *   own handle to the output file so that it can sync it before each
+ *   checkpoint, guaranteeing the output is at least as far along as any
+ *   checkpoint that describes it.
+ */
+pub struct Checkpointer
+{
+    path: PathBuf,
+    output_file: File,
+    last: Instant,
+}
+
+impl Checkpointer
+{
+    pub fn new(path: PathBuf, output_file: File) -> Checkpointer
+    {
+        Checkpointer {
+            path: path,
+            output_file: output_file,
+            last: Instant::now(),
+        }
+    }
+
+    // true once enough time has passed since the last checkpoint
+    pub fn due(&self) -> bool
+    {
+        self.last.elapsed() >= CHECKPOINT_INTERVAL
+    }
+
+    /* Records the given state. All output up to its output_offset must already
+     * have been handed to the OS ie any buffers must have been flushed.
+     */
+    pub fn record(&mut self, state: &Checkpoint) -> io::Result<()>
+    {
+        try!(self.output_file.sync_data());
+        try!(state.store(&self.path));
+        self.last = Instant::now();
+        Ok(())
+    }
+
+    // the job completed. its checkpoint is no longer needed
+    pub fn finish(self) -> io::Result<()>
+    {
+        match fs::remove_file(&self.path)
+        {
+        Err(ref err) if err.kind() == io::ErrorKind::NotFound => Ok(()),
+        result => result,
+        }
+    }
+}
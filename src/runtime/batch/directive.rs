@@ -0,0 +1,236 @@
+/* runtime/batch/directive.rs
+ * ===
+ * Batch header directives. A directive is a line beginning with '@' that sets a persistent
+ * default for the lines after it:
+ *
+ *   @from <unit>           - unit to convert from
+ *   @to <unit> [<unit>..]  - unit(s) to convert to
+ *   @format <s|d|l>        - output format, as the 'format' command
+ *
+ * Once both units are set, lines holding only values are converted from the default input
+ * unit into every default output unit. Those units are resolved into conversion plans once,
+ * when first needed after a directive changes them, so such lines skip unit parsing and
+ * lookup entirely. Directives also set the input_unit / output_unit recall variables.
+ *
+ * This file is a part of:
+ *
+ * Yucon - General Purpose Unit Converter
+ * Copyright (C) 2016-2017  Blaine Murphy
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use std::io;
+use std::io::Read;
+
+use ::utils::{TokenType, NO_PREFIX, AUTO_PREFIX, ALL_UNITS};
+use ::runtime::{Interpreter, InterpretErr, NONLITERAL_RECALL_MSG, AUTO_INPUT_MSG, ALL_INPUT_MSG};
+use ::runtime::parse::unit::{parse_unit_expr, UnitExpr};
+use ::runtime::convert::ConversionPlan;
+use ::runtime::units::UnitDatabase;
+
+/* Checks if the given word begins a directive rather than a conversion.
+ */
+pub fn is_directive(word: &str) -> bool
+{
+    word.starts_with('@')
+}
+
+/* struct Defaults
+ *
+ * Description: the units set by directives, both as written (for checkpoints)
+ *   and parsed, and the plans resolved from them once both are known.
+ */
+pub struct Defaults
+{
+    pub from_text: Option<String>,
+    pub to_text: Vec<String>,
+    from: Option<UnitExpr>,
+    to: Vec<UnitExpr>,
+    plans: Option<Vec<ConversionPlan>>,
+}
+
+impl Defaults
+{
+    pub fn new() -> Defaults
+    {
+        Defaults {
+            from_text: None,
+            to_text: Vec::new(),
+            from: None,
+            to: Vec::new(),
+            plans: None,
+        }
+    }
+
+    /* Restores defaults recorded in a checkpoint. They were valid when set so
+     * any that no longer parse are simply dropped.
+     */
+    pub fn restore(from_text: Option<String>, to_text: Vec<String>) -> Defaults
+    {
+        let mut defaults = Defaults::new();
+
+        if let Some(text) = from_text
+        {
+            if let Ok(expr) = parse_literal_unit(&text)
+            {
+                defaults.from = Some(expr);
+                defaults.from_text = Some(text);
+            }
+        }
+
+        for text in to_text
+        {
+            if let Ok(expr) = parse_literal_unit(&text)
+            {
+                defaults.to.push(expr);
+                defaults.to_text.push(text);
+            }
+        }
+
+        defaults
+    }
+
+    /* Carries out a directive line. Returns Ok if the directive took effect or
+     * the error to report otherwise. Recall variables and format are changed on
+     * the given interpreter.
+     */
+    pub fn apply<I, O>(&mut self, tokens: Vec<TokenType>, interpreter: &mut Interpreter<I, O>)
+        -> Result<(), InterpretErr> where I: Read, O: io::Write
+    {
+        let mut tokens_iter = tokens.into_iter();
+        let directive = tokens_iter.next().unwrap().unwrap();
+        let args: Vec<String> = tokens_iter.map(|tok| tok.unwrap()).collect();
+
+        match directive.as_ref()
+        {
+        "@from" => {
+            if args.len() != 1
+            {
+                return Err(if args.is_empty() { InterpretErr::IncompleteErr }
+                           else { InterpretErr::UnrecognizedCmd(args[1].clone()) });
+            }
+
+            let expr = try!(parse_literal_unit(&args[0]));
+            if expr.prefix == AUTO_PREFIX
+            {
+                return Err(InterpretErr::InvalidState(AUTO_INPUT_MSG.to_string()));
+            }
+            if expr.is_all()
+            {
+                return Err(InterpretErr::InvalidState(ALL_INPUT_MSG.to_string()));
+            }
+
+            interpreter.set_input_unit(expr.alias.as_ref().map(String::as_str));
+            self.from = Some(expr);
+            self.from_text = Some(args[0].clone());
+        },
+        "@to" | "@all" => {
+            // @all is short for @to *
+            let args = if directive == "@all"
+            {
+                if !args.is_empty()
+                {
+                    return Err(InterpretErr::UnrecognizedCmd(args[0].clone()));
+                }
+                vec![ALL_UNITS.to_string()]
+            }
+            else
+            {
+                args
+            };
+
+            if args.is_empty()
+            {
+                return Err(InterpretErr::IncompleteErr);
+            }
+
+            let mut exprs = Vec::with_capacity(args.len());
+            for arg in args.iter()
+            {
+                exprs.push(try!(parse_literal_unit(arg)));
+            }
+
+            // '*' is no unit to recall
+            if let Some(expr) = exprs.iter().find(|expr| !expr.is_all())
+            {
+                interpreter.set_output_unit(expr.alias.as_ref().map(String::as_str));
+            }
+            self.to = exprs;
+            self.to_text = args;
+        },
+        "@format" => {
+            let mut cmd = vec![TokenType::Normal("format".to_string())];
+            cmd.extend(args.into_iter().map(TokenType::Normal));
+
+            return match interpreter.execute(cmd)
+            {
+            Err(InterpretErr::CmdSuccess(..)) => Ok(()),
+            Err(err) => Err(err),
+            Ok(..) => Err(InterpretErr::IncompleteErr),
+            };
+        },
+        _ => return Err(InterpretErr::UnrecognizedCmd(directive)),
+        };
+
+        self.plans = None;
+        Ok(())
+    }
+
+    /* Returns the plans for value only lines, resolving them if the defaults
+     * changed since last time. None if either default unit is not yet set.
+     * Output units without a prefix get an automatic one if 'autoscale' is set.
+     */
+    pub fn plans(&mut self, units: &UnitDatabase, autoscale: bool) -> Option<&Vec<ConversionPlan>>
+    {
+        if self.plans.is_none()
+        {
+            let from = match self.from
+            {
+            Some(ref from) if !self.to.is_empty() => from,
+            _ => return None,
+            };
+
+            let to: Vec<UnitExpr> = self.to.iter()
+                .map(|to| {
+                    let mut to = to.clone();
+                    if autoscale && to.prefix == NO_PREFIX
+                    {
+                        to.prefix = AUTO_PREFIX;
+                    }
+                    to
+                })
+                .collect();
+
+            self.plans = Some(ConversionPlan::from_exprs_all(from, &to, units));
+        }
+
+        self.plans.as_ref()
+    }
+}
+
+// parses a unit expression that may not use recall
+fn parse_literal_unit(text: &String) -> Result<UnitExpr, InterpretErr>
+{
+    let expr = match parse_unit_expr(text)
+    {
+    Ok(expr) => expr,
+    Err(err) => return Err(InterpretErr::InvalidState(err.to_string())),
+    };
+
+    if expr.recall || expr.alias.is_none()
+    {
+        return Err(InterpretErr::InvalidState(NONLITERAL_RECALL_MSG.to_string()));
+    }
+
+    Ok(expr)
+}
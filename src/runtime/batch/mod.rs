@@ -0,0 +1,779 @@
+/* runtime/batch module
+ * ===
+ * Batch mode. Converts a stream of lines, each a conversion or a command exactly as typed
+ * into an interactive session, and writes the results in order without prompts. Work is
+ * split into stages that each run on their own thread and hand batches of records to the
+ * next stage through bounded queues:
+ *
+ *   read -> split lines -> parse -> convert -> format -> write
+ *
+ * Reading and writing thus overlap with parsing and conversion, and each stage keeps only
+ * its own working set hot. The queues are bounded so that a slow output sink applies
+ * backpressure all the way up to the reader and memory stays flat regardless of input size.
+ *
+ * When both ends of a batch are files, the write stage periodically records a checkpoint
+ * (see checkpoint.rs) at a batch boundary so that an interrupted job may be resumed. Stages
+ * also keep counters that may be reported while the job runs (see progress.rs). With
+ * '--window', the convert stage groups the arithmetic of many batches by pair of units
+ * before handing them on (see window.rs).
+ *
+ * This file is a part of:
+ *
+ * Yucon - General Purpose Unit Converter
+ * Copyright (C) 2016-2017  Blaine Murphy
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+pub mod checkpoint;
+pub mod directive;
+pub mod progress;
+mod window;
+
+use std::fmt::Write;
+use std::fs::{File, OpenOptions};
+use std::io;
+use std::io::{Read, Seek, SeekFrom};
+use std::io::Write as IoWrite;
+use std::mem;
+use std::sync::Arc;
+use std::sync::mpsc::{sync_channel, Receiver, SyncSender, TryRecvError};
+use std::thread;
+use std::time::Instant;
+
+use ::utils::TokenType;
+use ::runtime::{Interpreter, InterpretErr, is_command, tokenize_line};
+use ::runtime::parse::{ConvPrimitive, to_conv_primitive};
+use ::runtime::parse::number::{NumberExpr, parse_number_expr};
+use ::runtime::convert::{Conversion, convert_all, convert_with};
+use ::runtime::units::UnitDatabase;
+use ::runtime::state::Options;
+use ::runtime::batch::checkpoint::{Checkpoint, Checkpointer};
+use ::runtime::batch::progress::{Meter, ticker};
+use ::runtime::batch::directive::{Defaults, is_directive};
+use ::runtime::batch::window::Window;
+
+// bytes requested from the input per read
+const CHUNK_SIZE: usize = 64 * 1024;
+// lines handed between stages at a time
+const BATCH_LINES: usize = 256;
+// batches each queue holds before its producer blocks
+const QUEUE_DEPTH: usize = 4;
+
+/* struct Batch
+ *
+ * Description: a batch of lines, or of records made from them, along with the
+ *   input offset just past the last of them.
+ */
+struct Batch<T>
+{
+    items: Vec<T>,
+    input_end: u64,
+}
+
+/* struct Settled
+ *
+ * Description: a batch after conversion along with the state of the job as of
+ *   its last line. Everything after the convert stage is stateless, so this is
+ *   exactly the checkpoint to record once the batch has been written.
+ */
+struct Settled<T>
+{
+    items: T,
+    state: Checkpoint,
+}
+
+/* enum Record
+ *
+ * Description: a line after the parse stage, awaiting conversion or execution.
+ *   Lines that could not be parsed carry their error message along so that it
+ *   is reported in order with everything else.
+ */
+enum Record
+{
+    Blank,
+    Command(Vec<TokenType>),
+    Directive(Vec<TokenType>),
+    Convert(ConvPrimitive),
+    Values(Vec<NumberExpr>),
+    Error(String),
+}
+
+/* enum Output
+ *
+ * Description: result of a single line after the convert stage, ready to be
+ *   formatted.
+ */
+enum Output
+{
+    Blank,
+    Conversions(Vec<Conversion>),
+    Message(String),
+}
+
+/* Runs a batch job as described by the program options: input from the file
+ * given with '--input' or standard input and output to the file given with
+ * '--output' or standard output. When both are files, checkpoints are recorded
+ * and '--resume' continues from the last one, truncating any output written
+ * after it.
+ */
+pub fn run_job(opts: &Options, units: &UnitDatabase) -> io::Result<()>
+{
+    if opts.resume && (opts.input_path.is_none() || opts.output_path.is_none())
+    {
+        return Err(io::Error::new(io::ErrorKind::InvalidInput,
+                                  "\'--resume\' requires both \'--input\' and \'--output\' files"));
+    }
+
+    let mut start = Checkpoint::new(opts.format);
+    start.autoscale = opts.autoscale;
+
+    let (input_path, output_path) = match (&opts.input_path, &opts.output_path)
+    {
+    (&Some(ref input_path), &Some(ref output_path)) => (input_path, output_path),
+    (&Some(ref input_path), &None) => {
+        let input = try!(File::open(input_path));
+        let meter = Meter::new(input.metadata().ok().map(|meta| meta.len()));
+        return run(input, io::stdout(), units, start, None,
+                   Arc::new(meter), opts.progress, opts.window);
+    },
+    (&None, &Some(ref output_path)) => {
+        // standard input cannot be rewound. checkpoints would be useless
+        return run(io::stdin(), try!(File::create(output_path)), units, start, None,
+                   Arc::new(Meter::new(None)), opts.progress, opts.window);
+    },
+    (&None, &None) => {
+        return run(io::stdin(), io::stdout(), units, start, None,
+                   Arc::new(Meter::new(None)), opts.progress, opts.window);
+    },
+    };
+
+    let ckpt_path = Checkpoint::path_for(output_path);
+    let mut input = try!(File::open(input_path));
+
+    let output = if opts.resume
+    {
+        start = try!(Checkpoint::load(&ckpt_path));
+        start.autoscale = opts.autoscale;
+
+        let mut output = try!(OpenOptions::new().write(true).open(output_path));
+        try!(output.set_len(start.output_offset));
+        try!(output.seek(SeekFrom::End(0)));
+        try!(input.seek(SeekFrom::Start(start.input_offset)));
+        output
+    }
+    else
+    {
+        try!(File::create(output_path))
+    };
+
+    let checkpointer = Checkpointer::new(ckpt_path, try!(output.try_clone()));
+    let meter = Meter::new(input.metadata().ok().map(|meta| meta.len().saturating_sub(start.input_offset)));
+
+    run(input, output, units, start, Some(checkpointer), Arc::new(meter), opts.progress, opts.window)
+}
+
+/* Runs a batch over the given streams using the given units database. The job
+ * starts from the state in 'start', which is a fresh Checkpoint unless a job is
+ * being resumed. Returns once all input has been converted and written, the
+ * input issued 'exit', or either stream failed. I/O errors on either end are
+ * returned; conversion errors are written to the output as they would be shown
+ * interactively. Stages count their work in 'meter', which is reported to
+ * stderr while the job runs if 'report' is set. If 'window' is given, the
+ * arithmetic of about that many lines at a time is grouped by pair of units.
+ *
+ * The stages up to parsing wait on the input, which may be a pipe held open
+ * long after it issued 'exit'. They run on threads of their own, outside the
+ * scope of the others, so the job may end without them; they are then left to
+ * end with the process.
+ */
+pub fn run<R, W>(input: R, output: W, units: &UnitDatabase, start: Checkpoint,
+    checkpointer: Option<Checkpointer>, meter: Arc<Meter>, report: bool, window: Option<usize>) -> io::Result<()>
+    where R: Read + Send + 'static, W: io::Write + Send
+{
+    let (chunk_tx, chunk_rx) = sync_channel::<Vec<u8>>(QUEUE_DEPTH);
+    let (line_tx, line_rx) = sync_channel::<Batch<String>>(QUEUE_DEPTH);
+    let (record_tx, record_rx) = sync_channel::<Batch<Record>>(QUEUE_DEPTH);
+    let (output_tx, output_rx) = sync_channel::<Settled<Vec<Output>>>(QUEUE_DEPTH);
+    let (text_tx, text_rx) = sync_channel::<Settled<String>>(QUEUE_DEPTH);
+    let input_offset = start.input_offset;
+    let output_offset = start.output_offset;
+
+    let (stop_tx, stop_rx) = sync_channel::<()>(0);
+
+    let reader_meter = meter.clone();
+    let reader = thread::spawn(move || read_stage(input, chunk_tx, &reader_meter));
+    let splitter = thread::spawn(move || split_stage(chunk_rx, line_tx, input_offset));
+    let parser = thread::spawn(move || parse_stage(line_rx, record_tx));
+    let meter = &*meter;
+
+    thread::scope(|scope| {
+        if report
+        {
+            scope.spawn(move || ticker(meter, stop_rx));
+        }
+
+        let converter = scope.spawn(move || convert_stage(record_rx, output_tx, units, start, meter, window));
+        let formatter = scope.spawn(move || format_stage(output_rx, text_tx));
+        let writer = scope.spawn(move || write_stage(text_rx, output, output_offset, checkpointer, meter));
+
+        // join every stage explicitly for its result
+        let exited = converter.join().unwrap();
+        formatter.join().unwrap();
+        let write_result = writer.join().unwrap();
+
+        // the input need not be read to its end after an 'exit' or a failed write
+        let read_result = if exited || write_result.is_err()
+        {
+            Ok(())
+        }
+        else
+        {
+            let read_result = reader.join().unwrap();
+            splitter.join().unwrap();
+            parser.join().unwrap();
+            read_result
+        };
+        drop(stop_tx);
+
+        // keep the checkpoint unless the whole input made it to the output
+        match try!(read_result.and(write_result))
+        {
+        Some(checkpointer) => checkpointer.finish(),
+        None => Ok(()),
+        }
+    })
+}
+
+/* Reads the input in fixed size chunks regardless of line boundaries.
+ */
+fn read_stage<R: Read>(mut input: R, chunk_tx: SyncSender<Vec<u8>>, meter: &Meter) -> io::Result<()>
+{
+    loop
+    {
+        let mut chunk = vec![0u8; CHUNK_SIZE];
+        let bytes_read = match input.read(&mut chunk)
+        {
+            Ok(0) => return Ok(()),
+            Ok(count) => count,
+            Err(ref err) if err.kind() == io::ErrorKind::Interrupted => continue,
+            Err(err) => return Err(err),
+        };
+
+        chunk.truncate(bytes_read);
+        Meter::add(&meter.bytes_in, bytes_read as u64);
+
+        let blocked_since = Instant::now();
+
+        if chunk_tx.send(chunk).is_err()
+        {
+            // a later stage has stopped. nothing left to read for
+            return Ok(());
+        }
+
+        Meter::add_time(&meter.read_wait, blocked_since);
+    }
+}
+
+/* Splits chunks into lines, carrying partial lines over to the next chunk.
+ * Invalid UTF-8 is replaced rather than fatal so that one bad line does not
+ * end the batch. Line terminators are discarded. Input offsets are counted
+ * from 'offset', where the reader started. Lines are sent on in batches of
+ * BATCH_LINES, or as many as there are whenever no more input is waiting, so
+ * that input arriving slowly, eg typed or piped from another program, is
+ * converted as it comes.
+ */
+fn split_stage(chunk_rx: Receiver<Vec<u8>>, line_tx: SyncSender<Batch<String>>, mut offset: u64)
+{
+    let mut partial: Vec<u8> = Vec::new();
+    let mut lines: Vec<String> = Vec::with_capacity(BATCH_LINES);
+
+    loop
+    {
+        let chunk = match chunk_rx.try_recv()
+        {
+        Ok(chunk) => chunk,
+        Err(TryRecvError::Empty) => {
+            if !lines.is_empty()
+            {
+                let some = Batch {
+                    items: mem::replace(&mut lines, Vec::with_capacity(BATCH_LINES)),
+                    input_end: offset - partial.len() as u64,
+                };
+
+                if line_tx.send(some).is_err()
+                {
+                    return;
+                }
+            }
+
+            match chunk_rx.recv()
+            {
+            Ok(chunk) => chunk,
+            Err(..) => break,
+            }
+        },
+        Err(TryRecvError::Disconnected) => break,
+        };
+
+        let mut line_start = 0;
+
+        for (index, byte) in chunk.iter().enumerate()
+        {
+            if *byte != b'\n'
+            {
+                continue;
+            }
+
+            let line = if partial.is_empty()
+            {
+                String::from_utf8_lossy(&chunk[line_start..index]).into_owned()
+            }
+            else
+            {
+                partial.extend_from_slice(&chunk[line_start..index]);
+                let joined = String::from_utf8_lossy(&partial).into_owned();
+                partial.clear();
+                joined
+            };
+
+            lines.push(line);
+            line_start = index + 1;
+
+            if lines.len() == BATCH_LINES
+            {
+                let full = Batch {
+                    items: mem::replace(&mut lines, Vec::with_capacity(BATCH_LINES)),
+                    input_end: offset + line_start as u64,
+                };
+
+                if line_tx.send(full).is_err()
+                {
+                    return;
+                }
+            }
+        }
+
+        offset += chunk.len() as u64;
+        partial.extend_from_slice(&chunk[line_start..]);
+    }
+
+    // last line need not be terminated
+    if !partial.is_empty()
+    {
+        lines.push(String::from_utf8_lossy(&partial).into_owned());
+    }
+
+    if !lines.is_empty()
+    {
+        line_tx.send(Batch { items: lines, input_end: offset }).ok();
+    }
+}
+
+/* Tokenizes lines and, for conversions, builds their conversion primitives.
+ * Commands are only tokenized; they change interpreter state and so must be
+ * executed in order by the convert stage.
+ */
+fn parse_stage(line_rx: Receiver<Batch<String>>, record_tx: SyncSender<Batch<Record>>)
+{
+    for lines in line_rx.iter()
+    {
+        let records = Batch {
+            items: lines.items.iter().map(|line| parse_record(line)).collect(),
+            input_end: lines.input_end,
+        };
+
+        if record_tx.send(records).is_err()
+        {
+            return;
+        }
+    }
+}
+
+fn parse_record(line: &str) -> Record
+{
+    let tokens = match tokenize_line(line)
+    {
+        Ok(tokens) => tokens,
+        Err(InterpretErr::BlankLine) => return Record::Blank,
+        Err(err) => return Record::Error(format!("Error: {}", err)),
+    };
+
+    if is_command(tokens[0].peek())
+    {
+        return Record::Command(tokens);
+    }
+
+    if is_directive(tokens[0].peek())
+    {
+        return Record::Directive(tokens);
+    }
+
+    // a line of values only is converted with the units set by directives
+    if parse_number_expr(tokens[tokens.len() - 1].peek()).is_ok()
+    {
+        let values: Result<Vec<NumberExpr>, _> = tokens.iter().map(|tok| parse_number_expr(tok.peek())).collect();
+
+        if let Ok(values) = values
+        {
+            return Record::Values(values);
+        }
+    }
+
+    if tokens.len() < 3
+    {
+        return Record::Error(format!("Error: {}", InterpretErr::IncompleteErr));
+    }
+
+    match to_conv_primitive(&tokens)
+    {
+        Ok(prim) => Record::Convert(prim),
+        Err(err) => Record::Error(format!("In token \'{}\': {}", tokens[err.failed_at].peek(), err)),
+    }
+}
+
+/* Executes commands and performs conversions in input order. This is the only
+ * stage that holds interpreter state, ie the recall variables and format.
+ * Recall depends only on which conversions resolved, never on their results,
+ * so with a window the arithmetic may be left for later: batches are held
+ * until at least 'window' lines are, then finished together and sent on.
+ */
+fn convert_stage(record_rx: Receiver<Batch<Record>>, output_tx: SyncSender<Settled<Vec<Output>>>,
+    units: &UnitDatabase, start: Checkpoint, meter: &Meter, window: Option<usize>) -> bool
+{
+    let mut interpreter: Interpreter<_, _> = Interpreter::using_streams(io::empty(), io::sink());
+    let mut state = start;
+
+    interpreter.format = state.format;
+    interpreter.autoscale = state.autoscale;
+    interpreter.input_value = state.input_value;
+    interpreter.set_input_unit(state.input_unit.as_ref().map(String::as_str));
+    interpreter.set_output_unit(state.output_unit.as_ref().map(String::as_str));
+
+    let mut defaults = Defaults::restore(state.default_from.take(), mem::replace(&mut state.default_to, Vec::new()));
+    let mut window = window.map(Window::new);
+    let mut held: Vec<Settled<Vec<Output>>> = Vec::new();
+    let mut held_lines = 0;
+    let mut next: Option<Batch<Record>> = None;
+
+    loop
+    {
+        let records = match next.take()
+        {
+        Some(records) => records,
+        None => match record_rx.recv()
+        {
+        Ok(records) => records,
+        Err(..) => break,
+        },
+        };
+
+        let mut outputs = Vec::with_capacity(records.items.len());
+        let mut exiting = false;
+        let lines_before = state.lines;
+        let errors_before = state.errors;
+
+        for record in records.items
+        {
+            state.lines += 1;
+
+            let output = match record
+            {
+            Record::Blank => Output::Blank,
+            Record::Error(mesg) => {
+                state.errors += 1;
+                Output::Message(mesg)
+            },
+            Record::Command(tokens) => {
+                match interpreter.execute(tokens)
+                {
+                Err(InterpretErr::ExitSig) => {
+                    exiting = true;
+                    break;
+                },
+                Err(InterpretErr::BlankLine) |
+                Err(InterpretErr::HelpSig) |
+                Err(InterpretErr::VersionSig) => Output::Blank,
+                Err(cmd_mesg @ InterpretErr::CmdSuccess(..)) => Output::Message(cmd_mesg.to_string()),
+                Err(InterpretErr::ReplaySig(prims)) => {
+                    // replayed values are converted whole, outside any window, and not recalled
+                    let mut conversions: Vec<Conversion> = Vec::new();
+
+                    for prim in prims
+                    {
+                        conversions.extend(convert_all(prim, units));
+                    }
+
+                    for conversion in conversions.iter_mut()
+                    {
+                        conversion.format = interpreter.format;
+                    }
+
+                    if conversions.iter().any(|conversion| conversion.result.is_err())
+                    {
+                        state.errors += 1;
+                    }
+
+                    Output::Conversions(conversions)
+                },
+                Err(err) => {
+                    state.errors += 1;
+                    Output::Message(format!("Error: {}", err))
+                },
+                Ok(..) => unreachable!("command line executed as a conversion"),
+                }
+            },
+            Record::Directive(tokens) => {
+                if let Some(ref mut window) = window
+                {
+                    window.defaults_changed();
+                }
+
+                match defaults.apply(tokens, &mut interpreter)
+                {
+                Ok(..) => Output::Blank,
+                Err(err) => {
+                    state.errors += 1;
+                    Output::Message(format!("Error: {}", err))
+                },
+                }
+            },
+            Record::Values(mut values) => {
+                let recall_err = interpreter.recall_values(&mut values);
+
+                match (recall_err, defaults.plans(units, interpreter.autoscale))
+                {
+                (Some(err), _) => {
+                    state.errors += 1;
+                    Output::Message(format!("Error: {}", err))
+                },
+                (None, None) => {
+                    state.errors += 1;
+                    Output::Message(format!("Error: {}", InterpretErr::IncompleteErr))
+                },
+                (None, Some(plans)) => {
+                    let mut conversions = match window
+                    {
+                    Some(ref mut window) => window.prepare_values(&values, plans, held.len(), outputs.len()),
+                    None => convert_with(&values, plans),
+                    };
+
+                    for conversion in conversions.iter_mut()
+                    {
+                        conversion.format = interpreter.format;
+                    }
+
+                    if conversions.iter().any(|conversion| conversion.result.is_err())
+                    {
+                        state.errors += 1;
+                    }
+
+                    interpreter.update_recall(&conversions);
+                    Output::Conversions(conversions)
+                },
+                }
+            },
+            Record::Convert(mut conv_primitive) => {
+                match interpreter.perform_recall(&mut conv_primitive)
+                {
+                Some(err) => {
+                    state.errors += 1;
+                    Output::Message(format!("Error: {}", err))
+                },
+                None => {
+                    let mut conversions = match window
+                    {
+                    Some(ref mut window) => window.prepare(&conv_primitive, units, held.len(), outputs.len()),
+                    None => convert_all(conv_primitive, units),
+                    };
+
+                    for conversion in conversions.iter_mut()
+                    {
+                        conversion.format = interpreter.format;
+                    }
+
+                    if conversions.iter().any(|conversion| conversion.result.is_err())
+                    {
+                        state.errors += 1;
+                    }
+
+                    interpreter.update_recall(&conversions);
+                    Output::Conversions(conversions)
+                },
+                }
+            },
+            };
+
+            outputs.push(output);
+        }
+
+        Meter::add(&meter.lines, state.lines - lines_before);
+        Meter::add(&meter.errors, state.errors - errors_before);
+
+        state.input_offset = records.input_end;
+        state.format = interpreter.format;
+        state.input_value = interpreter.input_value;
+        state.input_unit = interpreter.input_unit().map(str::to_string);
+        state.output_unit = interpreter.output_unit().map(str::to_string);
+        state.default_from = defaults.from_text.clone();
+        state.default_to = defaults.to_text.clone();
+
+        let settled = Settled { items: outputs, state: state.clone() };
+
+        let window = match window
+        {
+        Some(ref mut window) => window,
+        None => {
+            if output_tx.send(settled).is_err() || exiting
+            {
+                return exiting;
+            }
+            continue;
+        },
+        };
+
+        held_lines += settled.items.len();
+        held.push(settled);
+
+        // held lines are finished early rather than waiting on input that is slow to come
+        let idle = match record_rx.try_recv()
+        {
+        Ok(records) => {
+            next = Some(records);
+            false
+        },
+        Err(..) => true,
+        };
+
+        if held_lines >= window.limit || exiting || idle
+        {
+            let added = window.finish(&mut held);
+            state.errors += added;
+            Meter::add(&meter.errors, added);
+            held_lines = 0;
+
+            for settled in held.drain(..)
+            {
+                if output_tx.send(settled).is_err()
+                {
+                    return false;
+                }
+            }
+
+            if exiting
+            {
+                return true;
+            }
+        }
+    }
+
+    if let Some(ref mut window) = window
+    {
+        window.finish(&mut held);
+
+        for settled in held.drain(..)
+        {
+            if output_tx.send(settled).is_err()
+            {
+                return false;
+            }
+        }
+    }
+
+    false
+}
+
+/* Renders each batch of outputs into a single block of text.
+ */
+fn format_stage(output_rx: Receiver<Settled<Vec<Output>>>, text_tx: SyncSender<Settled<String>>)
+{
+    let newline = if cfg!(target_os="windows") { "\r\n" } else { "\n" };
+
+    for outputs in output_rx.iter()
+    {
+        let mut text = String::with_capacity(outputs.items.len() * 24);
+
+        for output in outputs.items.iter()
+        {
+            match *output
+            {
+            Output::Blank => {},
+            Output::Message(ref mesg) => {
+                text.push_str(mesg);
+                text.push_str(newline);
+            },
+            Output::Conversions(ref conversions) => {
+                for conversion in conversions.iter()
+                {
+                    write!(text, "{}{}", conversion, newline).unwrap();
+                }
+            },
+            };
+        }
+
+        if text_tx.send(Settled { items: text, state: outputs.state }).is_err()
+        {
+            return;
+        }
+    }
+}
+
+/* Writes formatted blocks to the output. Returning early on error drops the
+ * queue, which stops every stage before it in turn. If checkpointing, a
+ * checkpoint is recorded after a block whenever one is due. The checkpointer
+ * is handed back once all output is written.
+ */
+fn write_stage<W: io::Write>(text_rx: Receiver<Settled<String>>, output: W, mut output_offset: u64,
+    mut checkpointer: Option<Checkpointer>, meter: &Meter) -> io::Result<Option<Checkpointer>>
+{
+    let mut output = io::BufWriter::with_capacity(CHUNK_SIZE, output);
+
+    loop
+    {
+        let mut text = match text_rx.try_recv()
+        {
+        Ok(text) => text,
+        Err(TryRecvError::Empty) => {
+            // nothing more to write for now. what has been is shown rather than held in the buffer
+            try!(output.flush());
+
+            match text_rx.recv()
+            {
+            Ok(text) => text,
+            Err(..) => break,
+            }
+        },
+        Err(TryRecvError::Disconnected) => break,
+        };
+
+        let busy_since = Instant::now();
+
+        try!(output.write_all(text.items.as_bytes()));
+        output_offset += text.items.len() as u64;
+
+        if let Some(ref mut checkpointer) = checkpointer
+        {
+            if checkpointer.due()
+            {
+                try!(output.flush());
+                text.state.output_offset = output_offset;
+                try!(checkpointer.record(&text.state));
+            }
+        }
+
+        Meter::add_time(&meter.write_busy, busy_since);
+    }
+
+    try!(output.flush());
+
+    Ok(checkpointer)
+}
@@ -0,0 +1,188 @@
+/* runtime/batch/progress.rs
+ * ===
+ * Throughput and progress reporting for batch jobs. Pipeline stages bump shared atomic
+ * counters once per batch; a separate ticker thread samples them at a fixed interval and
+ * reports to stderr, so that the stages themselves never format, lock, or print anything.
+ *
+ * This file is a part of:
+ *
+ * Yucon - General Purpose Unit Converter
+ * Copyright (C) 2016-2017  Blaine Murphy
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use std::io;
+use std::io::Write;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::mpsc::{Receiver, RecvTimeoutError};
+use std::time::{Duration, Instant};
+
+// time between two progress reports
+const REPORT_INTERVAL: Duration = Duration::from_secs(1);
+
+/* struct Meter
+ *
+ * Description: counters shared by the stages of a batch job. Only ever updated
+ *   with relaxed atomic adds; the ticker tolerates slightly stale values.
+ *
+ * Fields:
+ *   - lines      : lines converted or executed so far
+ *   - errors     : lines that produced an error
+ *   - bytes_in   : input bytes read so far
+ *   - read_wait  : ns the reader spent blocked on a full queue, ie waiting on
+ *                  the stages after it
+ *   - write_busy : ns the writer spent writing / syncing its output
+ *   - total      : bytes of input to read in all, if known
+ */
+pub struct Meter
+{
+    pub lines: AtomicU64,
+    pub errors: AtomicU64,
+    pub bytes_in: AtomicU64,
+    pub read_wait: AtomicU64,
+    pub write_busy: AtomicU64,
+    total: Option<u64>,
+    started: Instant,
+}
+
+impl Meter
+{
+    pub fn new(total: Option<u64>) -> Meter
+    {
+        Meter {
+            lines: AtomicU64::new(0),
+            errors: AtomicU64::new(0),
+            bytes_in: AtomicU64::new(0),
+            read_wait: AtomicU64::new(0),
+            write_busy: AtomicU64::new(0),
+            total: total,
+            started: Instant::now(),
+        }
+    }
+
+    pub fn add(counter: &AtomicU64, amount: u64)
+    {
+        counter.fetch_add(amount, Ordering::Relaxed);
+    }
+
+    pub fn add_time(counter: &AtomicU64, since: Instant)
+    {
+        counter.fetch_add(since.elapsed().as_nanos() as u64, Ordering::Relaxed);
+    }
+
+    fn sample(&self) -> Sample
+    {
+        Sample {
+            at: Instant::now(),
+            lines: self.lines.load(Ordering::Relaxed),
+            errors: self.errors.load(Ordering::Relaxed),
+            bytes_in: self.bytes_in.load(Ordering::Relaxed),
+            read_wait: self.read_wait.load(Ordering::Relaxed),
+            write_busy: self.write_busy.load(Ordering::Relaxed),
+        }
+    }
+}
+
+struct Sample
+{
+    at: Instant,
+    lines: u64,
+    errors: u64,
+    bytes_in: u64,
+    read_wait: u64,
+    write_busy: u64,
+}
+
+/* Reports progress to stderr every REPORT_INTERVAL until 'stop' disconnects,
+ * then reports once more with the final totals. Run on its own thread.
+ */
+pub fn ticker(meter: &Meter, stop: Receiver<()>)
+{
+    let mut last = meter.sample();
+
+    loop
+    {
+        let finished = match stop.recv_timeout(REPORT_INTERVAL)
+        {
+        Err(RecvTimeoutError::Timeout) => false,
+        _ => true,
+        };
+
+        let now = meter.sample();
+        report(meter, &last, &now, finished);
+        last = now;
+
+        if finished
+        {
+            return;
+        }
+    }
+}
+
+/* Writes a single report line. Rates are over the last interval; the error
+ * rate and ETA are over the whole job. The bottleneck hint compares how long
+ * the reader sat blocked on the pipeline and the writer sat in its output.
+ */
+fn report(meter: &Meter, last: &Sample, now: &Sample, finished: bool)
+{
+    let secs = duration_secs(now.at - last.at).max(1e-9);
+    let elapsed = now.at - meter.started;
+    let lines_per_sec = (now.lines - last.lines) as f64 / secs;
+    let mb_per_sec = (now.bytes_in - last.bytes_in) as f64 / secs / 1.0e6;
+    let error_pct = if now.lines == 0 { 0.0 } else { 100.0 * now.errors as f64 / now.lines as f64 };
+
+    let eta = match meter.total
+    {
+    Some(total) if !finished && now.bytes_in > 0 => {
+        let remaining = total.saturating_sub(now.bytes_in) as f64;
+        let rate = now.bytes_in as f64 / duration_secs(elapsed).max(1e-9);
+        format_hms(remaining / rate)
+    },
+    _ => "--:--:--".to_string(),
+    };
+
+    let interval_ns = secs * 1.0e9;
+    let bound = if (now.write_busy - last.write_busy) as f64 > 0.5 * interval_ns
+    {
+        "output-bound"
+    }
+    else if (now.read_wait - last.read_wait) as f64 > 0.5 * interval_ns
+    {
+        "cpu-bound"
+    }
+    else
+    {
+        "input-bound"
+    };
+
+    writeln!(io::stderr(),
+             "[{}] {} lines  {:.0} lines/s  {:.1} MB/s  errors {:.2}%  ETA {}  {}",
+             format_hms(duration_secs(elapsed)),
+             now.lines,
+             lines_per_sec,
+             mb_per_sec,
+             error_pct,
+             eta,
+             if finished { "done" } else { bound }).ok();
+}
+
+fn duration_secs(duration: Duration) -> f64
+{
+    duration.as_secs() as f64 + duration.subsec_nanos() as f64 * 1.0e-9
+}
+
+fn format_hms(secs: f64) -> String
+{
+    let secs = secs as u64;
+    format!("{:02}:{:02}:{:02}", secs / 3600, (secs / 60) % 60, secs % 60)
+}
@@ -0,0 +1,239 @@
+/* runtime/batch/window.rs
+ * ===
+ * Plan-locality scheduling for batch mode, enabled with '--window'. Lines of mixed units
+ * otherwise look up and convert each pair of units in turn, one value at a time. With a
+ * window, the convert stage holds back whole batches until the window is full and, for
+ * every conversion in it, only resolves its plan and checks its input. Conversions are
+ * grouped by their pair of units (see PlanKey) so each pair is looked up once per window,
+ * and each group is then run through its plan's kernel in one go. The results are put
+ * back in place before the batches move on to be formatted, so the output is exactly that
+ * of a job without a window.
+ *
+ * This file is a part of:
+ *
+ * Yucon - General Purpose Unit Converter
+ * Copyright (C) 2016-2017  Blaine Murphy
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use std::collections::HashMap;
+use std::slice;
+
+use ::runtime::parse::ConvPrimitive;
+use ::runtime::parse::number::NumberExpr;
+use ::runtime::convert::{Conversion, ConversionPlan};
+use ::runtime::units::UnitDatabase;
+use ::runtime::serve::cache::PlanKey;
+use ::runtime::batch::{Output, Settled};
+
+// a conversion waiting on its plan's kernel: where it is held and its input
+struct Slot
+{
+    batch: usize,
+    line: usize,
+    index: usize,
+    input: f64,
+}
+
+/* struct Window
+ *
+ * Description: the conversions of the batches held back by the convert stage
+ *   that still wait on their arithmetic, grouped by plan. Batches are counted
+ *   from the first one held and lines from the start of their batch.
+ */
+pub struct Window
+{
+    pub limit: usize, // lines to hold before the window is run
+    plans: Vec<ConversionPlan>,
+    keys: HashMap<PlanKey, Vec<usize>>, // indices into plans for each pair
+    defaults: Option<Vec<usize>>, // indices into plans of the directive defaults
+    groups: Vec<Vec<Slot>>, // pending conversions of each plan
+    watch: Vec<(usize, usize)>, // lines without an error so far
+}
+
+impl Window
+{
+    pub fn new(limit: usize) -> Window
+    {
+        Window {
+            limit: limit,
+            plans: Vec::new(),
+            keys: HashMap::new(),
+            defaults: None,
+            groups: Vec::new(),
+            watch: Vec::new(),
+        }
+    }
+
+    // the plans for value only lines must be taken from the defaults again
+    pub fn defaults_changed(&mut self)
+    {
+        self.defaults = None;
+    }
+
+    fn add_plan(&mut self, plan: ConversionPlan) -> usize
+    {
+        self.plans.push(plan);
+        self.groups.push(Vec::new());
+        self.plans.len() - 1
+    }
+
+    /* Prepares the conversions of a line of values with the plans set by
+     * directives, as fn convert_with would make them.
+     */
+    pub fn prepare_values(&mut self, values: &Vec<NumberExpr>, plans: &Vec<ConversionPlan>,
+        batch: usize, line: usize) -> Vec<Conversion>
+    {
+        if self.defaults.is_none()
+        {
+            let indices = plans.iter().map(|plan| self.add_plan(plan.clone())).collect();
+            self.defaults = Some(indices);
+        }
+
+        let indices = self.defaults.take().unwrap();
+        let conversions = self.prepare_line(values, &indices, batch, line);
+        self.defaults = Some(indices);
+
+        conversions
+    }
+
+    /* Prepares the conversions of a fully recalled conversion primitive, as fn
+     * convert_all would make them. Each pair of units is resolved only the
+     * first time it is seen in the window.
+     */
+    pub fn prepare(&mut self, conv_primitive: &ConvPrimitive, units: &UnitDatabase,
+        batch: usize, line: usize) -> Vec<Conversion>
+    {
+        let mut indices = Vec::with_capacity(conv_primitive.output_units.len());
+
+        for to in conv_primitive.output_units.iter()
+        {
+            let key = PlanKey::new(&conv_primitive.input_unit, to);
+
+            if !self.keys.contains_key(&key)
+            {
+                let plans = ConversionPlan::from_exprs_all(&conv_primitive.input_unit, slice::from_ref(to), units);
+                let added = plans.into_iter().map(|plan| self.add_plan(plan)).collect();
+                self.keys.insert(key.clone(), added);
+            }
+
+            indices.extend_from_slice(&self.keys[&key]);
+        }
+
+        self.prepare_line(&conv_primitive.input_vals, &indices, batch, line)
+    }
+
+    fn prepare_line(&mut self, values: &Vec<NumberExpr>, indices: &Vec<usize>,
+        batch: usize, line: usize) -> Vec<Conversion>
+    {
+        let mut conversions = Vec::with_capacity(values.len() * indices.len());
+        let mut failed = false;
+
+        for value_expr in values.iter()
+        {
+            for index in indices.iter()
+            {
+                let conversion = self.plans[*index].prepare(value_expr.value);
+
+                if conversion.result.is_ok()
+                {
+                    self.groups[*index].push(Slot {
+                        batch: batch,
+                        line: line,
+                        index: conversions.len(),
+                        input: value_expr.value,
+                    });
+                }
+                else
+                {
+                    failed = true;
+                }
+
+                conversions.push(conversion);
+            }
+        }
+
+        // only lines that may still fail need to be looked at again
+        if !failed && !conversions.is_empty()
+        {
+            self.watch.push((batch, line));
+        }
+
+        conversions
+    }
+
+    /* Runs every group through its plan and finishes the conversions held in
+     * 'held'. A line counts as one error if any of its conversions failed, so
+     * lines that only failed now are added to the error counts of the batches
+     * they are in and every batch after. Returns how many there were. The
+     * window is then empty and ready for the next batches.
+     */
+    pub fn finish(&mut self, held: &mut Vec<Settled<Vec<Output>>>) -> u64
+    {
+        trace_span!("window_finish");
+        let mut inputs = Vec::new();
+        let mut results = Vec::new();
+
+        for (plan, group) in self.plans.iter().zip(self.groups.iter())
+        {
+            if group.is_empty()
+            {
+                continue;
+            }
+
+            inputs.clear();
+            inputs.extend(group.iter().map(|slot| slot.input));
+            results.clear();
+            results.resize(group.len(), None);
+
+            plan.apply_all(&inputs, &mut results);
+
+            for (slot, result) in group.iter().zip(results.iter())
+            {
+                if let Output::Conversions(ref mut conversions) = held[slot.batch].items[slot.line]
+                {
+                    conversions[slot.index].finish(result.unwrap());
+                }
+            }
+        }
+
+        let mut failed = vec![0u64; held.len()];
+
+        for &(batch, line) in self.watch.iter()
+        {
+            if let Output::Conversions(ref conversions) = held[batch].items[line]
+            {
+                if conversions.iter().any(|conversion| conversion.result.is_err())
+                {
+                    failed[batch] += 1;
+                }
+            }
+        }
+
+        let mut added = 0;
+
+        for (settled, count) in held.iter_mut().zip(failed.iter())
+        {
+            added += *count;
+            settled.state.errors += added;
+        }
+
+        self.plans.clear();
+        self.keys.clear();
+        self.defaults = None;
+        self.groups.clear();
+        self.watch.clear();
+
+        added
+    }
+}
@@ -6,22 +6,18 @@
 
 use std::fmt;
 use std::fmt::{Display, Formatter};
-use std::rc::Rc;
+use std::sync::Arc;
 
 use ::runtime::units::{Unit, UnitDatabase};
 use ::runtime::parse::ConvPrimitive;
-use ::utils::{NO_PREFIX, prefix_as_num};
+use ::runtime::parse::number::NumberExpr;
+use ::runtime::parse::unit::UnitExpr;
+use ::utils::{NO_PREFIX, AUTO_PREFIX};
+use yucon_core::convert::{INPUT, OUTPUT, check_input, check_output};
+use yucon_core::kernel::{Kernel, PlanKind};
+use yucon_core::prefix::{best_prefix, prefix_scale};
 
-
-#[derive(Debug)]
-pub enum ConversionError
-{
-    OutOfRange(bool),   // input or output value not a valid f64, false: input
-    UnitNotFound(bool), // the unit was not found, false: input
-    TypeMismatch,       // the units' types disagree, ie volume into length
-}
-const INPUT: bool = false;
-const OUTPUT: bool = true;
+pub use yucon_core::convert::ConversionError;
 
 
 #[derive(Debug, Copy, Clone)]
@@ -50,12 +46,13 @@ pub struct Conversion
 {
     from_prefix: char,
     to_prefix: char,
-    pub from_alias: String,
-    pub to_alias: String,
-    pub from_tag: Option<String>,
-    pub to_tag: Option<String>,
-    pub from: Option<Rc<Unit>>,
-    pub to: Option<Rc<Unit>>,
+    auto_prefix: bool, // the output prefix was given as AUTO_PREFIX, to be chosen
+    pub from_alias: Arc<String>, // shared with the plan, as are the tags
+    pub to_alias: Arc<String>,
+    pub from_tag: Option<Arc<String>>,
+    pub to_tag: Option<Arc<String>>,
+    pub from: Option<Arc<Unit>>,
+    pub to: Option<Arc<Unit>>,
     pub input: f64,
     pub result: Result<f64, ConversionError>,
     pub format: ConversionFmt,
@@ -63,13 +60,14 @@ pub struct Conversion
 
 impl Conversion
 {
-    fn new(input_prefix: char, input_alias: String, input_tag: Option<String>,
-        output_prefix: char, output_alias: String, output_tag: Option<String>,
+    fn new(input_prefix: char, input_alias: Arc<String>, input_tag: Option<Arc<String>>,
+        output_prefix: char, output_alias: Arc<String>, output_tag: Option<Arc<String>>,
         input_val: f64) -> Conversion
     {
         Conversion {
             from_prefix: input_prefix,
             to_prefix: output_prefix,
+            auto_prefix: output_prefix == AUTO_PREFIX,
             from_alias: input_alias,
             to_alias: output_alias,
             from_tag: input_tag,
@@ -81,6 +79,46 @@ impl Conversion
             format: ConversionFmt::Desc,
         }
     }
+
+    // the prefix of the output unit, after an automatic one has been chosen
+    pub fn to_prefix(&self) -> char
+    {
+        self.to_prefix
+    }
+
+    pub fn from_prefix(&self) -> char
+    {
+        self.from_prefix
+    }
+
+    // the prefix of the output unit as it was given, whether or not it has been chosen yet
+    pub fn given_to_prefix(&self) -> char
+    {
+        if self.auto_prefix { AUTO_PREFIX } else { self.to_prefix }
+    }
+
+    /* Completes a conversion left pending by fn ConversionPlan::prepare given
+     * its value in the output unit. An automatic output prefix is chosen here:
+     * the value is divided by the scale of the prefix that brings it closest
+     * above 1. This is stage 7 of conversion exactly as if that prefix had been
+     * given, so the results are identical.
+     */
+    #[inline]
+    pub fn finish(&mut self, bare: f64)
+    {
+        if self.to_prefix == AUTO_PREFIX
+        {
+            let dimensions = self.to.as_ref().unwrap().dimensions;
+            let prefix = best_prefix(bare, dimensions);
+
+            self.result = check_output(bare / prefix_scale(prefix, dimensions).unwrap());
+            self.to_prefix = prefix;
+        }
+        else
+        {
+            self.result = check_output(bare);
+        }
+    }
 }
 
 impl Display for Conversion
@@ -166,146 +204,301 @@ impl Display for Conversion
 
 
 
-/* Performs a unit conversion given as an input value, input unit and prefix,
- * and an output unit and prefix. Fetches the units from the given units database
- * A struct conversion is returned allowing the caller to do with it as they
- * please. Note that struct Conversion implements the Display trait and tracks
- * its own validity / error state. This function returns as soon as an error is
- * encountered.
- *
- * Parameters:
- *   - input: the value to be converted
- *   - from_prefix: the single character metric prefix of the input unit
- *   - from: name / alias of the unit to that will be converted
- *   - to_prefix: the single character metric prefix of the output unit
- *   - to: name / alias of the unit to convert to
- *   - units: reference to the database that holds all of the units
+// placeholder kernel of a plan whose units did not resolve
+const NO_KERNEL: Kernel<f64> = Kernel::from_parts(PlanKind::Linear, 1.0, 1.0, 0.0, 1.0, 1.0);
+
+/* struct ConversionPlan
  *
- * Stages of Conversion:
- *   1. scale input using prefix and dimensions
- *   2. invert result if necessary
- *   3. change result to base units
- *   4. adjust result to output scale
- *   5. change result to output units
- *   6. invert result if necessary
- *   7. scale result using prefix and dimensions
+ * Description: a conversion from one unit expression to another, resolved
+ *   against the units database once and ready to be applied to any number of
+ *   values. Lookup failures and type mismatches are kept and reported by every
+ *   conversion made with the plan.
  */
-pub fn convert(input: f64, from_prefix: char, from: String, from_tag: Option<String>,
-    to_prefix: char, to: String, to_tag: Option<String>, units: &UnitDatabase) -> Conversion
+#[derive(Debug, Clone)]
+pub struct ConversionPlan
 {
-    //println!("from_tag: {:?}    to_tag: {:?}", from_tag, to_tag);
-    let mut conversion = Conversion::new(from_prefix,from, from_tag,
-                                         to_prefix,to, to_tag,
-                                         input);
-
-    // if the input value is NaN, INF, or too small
-    // Exactly 0 is acceptable however which is_normal() does not account for
-    if (!conversion.input.is_normal()) && (conversion.input != 0.0)
+    from_prefix: char,
+    to_prefix: char,
+    from_alias: Arc<String>,
+    to_alias: Arc<String>,
+    from_tag: Option<Arc<String>>,
+    to_tag: Option<Arc<String>>,
+    from: Option<Arc<Unit>>,
+    to: Option<Arc<Unit>>,
+    error: Option<ConversionError>,
+    kernel: Kernel<f64>,
+}
+
+impl ConversionPlan
+{
+    /* Looks up both units of a conversion and checks that their types agree.
+     *
+     * Parameters:
+     *   - from_prefix: the single character metric prefix of the input unit
+     *   - from: name / alias of the unit to that will be converted
+     *   - to_prefix: the single character metric prefix of the output unit
+     *   - to: name / alias of the unit to convert to
+     *   - units: reference to the database that holds all of the units
+     */
+    pub fn new(from_prefix: char, from: String, from_tag: Option<String>,
+        to_prefix: char, to: String, to_tag: Option<String>, units: &UnitDatabase) -> ConversionPlan
     {
-        conversion.result = Err(ConversionError::OutOfRange(INPUT));
-        return conversion;
+        ConversionPlan::resolve(ConversionPlan {
+            from_prefix: from_prefix,
+            to_prefix: to_prefix,
+            from: units.query(&from, from_tag.as_ref()),
+            to: units.query(&to, to_tag.as_ref()),
+            from_alias: Arc::new(from),
+            to_alias: Arc::new(to),
+            from_tag: from_tag.map(Arc::new),
+            to_tag: to_tag.map(Arc::new),
+            error: None,
+            kernel: NO_KERNEL,
+        })
     }
 
-    conversion.from = units.query(&conversion.from_alias, conversion.from_tag.as_ref());
-    conversion.to = units.query(&conversion.to_alias, conversion.to_tag.as_ref());
-
-    if conversion.from.is_none()
+    /* Plans the conversion between two units already at hand, named by their
+     * common names.
+     */
+    pub fn for_units(from_prefix: char, from: &Arc<Unit>, to_prefix: char, to: &Arc<Unit>) -> ConversionPlan
     {
-        conversion.result = Err(ConversionError::UnitNotFound(INPUT));
+        ConversionPlan::resolve(ConversionPlan {
+            from_prefix: from_prefix,
+            to_prefix: to_prefix,
+            from_alias: from.common_name.clone(),
+            to_alias: to.common_name.clone(),
+            from_tag: None,
+            to_tag: None,
+            from: Some(from.clone()),
+            to: Some(to.clone()),
+            error: None,
+            kernel: NO_KERNEL,
+        })
     }
-    if conversion.to.is_none()
+
+    // checks the units of a plan and builds its kernel
+    fn resolve(mut plan: ConversionPlan) -> ConversionPlan
     {
-        conversion.result = Err(ConversionError::UnitNotFound(OUTPUT));
+        if plan.from.is_none()
+        {
+            plan.error = Some(ConversionError::UnitNotFound(INPUT));
+        }
+        if plan.to.is_none()
+        {
+            plan.error = Some(ConversionError::UnitNotFound(OUTPUT));
+        }
+        if plan.error.is_some()
+        {
+            return plan;
+        }
+
+        if plan.to.as_ref().unwrap().unit_type != plan.from.as_ref().unwrap().unit_type
+        {
+            plan.error = Some(ConversionError::TypeMismatch);
+            return plan;
+        }
+
+        let from_factors = plan.from.as_ref().unwrap().factors();
+        let to_factors = plan.to.as_ref().unwrap().factors();
+        // the input must have a definite prefix
+        let from_scale = match prefix_scale(plan.from_prefix, from_factors.dimensions)
+        {
+        Some(scale) => scale,
+        None => {
+            plan.error = Some(ConversionError::UnitNotFound(INPUT));
+            return plan;
+        },
+        };
+        // an automatic output prefix is applied per value after the kernel
+        let to_scale = prefix_scale(plan.to_prefix, to_factors.dimensions).unwrap_or(1.0);
+
+        // f64 kernels always build
+        plan.kernel = Kernel::new(from_scale, &from_factors, to_scale, &to_factors).unwrap();
+
+        plan
     }
-    if conversion.result.is_err()
+
+    // plans the conversion between two fully recalled unit expressions
+    pub fn from_exprs(from: &UnitExpr, to: &UnitExpr, units: &UnitDatabase) -> ConversionPlan
     {
-        return conversion;
+        ConversionPlan::new(from.prefix, from.alias.clone().unwrap(), from.tag.clone(),
+                            to.prefix, to.alias.clone().unwrap(), to.tag.clone(),
+                            units)
     }
 
-    if conversion.to.as_ref().unwrap().unit_type !=
-        conversion.from.as_ref().unwrap().unit_type
+    /* Plans the conversions from one fully recalled unit expression into each
+     * of several, looking the input unit up only once. An output of '*' (see
+     * ALL_UNITS) stands for every unit of the input unit's type, in the order
+     * they were loaded, each with the output's prefix and named by its common
+     * name.
+     */
+    pub fn from_exprs_all(from: &UnitExpr, to: &[UnitExpr], units: &UnitDatabase) -> Vec<ConversionPlan>
     {
-        conversion.result = Err(ConversionError::TypeMismatch);
-        return conversion;
+        let from_alias = Arc::new(from.alias.clone().unwrap());
+        let from_tag = from.tag.clone().map(Arc::new);
+        let from_unit = units.query(&from_alias, from.tag.as_ref());
+        let mut plans = Vec::with_capacity(to.len());
+
+        for to in to.iter()
+        {
+            let mut plan = ConversionPlan {
+                from_prefix: from.prefix,
+                to_prefix: to.prefix,
+                from_alias: from_alias.clone(),
+                to_alias: Arc::new(to.alias.clone().unwrap()),
+                from_tag: from_tag.clone(),
+                to_tag: to.tag.clone().map(Arc::new),
+                from: from_unit.clone(),
+                to: None,
+                error: None,
+                kernel: NO_KERNEL,
+            };
+
+            if !to.is_all()
+            {
+                plan.to = units.query(&plan.to_alias, to.tag.as_ref());
+                plans.push(ConversionPlan::resolve(plan));
+                continue;
+            }
+
+            let unit_type = match from_unit
+            {
+            Some(ref unit) => unit.unit_type,
+            None => {
+                // there is no type to take the units of
+                plan.error = Some(ConversionError::UnitNotFound(INPUT));
+                plans.push(plan);
+                continue;
+            },
+            };
+
+            for unit in units.of_type(unit_type)
+            {
+                let mut plan = plan.clone();
+                plan.to_alias = unit.common_name.clone();
+                plan.to = Some(unit.clone());
+                plans.push(ConversionPlan::resolve(plan));
+            }
+        }
+
+        plans
     }
 
-    // do not initialize yet. we will fetch these values from conversion
-    let from_conv_factor: f64;
-    let from_zero_point: f64;
-    let from_dims: i32;
-    let from_is_inverse: bool;
-    let to_conv_factor: f64;
-    let to_zero_point: f64;
-    let to_dims: i32;
-    let to_is_inverse: bool;
-    {
-        // borrow scope for retrieving the unit properties
-        // avoids massive method chains on struct Conversion
-        let unit_from = conversion.from.as_ref().unwrap();
-        from_conv_factor = unit_from.conv_factor;
-        from_zero_point = unit_from.zero_point;
-        from_dims = unit_from.dimensions as i32;
-        from_is_inverse = unit_from.inverse;
-
-        let unit_to = conversion.to.as_ref().unwrap();
-        to_conv_factor = unit_to.conv_factor;
-        to_zero_point = unit_to.zero_point;
-        to_dims = unit_to.dimensions as i32;
-        to_is_inverse = unit_to.inverse;
-    } // end borrow scope
-
-    // S1
-    let mut output_val = conversion.input * prefix_as_num(
-        conversion.from_prefix)
-        .unwrap().powi(from_dims);
-
-    // S2
-    if from_is_inverse
+    /* Converts a single value using this plan.
+     *
+     * Stages of Conversion:
+     *   1. scale input using prefix and dimensions
+     *   2. invert result if necessary
+     *   3. change result to base units
+     *   4. adjust result to output scale
+     *   5. change result to output units
+     *   6. invert result if necessary
+     *   7. scale result using prefix and dimensions
+     */
+    pub fn convert(&self, input: f64) -> Conversion
     {
-        output_val = 1.0 / output_val;
-    }
+        let mut conversion = self.prepare(input);
 
-    output_val *= from_conv_factor; // S3
-    output_val += from_zero_point - to_zero_point; // S4
-    output_val /= to_conv_factor; // S5
+        if conversion.result.is_ok()
+        {
+            conversion.finish(self.kernel.apply(input).unwrap());
+        }
 
-    // S6
-    if to_is_inverse
-    {
-        output_val = 1.0 / output_val;
+        conversion
     }
 
-    // S7
-    output_val /= prefix_as_num(conversion.to_prefix).unwrap().powi(to_dims);
+    /* Everything of fn convert but the arithmetic: the input is checked and
+     * the units and any error of the plan are filled in. The conversion is left
+     * pending, with a result of Ok, if it only waits for the arithmetic. It is
+     * then finished with fn Conversion::finish given the value converted by fn
+     * apply_all, so that values of many lines may be run through the kernel
+     * together.
+     */
+    pub fn prepare(&self, input: f64) -> Conversion
+    {
+        let mut conversion = Conversion::new(self.from_prefix, self.from_alias.clone(), self.from_tag.clone(),
+                                             self.to_prefix, self.to_alias.clone(), self.to_tag.clone(),
+                                             input);
 
-    // if the output value is NaN, INF, or too small to properly represent
-    // Exactly 0 is acceptable however which is_normal() does not account for
-    if (!output_val.is_normal()) && (output_val != 0.0)
+        // if the input value is NaN, INF, or too small
+        if let Err(err) = check_input(input)
+        {
+            conversion.result = Err(err);
+            return conversion;
+        }
+
+        conversion.from = self.from.clone();
+        conversion.to = self.to.clone();
+
+        if let Some(err) = self.error
+        {
+            conversion.result = Err(err);
+        }
+
+        conversion
+    }
+
+    /* Runs the plan's kernel over many values at once. Each output is the
+     * value in the output unit, before any automatic prefix, to be given to fn
+     * Conversion::finish. The plan must have resolved without error.
+     */
+    pub fn apply_all(&self, inputs: &[f64], outputs: &mut [Option<f64>])
     {
-        conversion.result = Err(ConversionError::OutOfRange(OUTPUT));
-        return conversion;
+        self.kernel.apply_all(inputs, outputs);
     }
+}
 
-    conversion.result = Ok(output_val);
+/* Performs every conversion described by a conversion primitive: each input
+ * value into each output unit, in that order. Each pair of units is resolved
+ * only once no matter how many values there are. See fn
+ * ConversionPlan::from_exprs_all for output units of '*'.
+ */
+pub fn convert_all(conv_primitive: ConvPrimitive, units: &UnitDatabase) -> Vec<Conversion>
+{
+    trace_span!("convert_all");
+    let plans = ConversionPlan::from_exprs_all(&conv_primitive.input_unit, &conv_primitive.output_units, units);
 
-    conversion
+    convert_with(&conv_primitive.input_vals, &plans)
 }
 
-pub fn convert_all(conv_primitive: ConvPrimitive, units: &UnitDatabase) -> Vec<Conversion>
+/* Converts each value with each of a set of already resolved plans, in that
+ * order. Every value is run through one plan's kernel before the next with fn
+ * ConversionPlan::apply_all, so the kernel is chosen once per plan rather than
+ * once per value.
+ */
+pub fn convert_with(values: &Vec<NumberExpr>, plans: &Vec<ConversionPlan>) -> Vec<Conversion>
 {
-    let mut all_conversions = Vec::with_capacity(1);
+    if values.is_empty()
+    {
+        return Vec::new();
+    }
 
-    for value_expr in conv_primitive.input_vals
+    let inputs: Vec<f64> = values.iter().map(|value_expr| value_expr.value).collect();
+    // the results of each plan in turn, for every value
+    let mut results = vec![None; inputs.len() * plans.len()];
+
+    for (plan, plan_results) in plans.iter().zip(results.chunks_mut(inputs.len()))
     {
-        for output_unit in conv_primitive.output_units.iter()
+        if plan.error.is_none()
         {
-            //println!("{:?}", output_unit);
-            all_conversions.push(
-                convert(value_expr.value,
-                        conv_primitive.input_unit.prefix, conv_primitive.input_unit.alias.clone().unwrap(), conv_primitive.input_unit.tag.clone(),
-                        output_unit.clone().prefix, output_unit.clone().alias.unwrap(), output_unit.tag.clone(),
-                        units)
-            );
+            plan.apply_all(&inputs, plan_results);
+        }
+    }
+
+    let mut all_conversions = Vec::with_capacity(results.len());
+
+    for (index, input) in inputs.iter().enumerate()
+    {
+        for (plan_index, plan) in plans.iter().enumerate()
+        {
+            let mut conversion = plan.prepare(*input);
+
+            if conversion.result.is_ok()
+            {
+                conversion.finish(results[plan_index * inputs.len() + index].unwrap());
+            }
+
+            all_conversions.push(conversion);
         }
     }
 
@@ -0,0 +1,210 @@
+/* runtime/follow module
+ * ===
+ * Follow mode, as 'tail -f'. Lines appended to a file are converted as they are written,
+ * as batch mode would convert them, for as long as the program runs. The units database
+ * is loaded once and pairs of units are resolved into plans once and cached (see
+ * runtime/serve/cache.rs), so each line costs only its conversion.
+ *
+ * Following begins at the end of the file. When there is nothing more to read, the follower
+ * waits to be woken by the file changing (see watch.rs) rather than polling it. A file that
+ * shrinks has been truncated and is read again from its beginning. A file whose path now
+ * names another file has been rotated: the old one is read to its end, then the new one is
+ * followed from its beginning.
+ *
+ * This file is a part of:
+ *
+ * Yucon - General Purpose Unit Converter
+ * Copyright (C) 2016-2017  Blaine Murphy
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+mod watch;
+
+use std::fs;
+use std::fs::File;
+use std::io;
+use std::io::{BufRead, BufReader, BufWriter, Read, Seek, SeekFrom};
+use std::io::Write;
+use std::path::PathBuf;
+use std::time::Duration;
+
+use ::runtime::Interpreter;
+use ::runtime::units::UnitDatabase;
+use ::runtime::state::Options;
+use ::runtime::serve::respond_with;
+use ::runtime::serve::cache::PlanCache;
+use ::runtime::follow::watch::Watch;
+
+// most plans cached at once
+const CACHE_CAPACITY: usize = 4096;
+// longest wait for a wakeup before the file is looked at anyway
+const WAIT_LIMIT: Duration = Duration::from_secs(1);
+
+// a file's identity, which a rotated path no longer has
+#[cfg(unix)]
+fn identity(meta: &fs::Metadata) -> Option<(u64, u64)>
+{
+    use std::os::unix::fs::MetadataExt;
+    Some((meta.dev(), meta.ino()))
+}
+
+#[cfg(not(unix))]
+fn identity(_meta: &fs::Metadata) -> Option<(u64, u64)>
+{
+    // rotation is not detected. truncation still is
+    None
+}
+
+/* struct Follower
+ *
+ * Description: reads a file as it grows. A read only returns once there is
+ *   something to return, so reads never reach the end of the input.
+ */
+pub struct Follower
+{
+    path: PathBuf,
+    file: File,
+    identity: Option<(u64, u64)>,
+    position: u64,
+    watch: Watch,
+}
+
+impl Follower
+{
+    // follows the file at 'path' from its current end
+    pub fn open(path: &str) -> io::Result<Follower>
+    {
+        let mut file = try!(File::open(path));
+        let identity = identity(&try!(file.metadata()));
+        let position = try!(file.seek(SeekFrom::End(0)));
+
+        Ok(Follower {
+            path: PathBuf::from(path),
+            watch: Watch::new(&PathBuf::from(path)),
+            file: file,
+            identity: identity,
+            position: position,
+        })
+    }
+
+    /* Looks for truncation or rotation once the file has been read to its end.
+     * Returns whether there may be more to read now.
+     */
+    fn check(&mut self) -> io::Result<bool>
+    {
+        if try!(self.file.metadata()).len() < self.position
+        {
+            self.position = try!(self.file.seek(SeekFrom::Start(0)));
+            return Ok(true);
+        }
+
+        // a missing path is most likely a rotation halfway done
+        let replaced = match fs::metadata(&self.path)
+        {
+        Ok(meta) => identity(&meta) != self.identity,
+        Err(..) => false,
+        };
+
+        if !replaced
+        {
+            return Ok(false);
+        }
+
+        // the writer may not have moved on to the new file yet
+        if try!(self.file.metadata()).len() > self.position
+        {
+            return Ok(true);
+        }
+
+        let file = match File::open(&self.path)
+        {
+        Ok(file) => file,
+        Err(..) => return Ok(false),
+        };
+
+        self.identity = identity(&try!(file.metadata()));
+        self.file = file;
+        self.position = 0;
+        Ok(true)
+    }
+}
+
+impl Read for Follower
+{
+    fn read(&mut self, buf: &mut [u8]) -> io::Result<usize>
+    {
+        loop
+        {
+            let count = try!(self.file.read(buf));
+
+            if count > 0
+            {
+                self.position += count as u64;
+                return Ok(count);
+            }
+
+            if !try!(self.check())
+            {
+                self.watch.wait(WAIT_LIMIT);
+            }
+        }
+    }
+}
+
+/* Follows the file given with '--follow' and writes the conversions of the
+ * lines appended to it to the file given with '--output' or standard output.
+ * Only returns on an error or if the file gives the command 'exit'.
+ */
+pub fn run_job(opts: &Options, units: &UnitDatabase) -> io::Result<()>
+{
+    let follower = try!(Follower::open(opts.follow_path.as_ref().unwrap()));
+
+    match opts.output_path
+    {
+    Some(ref output_path) => run(follower, try!(File::create(output_path)), opts, units),
+    None => run(follower, io::stdout(), opts, units),
+    }
+}
+
+fn run<W: io::Write>(follower: Follower, output: W, opts: &Options, units: &UnitDatabase) -> io::Result<()>
+{
+    let mut input = BufReader::new(follower);
+    let mut output = BufWriter::new(output);
+    let mut interpreter: Interpreter<_, _> = Interpreter::using_streams(io::empty(), io::sink());
+    let cache = PlanCache::new(CACHE_CAPACITY);
+    let mut line: Vec<u8> = Vec::with_capacity(128);
+
+    interpreter.format = opts.format;
+    interpreter.autoscale = opts.autoscale;
+
+    loop
+    {
+        // the follower never ends, so this only returns whole lines
+        try!(input.read_until(b'\n', &mut line));
+
+        let reply = respond_with(&String::from_utf8_lossy(&line), &mut interpreter, &cache, units);
+        line.clear();
+
+        match reply
+        {
+        Some(text) => try!(output.write_all(text.as_bytes())),
+        None => return output.flush(),
+        };
+
+        // flushed once caught up with the file, so a burst of lines is written together
+        if input.buffer().is_empty()
+        {
+            try!(output.flush());
+        }
+    }
+}
@@ -0,0 +1,171 @@
+/* runtime/follow/watch.rs
+ * ===
+ * Wakeups for follow mode. On Linux, the directory holding the followed file is watched
+ * with inotify, which reports writes to the file as well as files being created, renamed,
+ * or removed in it, so rotation is seen as soon as appends are. A wait also ends after a
+ * limit in case an event is missed, eg on network file systems that do not report them.
+ * Elsewhere, or if inotify cannot be set up, waiting is simply sleeping for that limit.
+ *
+ * This file is a part of:
+ *
+ * Yucon - General Purpose Unit Converter
+ * Copyright (C) 2016-2017  Blaine Murphy
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use std::path::Path;
+use std::thread;
+use std::time::Duration;
+
+#[cfg(target_os = "linux")]
+mod inotify
+{
+    use std::ffi::CString;
+    use std::os::raw::{c_char, c_int, c_short, c_ulong, c_void};
+    use std::os::unix::ffi::OsStrExt;
+    use std::path::Path;
+    use std::time::Duration;
+
+    const IN_NONBLOCK: c_int = 0o4000;
+    const IN_CLOEXEC: c_int = 0o2000000;
+    const IN_MODIFY: u32 = 0x002;
+    const IN_ATTRIB: u32 = 0x004;
+    const IN_MOVED_FROM: u32 = 0x040;
+    const IN_MOVED_TO: u32 = 0x080;
+    const IN_CREATE: u32 = 0x100;
+    const IN_DELETE: u32 = 0x200;
+    const POLLIN: c_short = 0x001;
+
+    #[repr(C)]
+    struct PollFd
+    {
+        fd: c_int,
+        events: c_short,
+        revents: c_short,
+    }
+
+    extern "C"
+    {
+        fn inotify_init1(flags: c_int) -> c_int;
+        fn inotify_add_watch(fd: c_int, path: *const c_char, mask: u32) -> c_int;
+        fn poll(fds: *mut PollFd, nfds: c_ulong, timeout: c_int) -> c_int;
+        fn read(fd: c_int, buf: *mut c_void, count: usize) -> isize;
+        fn close(fd: c_int) -> c_int;
+    }
+
+    pub struct Inotify
+    {
+        fd: c_int,
+    }
+
+    impl Inotify
+    {
+        // watches everything that happens to the files of 'dir'. None if it cannot
+        pub fn watch_dir(dir: &Path) -> Option<Inotify>
+        {
+            let path = match CString::new(dir.as_os_str().as_bytes())
+            {
+            Ok(path) => path,
+            Err(..) => return None,
+            };
+
+            let fd = unsafe { inotify_init1(IN_NONBLOCK | IN_CLOEXEC) };
+            if fd < 0
+            {
+                return None;
+            }
+
+            let mask = IN_MODIFY | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO | IN_CREATE | IN_DELETE;
+            if unsafe { inotify_add_watch(fd, path.as_ptr(), mask) } < 0
+            {
+                unsafe { close(fd); }
+                return None;
+            }
+
+            Some(Inotify { fd: fd })
+        }
+
+        // waits for any event, or for 'limit', and discards the events
+        pub fn wait(&self, limit: Duration)
+        {
+            let mut poll_fd = PollFd { fd: self.fd, events: POLLIN, revents: 0 };
+            let millis = limit.as_secs() as c_int * 1000 + limit.subsec_nanos() as c_int / 1000000;
+
+            unsafe { poll(&mut poll_fd, 1, millis); }
+
+            // which file changed does not matter. the follower looks at its own
+            let mut events = [0u8; 4096];
+            while unsafe { read(self.fd, events.as_mut_ptr() as *mut c_void, events.len()) } > 0 {}
+        }
+    }
+
+    impl Drop for Inotify
+    {
+        fn drop(&mut self)
+        {
+            unsafe { close(self.fd); }
+        }
+    }
+}
+
+#[cfg(not(target_os = "linux"))]
+mod inotify
+{
+    use std::path::Path;
+    use std::time::Duration;
+
+    pub struct Inotify;
+
+    impl Inotify
+    {
+        pub fn watch_dir(_dir: &Path) -> Option<Inotify>
+        {
+            None
+        }
+
+        pub fn wait(&self, _limit: Duration) {}
+    }
+}
+
+/* struct Watch
+ *
+ * Description: wakes the follower when the followed file may have changed.
+ */
+pub struct Watch
+{
+    inotify: Option<inotify::Inotify>,
+}
+
+impl Watch
+{
+    pub fn new(file: &Path) -> Watch
+    {
+        let dir = match file.parent()
+        {
+        Some(dir) if !dir.as_os_str().is_empty() => dir,
+        _ => Path::new("."),
+        };
+
+        Watch { inotify: inotify::Inotify::watch_dir(dir) }
+    }
+
+    // waits until the file may have changed, or for at most 'limit'
+    pub fn wait(&self, limit: Duration)
+    {
+        match self.inotify
+        {
+        Some(ref inotify) => inotify.wait(limit),
+        None => thread::sleep(limit),
+        };
+    }
+}
@@ -0,0 +1,235 @@
+/* runtime/history module
+ * ===
+ * History of the conversions an interpreter has resolved, for recall by index. Eg \';3\' is the
+ * input value of the third to last conversion and \':2\' the output unit of the second to last.
+ *
+ * The history is a ring buffer of a fixed number of entries. Entries hold the value, the
+ * prefixes, and the IDs of the input and output unit names and tags rather than the names
+ * themselves, so recording one is a copy into the next slot and never allocates. Names and tags
+ * are given IDs by a table that grows when one is converted with or set as a recall variable for
+ * the first time. A recall variable may be set to any name, found or not, so the table is capped:
+ * once it is full, the names neither the history nor the recall variables refer to any more are
+ * dropped and the rest given new IDs. See fn UnitNames::compact.
+ *
+ * This file is a part of:
+ *
+ * Yucon - General Purpose Unit Converter
+ * Copyright (C) 2016-2017  Blaine Murphy
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use std::collections::HashMap;
+use std::mem;
+
+use ::utils::NO_PREFIX;
+
+// conversions kept. older ones are overwritten
+pub const HISTORY_LEN: usize = 64;
+
+pub type UnitId = u32;
+
+/* names kept before the unused ones are dropped. at most 4 per entry and the 2 recall variables
+ * are in use at once, so this leaves room for many more
+ */
+pub const NAMES_CAP: usize = 1024;
+
+/* struct UnitNames
+ *
+ * Description: table giving each unit alias seen by an interpreter a small ID. Looking up a
+ *   name already in the table does not allocate.
+ */
+pub struct UnitNames
+{
+    ids: HashMap<String, UnitId>,
+    names: Vec<String>,
+}
+
+impl UnitNames
+{
+    pub fn new() -> UnitNames
+    {
+        UnitNames
+        {
+            ids: HashMap::new(),
+            names: Vec::new(),
+        }
+    }
+
+    // the ID of the name, giving it one if it has none yet
+    pub fn id(&mut self, name: &str) -> UnitId
+    {
+        if let Some(&id) = self.ids.get(name)
+        {
+            return id;
+        }
+
+        let id = self.names.len() as UnitId;
+        self.names.push(name.to_string());
+        self.ids.insert(name.to_string(), id);
+        id
+    }
+
+    pub fn name(&self, id: UnitId) -> &str
+    {
+        &self.names[id as usize]
+    }
+
+    // whether fewer than 'count' more names may be given IDs before the table is full
+    pub fn needs_room(&self, count: usize) -> bool
+    {
+        self.names.len() + count > NAMES_CAP
+    }
+
+    /* Drops every name but those of the entries in the history and the given recall variables,
+     * which are given new IDs in place.
+     */
+    pub fn compact(&mut self, history: &mut History, recall: &mut [&mut Option<UnitId>])
+    {
+        let old = mem::replace(&mut self.names, Vec::new());
+        self.ids.clear();
+
+        for entry in history.entries_mut()
+        {
+            entry.from = self.id(&old[entry.from as usize]);
+            entry.to = self.id(&old[entry.to as usize]);
+            entry.from_tag = entry.from_tag.map(|tag| self.id(&old[tag as usize]));
+            entry.to_tag = entry.to_tag.map(|tag| self.id(&old[tag as usize]));
+        }
+
+        for id in recall.iter_mut()
+        {
+            **id = id.map(|id| self.id(&old[id as usize]));
+        }
+    }
+}
+
+/* struct Entry
+ *
+ * Description: one resolved conversion in the history. The aliases and tags are IDs in the
+ *   interpreter's UnitNames. The prefixes are as they were given, so an automatic output
+ *   prefix is AUTO_PREFIX rather than the prefix chosen for the value.
+ */
+#[derive(Clone, Copy)]
+pub struct Entry
+{
+    pub value: f64,
+    pub from: UnitId,
+    pub from_prefix: char,
+    pub from_tag: Option<UnitId>,
+    pub to: UnitId,
+    pub to_prefix: char,
+    pub to_tag: Option<UnitId>,
+}
+
+/* struct History
+ *
+ * Description: ring buffer of the last HISTORY_LEN resolved conversions.
+ */
+pub struct History
+{
+    entries: [Entry; HISTORY_LEN],
+    next: usize, // slot the next entry is recorded in
+    len: usize,
+}
+
+impl History
+{
+    pub fn new() -> History
+    {
+        History
+        {
+            entries: [Entry { value: 0.0,
+                              from: 0, from_prefix: NO_PREFIX, from_tag: None,
+                              to: 0, to_prefix: NO_PREFIX, to_tag: None }; HISTORY_LEN],
+            next: 0,
+            len: 0,
+        }
+    }
+
+    pub fn record(&mut self, entry: Entry)
+    {
+        self.entries[self.next] = entry;
+        self.next = (self.next + 1) % HISTORY_LEN;
+
+        if self.len < HISTORY_LEN
+        {
+            self.len += 1;
+        }
+    }
+
+    /* The entry 'back' conversions ago. 1 is the last conversion recorded. None if the
+     * history does not go back that far.
+     */
+    pub fn get(&self, back: usize) -> Option<Entry>
+    {
+        if back == 0 || back > self.len
+        {
+            return None;
+        }
+
+        Some(self.entries[(self.next + HISTORY_LEN - back) % HISTORY_LEN])
+    }
+
+    pub fn len(&self) -> usize
+    {
+        self.len
+    }
+
+    // the last 'count' entries, or every entry if there are fewer, oldest first
+    pub fn last(&self, count: usize) -> Last
+    {
+        Last { history: self, back: if count < self.len { count } else { self.len } }
+    }
+
+    // the entries recorded, in no particular order
+    fn entries_mut(&mut self) -> &mut [Entry]
+    {
+        // the ring is only wrapped once it is full
+        &mut self.entries[..self.len]
+    }
+}
+
+/* struct Last
+ *
+ * Description: iterator over the last entries of a History, oldest first. See
+ *   fn History::last.
+ */
+pub struct Last<'a>
+{
+    history: &'a History,
+    back: usize, // entries left, which is also how far back the next one is
+}
+
+impl<'a> Iterator for Last<'a>
+{
+    type Item = Entry;
+
+    fn next(&mut self) -> Option<Entry>
+    {
+        if self.back == 0
+        {
+            return None;
+        }
+
+        let entry = self.history.get(self.back);
+        self.back -= 1;
+        entry
+    }
+
+    fn size_hint(&self) -> (usize, Option<usize>)
+    {
+        (self.back, Some(self.back))
+    }
+}
+
+impl<'a> ExactSizeIterator for Last<'a> {}
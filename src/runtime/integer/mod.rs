@@ -0,0 +1,334 @@
+/* runtime/integer/mod.rs
+ * ===
+ * Integer mode: exact conversion of integer counts, eg sensor readings in micrometres. Each
+ * line of input holds one or more counts separated by spaces and the converted counts are
+ * written in the same layout. Counts never pass through floating point; see yucon_core's
+ * exact.rs for the arithmetic.
+ *
+ * Input is read in large chunks. The counts of every whole line in a chunk are parsed into
+ * one slice, converted together, and formatted, so that the conversion loop runs over many
+ * values at once.
+ *
+ * This file is a part of:
+ *
+ * Yucon - General Purpose Unit Converter
+ * Copyright (C) 2016-2017  Blaine Murphy
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use std::fs::File;
+use std::io;
+use std::io::{BufWriter, Read};
+use std::io::Write as IoWrite;
+use std::mem;
+
+use yucon_core::exact::IntPlan;
+use yucon_core::kernel::Ratio;
+use yucon_core::prefix::prefix_exponent;
+
+use ::runtime::option_unit;
+use ::runtime::parse::unit::UnitExpr;
+use ::runtime::units::UnitDatabase;
+use ::runtime::state::Options;
+
+const CHUNK_SIZE: usize = 256 * 1024;
+
+// a line of input after parsing: the end of its counts in the slice, or an error
+enum Line
+{
+    Counts(usize),
+    Error(String),
+}
+
+fn invalid_input(mesg: String) -> io::Error
+{
+    io::Error::new(io::ErrorKind::InvalidInput, mesg)
+}
+
+// the exact scale of a prefix on a unit of the given dimensions
+fn exact_prefix(expr: &UnitExpr, dimensions: u8) -> Option<Ratio>
+{
+    Ratio::pow10(prefix_exponent(expr.prefix)? * dimensions as i32)
+}
+
+/* Plans the integer conversion given by the program options. Fails if the units
+ * do not exist, disagree in type, or have literals that cannot be used exactly.
+ */
+fn plan(opts: &Options, units: &UnitDatabase) -> io::Result<IntPlan>
+{
+    let from_expr = try!(option_unit("--from", &opts.from_unit));
+    let to_expr = try!(option_unit("--to", &opts.to_unit));
+    let mut resolved = Vec::with_capacity(2);
+
+    for expr in [&from_expr, &to_expr].iter()
+    {
+        let alias = expr.alias.as_ref().unwrap();
+        let unit = match units.query(alias, expr.tag.as_ref())
+        {
+        Some(unit) => unit,
+        None => return Err(invalid_input(format!("no unit named \'{}\'", alias))),
+        };
+        let factors = match unit.exact_factors()
+        {
+        Some(factors) => factors,
+        None => return Err(invalid_input(format!("the numbers of unit \'{}\' are too long for exact conversion",
+                                                 alias))),
+        };
+        let scale = match exact_prefix(expr, unit.dimensions)
+        {
+        Some(scale) => scale,
+        None => return Err(invalid_input(format!("the prefix of \'{}\' is too large for exact conversion", alias))),
+        };
+
+        resolved.push((unit, factors, scale));
+    }
+
+    let (ref from, ref from_factors, from_scale) = resolved[0];
+    let (ref to, ref to_factors, to_scale) = resolved[1];
+
+    if from.unit_type != to.unit_type
+    {
+        return Err(invalid_input(format!("\'{}\' is a {} and \'{}\' is a {}",
+                                         from_expr.alias.as_ref().unwrap(), from.unit_type,
+                                         to_expr.alias.as_ref().unwrap(), to.unit_type)));
+    }
+
+    match IntPlan::new(from_scale, from_factors, to_scale, to_factors, opts.count_scale, opts.rounding)
+    {
+    Some(plan) => Ok(plan),
+    None => Err(invalid_input("the conversion is too large for exact 128-bit arithmetic".to_string())),
+    }
+}
+
+/* Runs an integer conversion as described by the program options. Input and
+ * output are the files given with '--input' and '--output' or standard input
+ * and output.
+ */
+pub fn run_job(opts: &Options, units: &UnitDatabase) -> io::Result<()>
+{
+    let plan = try!(plan(opts, units));
+    let bits = opts.int_bits.unwrap_or(64);
+
+    match (&opts.input_path, &opts.output_path)
+    {
+    (&Some(ref input_path), &Some(ref output_path)) =>
+        run(try!(File::open(input_path)), try!(File::create(output_path)), &plan, bits),
+    (&Some(ref input_path), &None) => run(try!(File::open(input_path)), io::stdout(), &plan, bits),
+    (&None, &Some(ref output_path)) => run(io::stdin(), try!(File::create(output_path)), &plan, bits),
+    (&None, &None) => run(io::stdin(), io::stdout(), &plan, bits),
+    }
+}
+
+/* Converts every line of input and writes the results, one line out for each
+ * line in. Counts that do not fit the integer type, before or after conversion,
+ * and lines that are not counts, are reported in place with an error.
+ */
+pub fn run<R: Read, W: io::Write>(mut input: R, output: W, plan: &IntPlan, bits: u32) -> io::Result<()>
+{
+    let mut output = BufWriter::with_capacity(CHUNK_SIZE, output);
+    let mut chunk = vec![0u8; CHUNK_SIZE];
+    let mut pending: Vec<u8> = Vec::new(); // an unfinished line from the last chunk
+    let mut counts: Vec<i64> = Vec::new();
+    let mut results: Vec<Option<i128>> = Vec::new();
+    let mut lines: Vec<Line> = Vec::new();
+    let mut text: Vec<u8> = Vec::with_capacity(CHUNK_SIZE * 2);
+
+    loop
+    {
+        let read = match input.read(&mut chunk)
+        {
+        Ok(read) => read,
+        Err(ref err) if err.kind() == io::ErrorKind::Interrupted => continue,
+        Err(err) => return Err(err),
+        };
+
+        let data: &[u8] = &chunk[..read];
+        let whole = if read == 0
+        {
+            pending.len()
+        }
+        else
+        {
+            // only whole lines are converted; the rest waits for the next chunk
+            match data.iter().rposition(|&byte| byte == b'\n')
+            {
+            Some(at) => pending.len() + at + 1,
+            None => {
+                pending.extend_from_slice(data);
+                continue;
+            },
+            }
+        };
+
+        pending.extend_from_slice(data);
+        let rest = pending.split_off(whole);
+        let block = mem::replace(&mut pending, rest);
+
+        counts.clear();
+        lines.clear();
+        for line in block.split(|&byte| byte == b'\n')
+        {
+            lines.push(parse_line(line, bits, &mut counts));
+        }
+        // a block ending in a newline leaves an empty piece after it
+        if block.is_empty() || block.last() == Some(&b'\n')
+        {
+            lines.pop();
+        }
+
+        results.clear();
+        results.resize(counts.len(), None);
+        plan.apply_all(&counts, &mut results);
+
+        text.clear();
+        format_lines(&lines, &results, bits, &mut text);
+        try!(output.write_all(&text));
+
+        if read == 0
+        {
+            break;
+        }
+    }
+
+    output.flush()
+}
+
+// parses a line of counts of i<bits> into counts. on error, counts is left as it was
+fn parse_line(line: &[u8], bits: u32, counts: &mut Vec<i64>) -> Line
+{
+    let start = counts.len();
+
+    for token in line.split(|&byte| byte == b' ' || byte == b'\t' || byte == b'\r')
+    {
+        if token.is_empty()
+        {
+            continue;
+        }
+
+        match parse_count(token)
+        {
+        Some(count) if bits != 32 || (count >= i32::min_value() as i64 && count <= i32::max_value() as i64) => {
+            counts.push(count);
+        },
+        Some(..) => {
+            counts.truncate(start);
+            return Line::Error(format!("In token \'{}\': count is out of range for i{}",
+                                       String::from_utf8_lossy(token), bits));
+        },
+        None => {
+            counts.truncate(start);
+            return Line::Error(format!("In token \'{}\': not an integer count", String::from_utf8_lossy(token)));
+        },
+        };
+    }
+
+    Line::Counts(counts.len())
+}
+
+fn parse_count(token: &[u8]) -> Option<i64>
+{
+    let (negative, digits) = match token[0]
+    {
+    b'-' => (true, &token[1..]),
+    b'+' => (false, &token[1..]),
+    _ => (false, token),
+    };
+
+    if digits.is_empty()
+    {
+        return None;
+    }
+
+    // accumulate negatively so that i64::MIN parses
+    let mut value: i64 = 0;
+    for &byte in digits
+    {
+        if byte < b'0' || byte > b'9'
+        {
+            return None;
+        }
+        value = value.checked_mul(10)?.checked_sub((byte - b'0') as i64)?;
+    }
+
+    if negative { Some(value) } else { value.checked_neg() }
+}
+
+fn format_lines(lines: &Vec<Line>, results: &Vec<Option<i128>>, bits: u32, text: &mut Vec<u8>)
+{
+    let newline: &[u8] = if cfg!(target_os="windows") { b"\r\n" } else { b"\n" };
+    let (min, max) = if bits == 32
+    {
+        (i32::min_value() as i128, i32::max_value() as i128)
+    }
+    else
+    {
+        (i64::min_value() as i128, i64::max_value() as i128)
+    };
+    let mut start = 0;
+
+    for line in lines.iter()
+    {
+        match *line
+        {
+        Line::Counts(end) => {
+            let converted = &results[start..end];
+            start = end;
+
+            if converted.iter().any(|result| match *result { Some(value) => value < min || value > max, None => true })
+            {
+                text.extend_from_slice(format!("Error: converted count is out of range for i{}", bits).as_bytes());
+            }
+            else
+            {
+                for (index, result) in converted.iter().enumerate()
+                {
+                    if index > 0
+                    {
+                        text.push(b' ');
+                    }
+                    push_int(result.unwrap(), text);
+                }
+            }
+        },
+        Line::Error(ref mesg) => text.extend_from_slice(mesg.as_bytes()),
+        };
+
+        text.extend_from_slice(newline);
+    }
+}
+
+// formats an integer without going through fmt
+fn push_int(value: i128, text: &mut Vec<u8>)
+{
+    let mut digits = [0u8; 40];
+    let mut at = digits.len();
+    let mut rest = value.unsigned_abs();
+
+    loop
+    {
+        at -= 1;
+        digits[at] = b'0' + (rest % 10) as u8;
+        rest /= 10;
+
+        if rest == 0
+        {
+            break;
+        }
+    }
+
+    if value < 0
+    {
+        text.push(b'-');
+    }
+    text.extend_from_slice(&digits[at..]);
+}
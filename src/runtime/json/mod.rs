@@ -0,0 +1,584 @@
+/* runtime/json/mod.rs
+ * ===
+ * Streaming conversion of numeric fields in JSON documents. Input is scanned a chunk at a
+ * time by a small state machine which tracks only where it is in the document: the member
+ * name or element index at each level of nesting. Every byte is copied to the output as it
+ * is scanned except for numbers at a location matching the field path, which are replaced
+ * by their conversion. Nothing else is reformatted and no document is ever held in memory,
+ * so memory use depends on nesting depth alone, never on the size of arrays or documents.
+ *
+ * Any number of documents may follow one another, separated by whitespace, which covers
+ * NDJSON. The units are resolved into a single conversion plan before scanning starts.
+ *
+ * This file is a part of:
+ *
+ * Yucon - General Purpose Unit Converter
+ * Copyright (C) 2016-2017  Blaine Murphy
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+pub mod path;
+
+use std::fs::File;
+use std::io;
+use std::io::{BufWriter, Read, stderr};
+use std::io::Write as IoWrite;
+use std::str;
+
+use ::runtime::option_unit;
+use ::runtime::convert::{ConversionError, ConversionPlan};
+use ::runtime::units::UnitDatabase;
+use ::runtime::state::Options;
+use ::runtime::json::path::{FieldPath, Location};
+
+const CHUNK_SIZE: usize = 64 * 1024;
+
+// what the scanner accepts next, between tokens
+#[derive(Debug, Copy, Clone, PartialEq)]
+enum Expect
+{
+    Value,
+    ValueOrClose,  // just after '['
+    Member,
+    MemberOrClose, // just after '{'
+    Colon,
+    CommaOrClose,
+}
+
+// the token the scanner is in the middle of, if any
+#[derive(Debug, Copy, Clone, PartialEq)]
+enum Lexeme
+{
+    Between,
+    Str { escaped: bool, member: bool },
+    Number,
+    Literal,
+}
+
+/* struct Rewriter
+ *
+ * Description: the scanner. Fed the input in chunks of any size and writes the
+ *   rewritten document to its output as it goes.
+ */
+pub struct Rewriter<W: io::Write>
+{
+    output: W,
+    path: FieldPath,
+    plan: ConversionPlan,
+    location: Vec<Location>,
+    expect: Expect,
+    lexeme: Lexeme,
+    number: Vec<u8>,   // text of the number being scanned
+    number_at: u64,    // input offset where it began
+    offset: u64,       // input offset of the current chunk
+    pub converted: u64,
+    pub failed: u64,
+}
+
+impl<W: io::Write> Rewriter<W>
+{
+    pub fn new(output: W, path: FieldPath, plan: ConversionPlan) -> Rewriter<W>
+    {
+        Rewriter {
+            output: output,
+            path: path,
+            plan: plan,
+            location: Vec::new(),
+            expect: Expect::Value,
+            lexeme: Lexeme::Between,
+            number: Vec::with_capacity(32),
+            number_at: 0,
+            offset: 0,
+            converted: 0,
+            failed: 0,
+        }
+    }
+
+    /* Scans the next chunk of input. Tokens may be split across chunks in any
+     * way.
+     */
+    pub fn feed(&mut self, chunk: &[u8]) -> io::Result<()>
+    {
+        let mut copy_from = 0; // start of the bytes not yet copied to the output
+        let mut at = 0;
+
+        while at < chunk.len()
+        {
+            let byte = chunk[at];
+
+            match self.lexeme
+            {
+            Lexeme::Str { escaped, member } => {
+                if escaped
+                {
+                    self.lexeme = Lexeme::Str { escaped: false, member: member };
+                }
+                else if byte == b'\\'
+                {
+                    self.lexeme = Lexeme::Str { escaped: true, member: member };
+                }
+                else if byte == b'"'
+                {
+                    self.lexeme = Lexeme::Between;
+
+                    if member
+                    {
+                        if let Some(&mut Location::Member(Some(ref mut name))) = self.location.last_mut()
+                        {
+                            unescape(name);
+                        }
+                        self.expect = Expect::Colon;
+                    }
+                    else
+                    {
+                        self.end_value();
+                    }
+
+                    at += 1;
+                    continue;
+                }
+
+                if member
+                {
+                    if let Some(&mut Location::Member(Some(ref mut name))) = self.location.last_mut()
+                    {
+                        name.push(byte);
+                    }
+                }
+
+                at += 1;
+                continue;
+            },
+            Lexeme::Number => {
+                match byte
+                {
+                b'0' ..= b'9' | b'-' | b'+' | b'.' | b'e' | b'E' => {
+                    self.number.push(byte);
+                    at += 1;
+                    continue;
+                },
+                _ => {
+                    try!(self.end_number());
+                    copy_from = at;
+                },
+                };
+            },
+            Lexeme::Literal => {
+                if byte.is_ascii_alphabetic()
+                {
+                    at += 1;
+                    continue;
+                }
+
+                self.lexeme = Lexeme::Between;
+                self.end_value();
+            },
+            Lexeme::Between => {},
+            };
+
+            let value_next = self.expect == Expect::Value || self.expect == Expect::ValueOrClose;
+            let member_next = self.expect == Expect::Member || self.expect == Expect::MemberOrClose;
+
+            match byte
+            {
+            b' ' | b'\t' | b'\n' | b'\r' => {},
+            b'{' if value_next => {
+                self.location.push(Location::Member(None));
+                self.expect = Expect::MemberOrClose;
+            },
+            b'[' if value_next => {
+                self.location.push(Location::Index(0));
+                self.expect = Expect::ValueOrClose;
+            },
+            b'"' if value_next => self.lexeme = Lexeme::Str { escaped: false, member: false },
+            b'"' if member_next => {
+                if let Some(&mut Location::Member(ref mut name)) = self.location.last_mut()
+                {
+                    *name = Some(Vec::new());
+                }
+
+                self.lexeme = Lexeme::Str { escaped: false, member: true };
+            },
+            b'0' ..= b'9' | b'-' if value_next => {
+                try!(self.output.write_all(&chunk[copy_from..at]));
+                self.number.clear();
+                self.number.push(byte);
+                self.number_at = self.offset + at as u64;
+                self.lexeme = Lexeme::Number;
+            },
+            b't' | b'f' | b'n' if value_next => self.lexeme = Lexeme::Literal,
+            b':' if self.expect == Expect::Colon => self.expect = Expect::Value,
+            b',' if self.expect == Expect::CommaOrClose => {
+                match self.location.last_mut()
+                {
+                Some(&mut Location::Index(ref mut index)) => {
+                    *index += 1;
+                    self.expect = Expect::Value;
+                },
+                Some(&mut Location::Member(ref mut name)) => {
+                    *name = None;
+                    self.expect = Expect::Member;
+                },
+                None => return Err(self.malformed(at)),
+                };
+            },
+            b'}' if self.expect == Expect::MemberOrClose || self.expect == Expect::CommaOrClose => {
+                match self.location.pop()
+                {
+                Some(Location::Member(..)) => self.end_value(),
+                _ => return Err(self.malformed(at)),
+                };
+            },
+            b']' if self.expect == Expect::ValueOrClose || self.expect == Expect::CommaOrClose => {
+                match self.location.pop()
+                {
+                Some(Location::Index(..)) => self.end_value(),
+                _ => return Err(self.malformed(at)),
+                };
+            },
+            _ => return Err(self.malformed(at)),
+            };
+
+            at += 1;
+        }
+
+        // the bytes of an unfinished number are held until it ends
+        if self.lexeme != Lexeme::Number
+        {
+            try!(self.output.write_all(&chunk[copy_from..]));
+        }
+
+        self.offset += chunk.len() as u64;
+        Ok(())
+    }
+
+    /* Ends the input. Fails if it stopped in the middle of a document. Returns
+     * the output, flushed.
+     */
+    pub fn finish(mut self) -> io::Result<W>
+    {
+        match self.lexeme
+        {
+        Lexeme::Number => try!(self.end_number()),
+        Lexeme::Literal => self.end_value(),
+        Lexeme::Str { .. } => return Err(self.truncated()),
+        Lexeme::Between => {},
+        };
+
+        if !self.location.is_empty()
+        {
+            return Err(self.truncated());
+        }
+
+        try!(self.output.flush());
+        Ok(self.output)
+    }
+
+    // a value was completed: a scalar or the closing of a container
+    fn end_value(&mut self)
+    {
+        self.expect = if self.location.is_empty() { Expect::Value } else { Expect::CommaOrClose };
+    }
+
+    // writes out a finished number, converted if it is one of the fields
+    fn end_number(&mut self) -> io::Result<()>
+    {
+        self.lexeme = Lexeme::Between;
+        self.end_value();
+
+        if !self.path.matches(&self.location)
+        {
+            return self.output.write_all(&self.number);
+        }
+
+        let input = match str::from_utf8(&self.number).ok().and_then(|text| text.parse::<f64>().ok())
+        {
+        Some(input) => input,
+        None => return Err(io::Error::new(io::ErrorKind::InvalidData,
+                                          format!("malformed number at byte {}", self.number_at))),
+        };
+
+        let conversion = self.plan.convert(input);
+
+        match conversion.result
+        {
+        // JSON has no INF or NaN, so they are failures too
+        Ok(output) if output.is_finite() => {
+            self.converted += 1;
+            write!(self.output, "{}", output)
+        },
+        Ok(output) => {
+            self.failed += 1;
+            writeln!(stderr(), "At byte {}: {} is not a JSON number", self.number_at, output).ok();
+            self.output.write_all(&self.number)
+        },
+        Err(..) => {
+            self.failed += 1;
+            writeln!(stderr(), "At byte {}: {}", self.number_at, conversion).ok();
+            self.output.write_all(&self.number)
+        },
+        }
+    }
+
+    fn malformed(&self, at: usize) -> io::Error
+    {
+        io::Error::new(io::ErrorKind::InvalidData,
+                       format!("malformed JSON at byte {}", self.offset + at as u64))
+    }
+
+    fn truncated(&self) -> io::Error
+    {
+        io::Error::new(io::ErrorKind::UnexpectedEof, "input ended in the middle of a JSON document")
+    }
+}
+
+/* Decodes the escape sequences of a member name in place so that it is compared
+ * to the field path as the name it stands for. A name with a malformed escape is
+ * left as it was written.
+ */
+fn unescape(name: &mut Vec<u8>)
+{
+    if !name.contains(&b'\\')
+    {
+        return;
+    }
+
+    let mut decoded = Vec::with_capacity(name.len());
+    let mut at = 0;
+
+    while at < name.len()
+    {
+        let byte = name[at];
+        at += 1;
+
+        if byte != b'\\'
+        {
+            decoded.push(byte);
+            continue;
+        }
+
+        let escape = match name.get(at)
+        {
+        Some(&escape) => escape,
+        None => return,
+        };
+        at += 1;
+
+        let ch = match escape
+        {
+        b'"' => '"',
+        b'\\' => '\\',
+        b'/' => '/',
+        b'b' => '\u{8}',
+        b'f' => '\u{c}',
+        b'n' => '\n',
+        b'r' => '\r',
+        b't' => '\t',
+        b'u' => {
+            let unit = match hex4(name, at)
+            {
+            Some(unit) => unit,
+            None => return,
+            };
+            at += 4;
+
+            // characters beyond the BMP are written as a pair of surrogates
+            if unit >= 0xd800 && unit < 0xdc00 && name[at..].starts_with(b"\\u")
+            {
+                match hex4(name, at + 2)
+                {
+                Some(low) if low >= 0xdc00 && low < 0xe000 => {
+                    at += 6;
+                    char::from_u32(0x10000 + ((unit - 0xd800) << 10) + (low - 0xdc00)).unwrap()
+                },
+                _ => '\u{fffd}',
+                }
+            }
+            else
+            {
+                char::from_u32(unit).unwrap_or('\u{fffd}')
+            }
+        },
+        _ => return,
+        };
+
+        let mut buf = [0u8; 4];
+        decoded.extend_from_slice(ch.encode_utf8(&mut buf).as_bytes());
+    }
+
+    *name = decoded;
+}
+
+// the four hex digits of a \u escape at 'at'
+fn hex4(text: &[u8], at: usize) -> Option<u32>
+{
+    let digits = text.get(at..at + 4)?;
+
+    if !digits.iter().all(|digit| digit.is_ascii_hexdigit())
+    {
+        return None;
+    }
+
+    u32::from_str_radix(str::from_utf8(digits).unwrap(), 16).ok()
+}
+
+fn invalid_input(mesg: String) -> io::Error
+{
+    io::Error::new(io::ErrorKind::InvalidInput, mesg)
+}
+
+/* Runs a JSON conversion as described by the program options: the fields named
+ * by '--field' are converted from the '--from' unit into the '--to' unit. Input
+ * and output are the files given with '--input' and '--output' or standard
+ * input and output.
+ */
+pub fn run_job(opts: &Options, units: &UnitDatabase) -> io::Result<()>
+{
+    let path = match opts.field
+    {
+    Some(ref field) => try!(FieldPath::parse(field).map_err(invalid_input)),
+    None => return Err(invalid_input("program option --field is required".to_string())),
+    };
+    let from = try!(option_unit("--from", &opts.from_unit));
+    let to = try!(option_unit("--to", &opts.to_unit));
+    let plan = ConversionPlan::from_exprs(&from, &to, units);
+
+    // report a bad pair of units up front rather than once per field
+    let probe = plan.convert(0.0);
+    match probe.result
+    {
+    Err(ConversionError::UnitNotFound(..)) |
+    Err(ConversionError::TypeMismatch) => return Err(invalid_input(probe.to_string())),
+    _ => {},
+    };
+
+    let rewriter = match opts.output_path
+    {
+    Some(ref output_path) => Rewriter::new(BufWriter::new(try!(File::create(output_path))), path, plan),
+    None => return run_with(opts, Rewriter::new(BufWriter::new(io::stdout()), path, plan)),
+    };
+
+    run_with(opts, rewriter)
+}
+
+fn run_with<W: io::Write>(opts: &Options, rewriter: Rewriter<W>) -> io::Result<()>
+{
+    match opts.input_path
+    {
+    Some(ref input_path) => run(try!(File::open(input_path)), rewriter),
+    None => run(io::stdin(), rewriter),
+    }
+}
+
+/* Streams the input through the rewriter. Fields that could not be converted
+ * are reported to stderr as they are found and left as they were.
+ */
+pub fn run<R: Read, W: io::Write>(mut input: R, mut rewriter: Rewriter<W>) -> io::Result<()>
+{
+    let mut chunk = vec![0u8; CHUNK_SIZE];
+
+    loop
+    {
+        let read = match input.read(&mut chunk)
+        {
+        Ok(0) => break,
+        Ok(read) => read,
+        Err(ref err) if err.kind() == io::ErrorKind::Interrupted => continue,
+        Err(err) => return Err(err),
+        };
+
+        try!(rewriter.feed(&chunk[..read]));
+    }
+
+    let failed = rewriter.failed;
+    try!(rewriter.finish());
+
+    if failed > 0
+    {
+        writeln!(stderr(), "{} field(s) could not be converted and were left unchanged", failed).ok();
+    }
+
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests
+{
+    use super::*;
+    use ::runtime::units::reader::read_units;
+    use ::utils::NO_PREFIX;
+
+    const DOCUMENT: &'static str = "{\"readings\": [{\"temp\": 1.5, \"name\": \"a, \\\"temp\\\": 2\"},\n\
+                                    \t{\"te\\u006dp\" :-2e3 , \"other\": 7}  , {\"temp\": \"3\"}],\n\
+                                    \"temp\": 4}\n[{\"temp\": 5}] {\"readings\": [{\"temp\": 0.25}]}\n";
+
+    const REWRITTEN: &'static str = "{\"readings\": [{\"temp\": 1500, \"name\": \"a, \\\"temp\\\": 2\"},\n\
+                                     \t{\"te\\u006dp\" :-2000000 , \"other\": 7}  , {\"temp\": \"3\"}],\n\
+                                     \"temp\": 4}\n[{\"temp\": 5}] {\"readings\": [{\"temp\": 250}]}\n";
+
+    fn rewriter() -> Rewriter<Vec<u8>>
+    {
+        let cfg = "[kilometer]\n\taliases = km\n\ttype = length\n\tconv_factor = 1000000\n\
+                   [meter]\n\taliases = m\n\ttype = length\n\tconv_factor = 1000\n";
+        let mut units = UnitDatabase::new();
+
+        for unit in read_units(cfg.as_bytes(), &mut |_| {})
+        {
+            units.add(unit.init.unit, &unit.aliases, &unit.tags);
+        }
+        units.freeze();
+
+        let plan = ConversionPlan::new(NO_PREFIX, "km".to_string(), None, NO_PREFIX, "m".to_string(), None, &units);
+        Rewriter::new(Vec::new(), FieldPath::parse("$.readings[*].temp").unwrap(), plan)
+    }
+
+    // the output of the rewriter fed 'chunks' in turn, with its counts of converted and failed fields
+    fn rewrite<'a, I: Iterator<Item = &'a [u8]>>(chunks: I) -> (String, u64, u64)
+    {
+        let mut rewriter = rewriter();
+
+        for chunk in chunks
+        {
+            rewriter.feed(chunk).unwrap();
+        }
+
+        let (converted, failed) = (rewriter.converted, rewriter.failed);
+        (String::from_utf8(rewriter.finish().unwrap()).unwrap(), converted, failed)
+    }
+
+    #[test]
+    fn rewrites_only_the_fields()
+    {
+        assert_eq!(rewrite(Some(DOCUMENT.as_bytes()).into_iter()), (REWRITTEN.to_string(), 3, 0));
+
+        // a result out of range is reported and the field left as it was
+        let out_of_range = "{\"readings\": [{\"temp\": 1e400}, {\"temp\": 2}]}";
+        assert_eq!(rewrite(Some(out_of_range.as_bytes()).into_iter()),
+                   ("{\"readings\": [{\"temp\": 1e400}, {\"temp\": 2000}]}".to_string(), 1, 1));
+    }
+
+    #[test]
+    fn chunk_splits_do_not_change_the_output()
+    {
+        let bytes = DOCUMENT.as_bytes();
+        let expected = (REWRITTEN.to_string(), 3, 0);
+
+        for at in 0..bytes.len() + 1
+        {
+            assert_eq!(rewrite(vec![&bytes[..at], &bytes[at..]].into_iter()), expected, "split at {}", at);
+        }
+
+        assert_eq!(rewrite(bytes.chunks(1)), expected);
+        assert_eq!(rewrite(bytes.chunks(7)), expected);
+    }
+}
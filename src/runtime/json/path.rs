@@ -0,0 +1,148 @@
+/* runtime/json/path.rs
+ * ===
+ * Field paths for JSON conversion. A path is a small subset of JSONPath naming the numeric
+ * fields to rewrite:
+ *
+ *   $             - the root of each document
+ *   .name         - member 'name' of an object. also ['name'] or ["name"]
+ *   [N]           - element N of an array, counting from 0
+ *   [*] or .*     - any member or element
+ *
+ * eg '$.readings[*].temp'. Member names are compared byte for byte with the names they stand
+ * for, escape sequences in the document decoded, eg "te\u006dp" matches '.temp'.
+ *
+ * This file is a part of:
+ *
+ * Yucon - General Purpose Unit Converter
+ * Copyright (C) 2016-2017  Blaine Murphy
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* enum Step
+ *
+ * Description: one level of a field path
+ */
+#[derive(Debug, Clone, PartialEq)]
+pub enum Step
+{
+    Member(Vec<u8>),
+    Index(usize),
+    Any,
+}
+
+/* enum Location
+ *
+ * Description: where the scanner is within one level of a document. In an
+ *   object, the name of the current member once it has been read.
+ */
+#[derive(Debug)]
+pub enum Location
+{
+    Member(Option<Vec<u8>>),
+    Index(usize),
+}
+
+pub struct FieldPath
+{
+    steps: Vec<Step>,
+}
+
+impl FieldPath
+{
+    /* Parses a field path. On failure, returns a message describing what is
+     * wrong with it.
+     */
+    pub fn parse(text: &str) -> Result<FieldPath, String>
+    {
+        let bytes = text.as_bytes();
+
+        if bytes.first() != Some(&b'$')
+        {
+            return Err(format!("field path \'{}\' must begin with \'$\'", text));
+        }
+
+        let mut steps = Vec::new();
+        let mut at = 1;
+
+        while at < bytes.len()
+        {
+            match bytes[at]
+            {
+            b'.' => {
+                let start = at + 1;
+                at = start;
+
+                while at < bytes.len() && bytes[at] != b'.' && bytes[at] != b'['
+                {
+                    at += 1;
+                }
+
+                match &bytes[start..at]
+                {
+                b"" => return Err(format!("empty member name in field path \'{}\'", text)),
+                b"*" => steps.push(Step::Any),
+                name => steps.push(Step::Member(name.to_vec())),
+                };
+            },
+            b'[' => {
+                let close = match bytes[at..].iter().position(|&byte| byte == b']')
+                {
+                Some(offset) => at + offset,
+                None => return Err(format!("unclosed \'[\' in field path \'{}\'", text)),
+                };
+                let inner = &text[at + 1..close];
+
+                if inner == "*"
+                {
+                    steps.push(Step::Any);
+                }
+                else if inner.len() >= 2 && (inner.starts_with('\'') && inner.ends_with('\'') ||
+                                             inner.starts_with('"') && inner.ends_with('"'))
+                {
+                    steps.push(Step::Member(inner[1..inner.len() - 1].as_bytes().to_vec()));
+                }
+                else
+                {
+                    match inner.parse::<usize>()
+                    {
+                    Ok(index) => steps.push(Step::Index(index)),
+                    Err(..) => return Err(format!("bad index \'{}\' in field path \'{}\'", inner, text)),
+                    };
+                }
+
+                at = close + 1;
+            },
+            _ => return Err(format!("expected \'.\' or \'[\' at position {} of field path \'{}\'", at, text)),
+            };
+        }
+
+        Ok(FieldPath { steps: steps })
+    }
+
+    // checks if the value at the given location in a document is one of the path's fields
+    pub fn matches(&self, location: &Vec<Location>) -> bool
+    {
+        if location.len() != self.steps.len()
+        {
+            return false;
+        }
+
+        self.steps.iter().zip(location.iter()).all(|(step, level)| match (step, level)
+        {
+        (&Step::Any, _) => true,
+        (&Step::Member(ref name), &Location::Member(Some(ref member))) => name == member,
+        (&Step::Index(index), &Location::Index(element)) => index == element,
+        _ => false,
+        })
+    }
+}
@@ -22,10 +22,17 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+pub mod batch;
 pub mod convert;
+pub mod follow;
+pub mod history;
+pub mod integer;
+pub mod json;
 pub mod parse;
-mod state;
+pub mod serve;
+pub mod state;
 pub mod units;
+pub mod verify;
 
 use std::io;
 use std::io::Read;
@@ -35,18 +42,22 @@ use std::fmt;
 use std::fmt::Display;
 use std::fmt::Write;
 use std::error::Error;
+use std::thread;
 
 use ::utils::*;
 use ::runtime::parse::ConvPrimitive;
 use ::runtime::parse::number::{parse_number_expr, NumberExpr};
 use ::runtime::parse::unit::{parse_unit_expr, UnitExpr};
 use ::runtime::convert::{Conversion, ConversionFmt, ConversionError};
+use ::runtime::history::{Entry, History, UnitId, UnitNames};
 use runtime::units::UnitDatabase;
 use runtime::state::Options;
-use std::io::Write;
+use std::io::Write as IoWrite;
 use runtime::units::config::load_units_list;
 
-static NONLITERAL_RECALL_MSG: &'static str = "recall variables must be literals";
+pub static NONLITERAL_RECALL_MSG: &'static str = "recall variables must be literals";
+pub static AUTO_INPUT_MSG: &'static str = "automatic metric prefix \'*\' is only for output units";
+pub static ALL_INPUT_MSG: &'static str = "every unit \'*\' is only for output units";
 
 #[derive(Debug)]
 pub enum InterpretErr
@@ -58,12 +69,15 @@ pub enum InterpretErr
     RecallErr(String, String),
     UnknownLongOpt(String),
     UnknownShortOpt(char),
+    MissingOptArg(String),
+    BadOptArg(String, String),
     IncompleteErr,
     ExitSig,
     BlankLine,
     HelpSig,
     VersionSig,
-    ConversionSig
+    ConversionSig,
+    ReplaySig(Vec<ConvPrimitive>), // conversions to carry out for a 'replay' command
 }
 
 impl Error for InterpretErr
@@ -78,12 +92,15 @@ impl Error for InterpretErr
         InterpretErr::TokenizeErr(ref err) => err.description(),
         InterpretErr::RecallErr(..) => "unable to recall variable",
         InterpretErr::UnknownLongOpt(..) | InterpretErr::UnknownShortOpt(..) => "unknown program option",
+        InterpretErr::MissingOptArg(..) => "program option requires an argument",
+        InterpretErr::BadOptArg(..) => "invalid argument for program option",
         InterpretErr::IncompleteErr => "command is incomplete",
         InterpretErr::ExitSig => "user terminated session",
         InterpretErr::BlankLine => "no action",
         InterpretErr::HelpSig => "user requested help",
         InterpretErr::VersionSig => "user requested version",
         InterpretErr::ConversionSig => "user issued conversion",
+        InterpretErr::ReplaySig(..) => "user issued replay",
         }
     }
 
@@ -124,6 +141,12 @@ impl Display for InterpretErr
         InterpretErr::UnknownShortOpt(ref opt) => {
             write!(f, "{}: {}", self.description(), opt)
         },
+        InterpretErr::MissingOptArg(ref opt) => {
+            write!(f, "{}: {}", self.description(), opt)
+        },
+        InterpretErr::BadOptArg(ref opt, ref arg) => {
+            write!(f, "{} {}: \'{}\'", self.description(), opt, arg)
+        },
         _ => {
             write!(f, "{}", self.description())
         },
@@ -210,24 +233,133 @@ impl SyntaxChecker for LineCheck
     {
         self.esc = false;
     }
+    fn special_bytes(&self) -> Option<&'static [u8]>
+    {
+        Some(b" #\n\r")
+    }
 }
 
+// keywords recognized as commands when they begin a line
+static COMMANDS: [&'static str; 9] = ["exit",
+                                      "format",
+                                      "help",
+                                      "history",
+                                      "input_unit",
+                                      "output_unit",
+                                      "replay",
+                                      "value",
+                                      "version",];
+
+/* Checks if the given word begins a command rather than a conversion.
+ */
+pub fn is_command(word: &str) -> bool
+{
+    COMMANDS.contains(&word)
+}
+
+// parses a unit given with '--from' or '--to'. recall is meaningless here
+pub fn option_unit(opt: &str, text: &Option<String>) -> io::Result<UnitExpr>
+{
+    let text = match *text
+    {
+    Some(ref text) => text,
+    None => return Err(io::Error::new(io::ErrorKind::InvalidInput, format!("program option {} is required", opt))),
+    };
+
+    let expr = match parse_unit_expr(text)
+    {
+    Ok(expr) => expr,
+    Err(err) => return Err(io::Error::new(io::ErrorKind::InvalidInput, format!("In unit \'{}\': {}", text, err))),
+    };
+
+    if expr.recall || expr.alias.is_none()
+    {
+        return Err(io::Error::new(io::ErrorKind::InvalidInput, format!("In unit \'{}\': {}", text, NONLITERAL_RECALL_MSG)));
+    }
+
+    if expr.is_all()
+    {
+        return Err(io::Error::new(io::ErrorKind::InvalidInput,
+                                  format!("In unit \'{}\': every unit \'*\' is not allowed here", text)));
+    }
+
+    // the output is bare numbers. the prefix chosen could never be shown
+    if expr.prefix == AUTO_PREFIX
+    {
+        return Err(io::Error::new(io::ErrorKind::InvalidInput,
+                                  format!("In unit \'{}\': automatic metric prefix \'*\' is not allowed here", text)));
+    }
+
+    Ok(expr)
+}
+
+/* Tokenizes a raw line of interpreter input at spaces, discarding comments,
+ * delimiters, and blank tokens. Returns BlankLine if nothing is left. This is
+ * the stateless half of fn Interpreter::interpret and may be run ahead of or
+ * apart from the interpreter that will execute the line.
+ */
+pub fn tokenize_line(raw_line: &str) -> Result<Vec<TokenType>, InterpretErr>
+{
+    let mut line_checker = LineCheck::new();
+    let mut tokens = try!(tokenize(raw_line, &mut line_checker));
+
+    tokens.retain(|tok| !tok.is_empty());
+    tokens.retain(|tok| match *tok{ TokenType::Delim(..) => false, _ => true });
+
+    if line_checker.argc == 0
+    {
+        return Err(InterpretErr::BlankLine);
+    }
+
+    Ok(tokens)
+}
+
+/* struct Boostrapper
+ *
+ * Description: orchestrates startup. Loading the units database is by far the
+ *   slowest part of it, so it is begun on a background thread as soon as the
+ *   options are parsed and only waited for when the units are first needed.
+ *   In an interactive session the greeting is shown and the first line read in
+ *   the meantime. The database is never loaded at all when the options ask for
+ *   help or the version or are not valid.
+ */
 pub struct Boostrapper
 {
+    loader: Option<thread::JoinHandle<Option<UnitDatabase>>>,
     units_db: Option<UnitDatabase>,
-    program_state: Option<Options>,
-    //input_stream: Option<>,
+    fold: bool, // index the folded names of the units. see units/fold.rs
+    opts: Option<Result<(Options, Vec<String>), InterpretErr>>, // parsed by fn start
 }
 
 impl Boostrapper
 {
     pub fn create() -> Boostrapper
     {
-        Bootstrapper
+        Boostrapper
         {
+            loader: None,
             units_db: None,
-            program_state: None,
+            fold: false,
+            opts: None,
+        }
+    }
+
+    /* Parses the program options and begins loading the units database in the
+     * background, unless the options ask for help or the version or are not
+     * valid, in which case nothing will need it. See fn parse_opts.
+     */
+    pub fn start(&mut self)
+    {
+        let opts = Options::get_opts();
+
+        if let Ok((ref opts, _)) = opts
+        {
+            let fold = opts.fold_names;
+            self.fold = fold;
+            self.loader = Some(thread::spawn(move || load_units_list(fold)));
         }
+
+        self.opts = Some(opts);
     }
 
     /**
@@ -238,6 +370,9 @@ impl Boostrapper
      * or failure of per-user configurations, unless the default units.cfg file at /etc/yucon/units.cfg
      * or in the executable path also does not exist.
      *
+     * If loading was begun by fn start, this waits for it to finish instead. Once loaded, the
+     * database is kept and this returns immediately.
+     *
      * This method will automatically inform the user of errors loading / parsing the file. On
      * successful loading of the units.cfg file, TRUE will be returned.
      *
@@ -245,35 +380,49 @@ impl Boostrapper
      */
     pub fn load_units_db(&mut self) -> bool
     {
-        self.units_db = load_units_list();
-        self.units_db == None
+        if self.units_db.is_none()
+        {
+            self.units_db = match self.loader.take()
+            {
+            Some(loader) => loader.join().unwrap_or(None),
+            None => load_units_list(self.fold),
+            };
+        }
+
+        self.units_db.is_some()
     }
 
-    pub fn parse_opts(&mut self) -> Result<(), InterpretErr>
+    // the units database, waiting for it or loading it if need be
+    pub fn units(&mut self) -> Option<&UnitDatabase>
     {
-        // TODO handle extra args
-        let (opts, extra_args) = Options::get_opts()?;
-        self.program_state = Some(opts);
-
-        Ok(())
+        if self.load_units_db() { self.units_db.as_ref() } else { None }
     }
 
-    /*
-    pub fn get_interpreter(&self) -> Result<Interpreter, String>
+    /* The program options, as parsed by fn start or parsed now if it was not
+     * called. Returns them along with the arguments left over for a single use
+     * conversion.
+     */
+    pub fn parse_opts(&mut self) -> Result<(Options, Vec<String>), InterpretErr>
     {
-
+        match self.opts.take()
+        {
+        Some(opts) => opts,
+        None => Options::get_opts(),
+        }
     }
-    */
 }
 
 pub struct Interpreter<I, O> where I: Read, O: io::Write
 {
     pub format: ConversionFmt,
+    pub autoscale: bool, // give output units without a prefix an automatic one
     input_stream: BufReader<I>,
     output_stream: O,
     input_value: Option<f64>,
-    input_unit: Option<String>,
-    output_unit: Option<String>,
+    input_unit: Option<UnitId>,
+    output_unit: Option<UnitId>,
+    names: UnitNames, // aliases of the recall units and history
+    history: History,
 }
 
 impl <I, O> Interpreter<I, O> where I: Read, O: io::Write
@@ -281,11 +430,63 @@ impl <I, O> Interpreter<I, O> where I: Read, O: io::Write
     pub fn using_streams(istream: I, ostream: O) -> Interpreter<I, O>
     {
         Interpreter { format: ConversionFmt::Desc,
+                      autoscale: false,
                       input_stream: BufReader::new(istream),
                       output_stream: ostream,
                       input_value: None,
                       input_unit: None,
                       output_unit: None,
+                      names: UnitNames::new(),
+                      history: History::new(),
+        }
+    }
+
+    // the input unit recall variable
+    pub fn input_unit(&self) -> Option<&str>
+    {
+        match self.input_unit
+        {
+        Some(id) => Some(self.names.name(id)),
+        None => None,
+        }
+    }
+
+    // the output unit recall variable
+    pub fn output_unit(&self) -> Option<&str>
+    {
+        match self.output_unit
+        {
+        Some(id) => Some(self.names.name(id)),
+        None => None,
+        }
+    }
+
+    pub fn set_input_unit(&mut self, alias: Option<&str>)
+    {
+        self.make_room(1);
+        self.input_unit = match alias
+        {
+        Some(alias) => Some(self.names.id(alias)),
+        None => None,
+        };
+    }
+
+    pub fn set_output_unit(&mut self, alias: Option<&str>)
+    {
+        self.make_room(1);
+        self.output_unit = match alias
+        {
+        Some(alias) => Some(self.names.id(alias)),
+        None => None,
+        };
+    }
+
+    // makes sure 'count' more names may be given IDs, dropping those no longer referred to
+    fn make_room(&mut self, count: usize)
+    {
+        if self.names.needs_room(count)
+        {
+            self.names.compact(&mut self.history, &mut [&mut self.input_unit, &mut self.output_unit]);
         }
     }
 
@@ -315,17 +516,16 @@ impl <I, O> Interpreter<I, O> where I: Read, O: io::Write
             return Err(InterpretErr::ExitSig);
         }
 
-        let mut line_checker = LineCheck::new();
-        let mut tokens = try!(tokenize(&raw_line, &mut line_checker));
-
-        tokens.retain(|tok| !tok.is_empty());
-        tokens.retain(|tok| match *tok{ TokenType::Delim(..) => false, _ => true });
-
-        if line_checker.argc == 0
-        {
-            return Err(InterpretErr::BlankLine);
-        }
+        let tokens = try!(tokenize_line(&raw_line));
+        self.execute(tokens)
+    }
 
+    /* Executes an already tokenized line (see fn tokenize_line). Commands are
+     * carried out against this interpreter's state exactly as in fn interpret.
+     * Conversions are handed back untouched as Ok(tokens).
+     */
+    pub fn execute(&mut self, tokens: Vec<TokenType>) -> Result<Vec<TokenType>, InterpretErr>
+    {
         let mut cmd_result = InterpretErr::BlankLine;
         { // scope to sequester borrow caused by iterator
         let mut tokens_iter = tokens.iter();
@@ -363,6 +563,23 @@ impl <I, O> Interpreter<I, O> where I: Read, O: io::Write
         "help" => {
             cmd_result = InterpretErr::HelpSig;
         },
+        "history" => {
+            let mut listing = String::with_capacity(80);
+
+            for (index, entry) in self.history.last(self.history.len()).enumerate()
+            {
+                if index > 0
+                {
+                    listing.push('\n');
+                }
+                write!(listing, "{:>3}: {} {} {}", self.history.len() - index, entry.value,
+                       self.unit_text(entry.from_prefix, entry.from, entry.from_tag),
+                       self.unit_text(entry.to_prefix, entry.to, entry.to_tag));
+            }
+
+            cmd_result = InterpretErr::CmdSuccess(
+                if listing.is_empty() { "[empty]".to_string() } else { listing });
+        },
         keyword @ "input_unit" | keyword @ "output_unit" => {
             let is_input = keyword.starts_with("input");
             let next_tok = tokens_iter.next();
@@ -371,16 +588,14 @@ impl <I, O> Interpreter<I, O> where I: Read, O: io::Write
             {
                 let value = if is_input
                 {
-                    &self.input_unit
+                    self.input_unit()
                 }
                 else
                 {
-                    &self.output_unit
+                    self.output_unit()
                 };
 
-                cmd_result = InterpretErr::CmdSuccess(
-                    if value.is_none() { "[not set]".to_string() }
-                    else { value.clone().unwrap() });
+                cmd_result = InterpretErr::CmdSuccess(value.unwrap_or("[not set]").to_string());
             }
             else
             {
@@ -405,15 +620,58 @@ impl <I, O> Interpreter<I, O> where I: Read, O: io::Write
 
                 if is_input
                 {
-                    self.input_unit = Some(unit_expr.alias.unwrap());
+                    self.set_input_unit(unit_expr.alias.as_ref().map(String::as_str));
                 }
                 else
                 {
-                    self.output_unit = Some(unit_expr.alias.unwrap());
+                    self.set_output_unit(unit_expr.alias.as_ref().map(String::as_str));
                 }
                 cmd_result = InterpretErr::CmdSuccess("Okay.".to_string());
             }
         },
+        "replay" => {
+            let count = match tokens_iter.next()
+            {
+            None => return Err(InterpretErr::IncompleteErr),
+            Some(tok) => match tok.peek().parse::<usize>()
+            {
+            Ok(count) if count > 0 => count,
+            _ => return Err(InterpretErr::InvalidState(tok.peek().clone())),
+            },
+            };
+
+            let mut output_units: Vec<UnitExpr> = Vec::new();
+
+            for tok in tokens_iter.by_ref()
+            {
+                let mut unit_expr = match parse_unit_expr(tok.peek())
+                {
+                Ok(expr) => expr,
+                Err(err) => {
+                    let mut err_mesg = String::with_capacity(80);
+                    write!(&mut err_mesg, "{}", err);
+                    return Err(InterpretErr::InvalidState(err_mesg));
+                },
+                };
+
+                if let Some(err) = self.recall_output_unit(&mut unit_expr)
+                {
+                    return Err(err);
+                }
+                output_units.push(unit_expr);
+            }
+
+            if output_units.is_empty()
+            {
+                return Err(InterpretErr::IncompleteErr);
+            }
+
+            cmd_result = match self.replay(count, output_units)
+            {
+            Ok(prims) => InterpretErr::ReplaySig(prims),
+            Err(err) => return Err(err),
+            };
+        },
         "value" => {
             let next_tok = tokens_iter.next();
 
@@ -472,7 +730,7 @@ impl <I, O> Interpreter<I, O> where I: Read, O: io::Write
 
         } // end sequestration of iterator
 
-        if line_checker.argc < 3
+        if tokens.len() < 3
         {
             return Err(InterpretErr::IncompleteErr);
         }
@@ -482,60 +740,211 @@ impl <I, O> Interpreter<I, O> where I: Read, O: io::Write
 
     pub fn perform_recall(&self, exprs: &mut ConvPrimitive) -> Option<InterpretErr>
     {
-        let mut evald_input_vals: Vec<NumberExpr> = Vec::new();
-        let mut evald_output_units: Vec<UnitExpr> = Vec::new();
+        trace_span!("perform_recall");
 
-        for mut input_val in exprs.input_vals.drain(..)
+        if let Some(err) = self.recall_values(&mut exprs.input_vals)
         {
-            if input_val.recall
-            {
-                input_val.value = match self.input_value
-                {
-                    None => {
-                        return Some(InterpretErr::RecallErr("input value".to_string(),
-                                                            "not set". to_string()));
-                    },
-                    Some(val) => val,
-                };
-            }
-            evald_input_vals.push(input_val);
+            return Some(err);
         }
 
-        exprs.input_vals = evald_input_vals;
+        if exprs.input_unit.prefix == AUTO_PREFIX
+        {
+            return Some(InterpretErr::InvalidState(AUTO_INPUT_MSG.to_string()));
+        }
+        if exprs.input_unit.is_all()
+        {
+            return Some(InterpretErr::InvalidState(ALL_INPUT_MSG.to_string()));
+        }
 
         if exprs.input_unit.recall
         {
-            exprs.input_unit.alias = match self.input_unit
+            let index = exprs.input_unit.recall_index;
+
+            if index == 0
+            {
+                exprs.input_unit.alias = match self.input_unit
+                {
+                    None => return Some(self.recall_err("input unit", index)),
+                    Some(id) => Some(self.names.name(id).to_string()),
+                }
+            }
+            else
             {
-                None => {
-                    return Some(InterpretErr::RecallErr("input unit".to_string(),
-                                                       "not set". to_string()));
+                match self.history.get(index)
+                {
+                    None => return Some(self.recall_err("input unit", index)),
+                    Some(entry) => self.recall_unit(&mut exprs.input_unit, entry.from, entry.from_prefix, entry.from_tag),
                 }
-                Some(ref alias) => Some(alias.clone()),
             }
         }
 
-        for mut output_unit in exprs.output_units.drain(..)
+        for output_unit in exprs.output_units.iter_mut()
+        {
+            if let Some(err) = self.recall_output_unit(output_unit)
+            {
+                return Some(err);
+            }
+        }
+
+        None
+    }
+
+    // recalls an output unit if it asks for it and gives it the automatic prefix if need be
+    fn recall_output_unit(&self, output_unit: &mut UnitExpr) -> Option<InterpretErr>
+    {
+        if output_unit.recall
         {
-            if output_unit.recall
+            let index = output_unit.recall_index;
+
+            if index == 0
             {
                 output_unit.alias = match self.output_unit
                 {
-                    None => {
-                        return Some(InterpretErr::RecallErr("output unit".to_string(),
-                                                            "not set". to_string()));
-                    }
-                    Some(ref alias) => Some(alias.clone()),
+                    None => return Some(self.recall_err("output unit", index)),
+                    Some(id) => Some(self.names.name(id).to_string()),
                 };
             }
-            evald_output_units.push(output_unit);
+            else
+            {
+                match self.history.get(index)
+                {
+                    None => return Some(self.recall_err("output unit", index)),
+                    Some(entry) => self.recall_unit(output_unit, entry.to, entry.to_prefix, entry.to_tag),
+                }
+            }
+        }
+        if self.autoscale && output_unit.prefix == NO_PREFIX
+        {
+            output_unit.prefix = AUTO_PREFIX;
+        }
+
+        None
+    }
+
+    /* Fills in a unit recalled from the history. Unlike the recall variables, the unit keeps
+     * the prefix and tag it was converted with, unless the expression gives its own.
+     */
+    fn recall_unit(&self, unit: &mut UnitExpr, alias: UnitId, prefix: char, tag: Option<UnitId>)
+    {
+        unit.alias = Some(self.names.name(alias).to_string());
+
+        if unit.prefix == NO_PREFIX
+        {
+            unit.prefix = prefix;
+        }
+        if unit.tag.is_none()
+        {
+            unit.tag = tag.map(|tag| self.names.name(tag).to_string());
+        }
+    }
+
+    // a unit from the history written as it would be entered, eg _km@us
+    fn unit_text(&self, prefix: char, alias: UnitId, tag: Option<UnitId>) -> String
+    {
+        let mut text = String::with_capacity(16);
+
+        if prefix != NO_PREFIX
+        {
+            text.push('_');
+            text.push(prefix);
+        }
+        text.push_str(self.names.name(alias));
+        if let Some(tag) = tag
+        {
+            text.push('@');
+            text.push_str(self.names.name(tag));
+        }
+
+        text
+    }
+
+    // error for recalling something not set, or not in the history that far back
+    fn recall_err(&self, which: &str, index: usize) -> InterpretErr
+    {
+        if index == 0
+        {
+            InterpretErr::RecallErr(which.to_string(), "not set".to_string())
         }
+        else
+        {
+            InterpretErr::RecallErr(format!("{} {}", which, index),
+                                    format!("history holds {} conversions", self.history.len()))
+        }
+    }
+
+    // recalls the input value for every value expression that asks for it
+    pub fn recall_values(&self, values: &mut Vec<NumberExpr>) -> Option<InterpretErr>
+    {
+        for input_val in values.iter_mut()
+        {
+            if input_val.recall
+            {
+                let recalled = if input_val.recall_index == 0
+                {
+                    self.input_value
+                }
+                else
+                {
+                    self.history.get(input_val.recall_index).map(|entry| entry.value)
+                };
 
-        exprs.output_units = evald_output_units;
+                input_val.value = match recalled
+                {
+                    None => return Some(self.recall_err("input value", input_val.recall_index)),
+                    Some(val) => val,
+                };
+            }
+        }
 
         None
     }
 
+    /* Builds the conversions of the last 'count' values in the history into the given output
+     * units, oldest first. Consecutive values from the same unit are given as one conversion
+     * so that they are converted as a batch.
+     */
+    fn replay(&self, count: usize, output_units: Vec<UnitExpr>) -> Result<Vec<ConvPrimitive>, InterpretErr>
+    {
+        let entries = self.history.last(count);
+
+        if entries.len() == 0
+        {
+            return Err(InterpretErr::RecallErr("history".to_string(), "empty".to_string()));
+        }
+
+        let mut prims: Vec<ConvPrimitive> = Vec::new();
+        let mut last_from: Option<(UnitId, char, Option<UnitId>)> = None;
+
+        for entry in entries
+        {
+            let value = NumberExpr { value: entry.value, recall: false, recall_index: 0 };
+
+            let from = (entry.from, entry.from_prefix, entry.from_tag);
+
+            if last_from == Some(from)
+            {
+                prims.last_mut().unwrap().input_vals.push(value);
+                continue;
+            }
+
+            last_from = Some(from);
+            prims.push(ConvPrimitive {
+                input_vals: vec![value],
+                input_unit: UnitExpr { prefix: entry.from_prefix,
+                                       alias: Some(self.names.name(entry.from).to_string()),
+                                       recall: false,
+                                       recall_index: 0,
+                                       tag: entry.from_tag.map(|tag| self.names.name(tag).to_string()) },
+                output_units: output_units.clone(),
+            });
+        }
+
+        Ok(prims)
+    }
+
+    /* Sets the recall variables from the conversions just made and records those whose units
+     * were both found in the history.
+     */
     pub fn update_recall(&mut self, conversions: &Vec<Conversion>)
     {
         for conversion in conversions.iter()
@@ -546,26 +955,28 @@ impl <I, O> Interpreter<I, O> where I: Read, O: io::Write
                 match *err
                 {
                 ConversionError::OutOfRange(output) => {
+                    self.set_input_unit(Some(&conversion.from_alias));
+                    self.set_output_unit(Some(&conversion.to_alias));
                     if output
                     {
                         self.input_value = Some(conversion.input);
+                        self.record_recall(conversion);
                     }
-                    self.input_unit = Some(conversion.from_alias.clone());
-                    self.output_unit = Some(conversion.to_alias.clone());
                 },
                 ConversionError::TypeMismatch => {
                     self.input_value = Some(conversion.input);
-                    self.input_unit = Some(conversion.from_alias.clone());
-                    self.output_unit = Some(conversion.to_alias.clone());
+                    self.set_input_unit(Some(&conversion.from_alias));
+                    self.set_output_unit(Some(&conversion.to_alias));
+                    self.record_recall(conversion);
                 },
                 ConversionError::UnitNotFound(..) => {
                     if conversion.to.is_some()
                     {
-                        self.output_unit = Some(conversion.to_alias.clone());
+                        self.set_output_unit(Some(&conversion.to_alias));
                     }
                     if conversion.from.is_some()
                     {
-                        self.input_unit = Some(conversion.from_alias.clone());
+                        self.set_input_unit(Some(&conversion.from_alias));
                     }
                     self.input_value = Some(conversion.input);
                 },
@@ -573,15 +984,45 @@ impl <I, O> Interpreter<I, O> where I: Read, O: io::Write
             },
             _ => {
                 self.input_value = Some(conversion.input);
-                self.input_unit = Some(conversion.from_alias.clone());
-                self.output_unit = Some(conversion.to_alias.clone());
+                self.set_input_unit(Some(&conversion.from_alias));
+                self.set_output_unit(Some(&conversion.to_alias));
+                self.record_recall(conversion);
             },
             };
         }
     }
 
+    // records a conversion whose units were both found in the history
+    fn record_recall(&mut self, conversion: &Conversion)
+    {
+        self.make_room(4);
+
+        let from_tag = match conversion.from_tag
+        {
+        Some(ref tag) => Some(self.names.id(tag)),
+        None => None,
+        };
+        let to_tag = match conversion.to_tag
+        {
+        Some(ref tag) => Some(self.names.id(tag)),
+        None => None,
+        };
+
+        let entry = Entry {
+            value: conversion.input,
+            from: self.names.id(&conversion.from_alias),
+            from_prefix: conversion.from_prefix(),
+            from_tag: from_tag,
+            to: self.names.id(&conversion.to_alias),
+            to_prefix: conversion.given_to_prefix(),
+            to_tag: to_tag,
+        };
+        self.history.record(entry);
+    }
+
     pub fn publish<T>(&mut self, element: &T, mesg: &Option<String>) where T: Display
     {
+        trace_span!("publish");
         match mesg
         {
         &Some(ref text) => { write!(self.output_stream, "{}", text); },
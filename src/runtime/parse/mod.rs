@@ -94,6 +94,24 @@ impl Display for GeneralParseError
     }
 }
 
+/* Parses the history index that may follow a recall character, eg the 3 in
+ * ';3'. Indices count back from the last conversion, which is 1.
+ */
+pub fn parse_recall_index(token: &str) -> Option<usize>
+{
+    if token.is_empty() || !token.bytes().all(|byte| byte.is_ascii_digit())
+    {
+        return None;
+    }
+
+    match token.parse::<usize>()
+    {
+    Ok(index) if index > 0 => Some(index),
+    _ => None,
+    }
+}
+
+#[derive(Debug)]
 pub struct ConvPrimitive
 {
     pub input_vals: Vec<NumberExpr>,
@@ -126,10 +144,12 @@ enum ConvPrimState
  */
 pub fn to_conv_primitive(mut tokens: &Vec<TokenType>) -> Result<ConvPrimitive, GeneralParseError>
 {
+    trace_span!("to_conv_primitive");
     let mut value_exprs: Vec<NumberExpr> = Vec::new(); //NumberExpr { value: 0.0, recall: false };
     let mut unit_in_expr = UnitExpr { prefix: NO_PREFIX,
                                       alias: None,
                                       recall: false,
+                                      recall_index: 0,
                                       tag: None };
     let mut unit_out_exprs: Vec<UnitExpr> = Vec::new();
 
@@ -1,11 +1,12 @@
 
-use ::runtime::parse::ExprParseError;
+use ::runtime::parse::{ExprParseError, parse_recall_index};
 use ::utils::*;
 
 enum NumberCheckState
 {
     FloatLiteral,
     Semicolon,
+    RecallIndex,
     Trailing,
 }
 
@@ -52,6 +53,16 @@ impl<'a> SyntaxChecker for NumberCheck<'a>
             },
             NumberCheckState::Semicolon if delim => {
                 if token == ";"
+                {
+                    self.state = NumberCheckState::RecallIndex;
+                }
+                else
+                {
+                    self.valid = false;
+                }
+            },
+            NumberCheckState::RecallIndex if !delim => {
+                if token.is_empty() || parse_recall_index(token).is_some()
                 {
                     self.state = NumberCheckState::Trailing;
                 }
@@ -60,7 +71,6 @@ impl<'a> SyntaxChecker for NumberCheck<'a>
                     self.valid = false;
                 }
             },
-
             NumberCheckState::Trailing => {
                 if !token.is_empty()
                 {
@@ -127,6 +137,9 @@ impl<'a> SyntaxChecker for NumberCheck<'a>
         {
             match self.state
             {
+            NumberCheckState::RecallIndex => {
+                return Err(SyntaxError::Expected(index, "history index of 1 or more after ';'".to_string()));
+            },
             NumberCheckState::Trailing => {
                 return Err(SyntaxError::Expected(index, "nothing after value expression".to_string()));
             },
@@ -152,12 +165,18 @@ impl<'a> SyntaxChecker for NumberCheck<'a>
         self.valid = true;
         self.state = NumberCheckState::FloatLiteral;
     }
+    fn special_bytes(&self) -> Option<&'static [u8]>
+    {
+        Some(b";#")
+    }
 }
 
+#[derive(Debug)]
 pub struct NumberExpr
 {
     pub value: f64,
     pub recall: bool,
+    pub recall_index: usize, // conversions back in the history. 0 for the recall variable
 }
 
 pub fn parse_number_expr(token: &String) -> Result<NumberExpr, ExprParseError>
@@ -177,17 +196,25 @@ pub fn parse_number_expr(token: &String) -> Result<NumberExpr, ExprParseError>
     let mut value_expr = NumberExpr {
         value: -1.0,
         recall: false,
+        recall_index: 0,
     };
 
     for (index, tok) in tokens.drain(..).enumerate()
     {
-        if index > 0
+        if index > 1 || (index == 1 && !value_expr.recall)
         {
             unreachable!("too many tokens in value expression after syntax check");
         }
 
         match tok
         {
+        TokenType::Normal(ref index) if value_expr.recall => {
+            value_expr.recall_index = match parse_recall_index(index)
+            {
+            Some(index) => index,
+            None => unreachable!("illegal history index after syntax check"),
+            };
+        },
         TokenType::Normal(number) => {
             value_expr.value = match number.parse::<f64>()
             {
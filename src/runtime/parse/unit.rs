@@ -2,7 +2,7 @@
 use std::vec::Drain;
 
 use ::utils::*;
-use ::runtime::parse::ExprParseError;
+use ::runtime::parse::{ExprParseError, parse_recall_index};
 
 enum UnitCheckState
 {
@@ -10,6 +10,7 @@ enum UnitCheckState
     UnderscoreOrColon,
     PrefixOrName,
     Colon,
+    RecallIndex,
     FinishOrTag,
     Tag,
     Finish
@@ -60,7 +61,7 @@ impl SyntaxChecker for UnitCheck
                 }
                 else if token == ":"
                 {
-                    self.state = UnitCheckState::FinishOrTag;
+                    self.state = UnitCheckState::RecallIndex;
                 }
                 else
                 {
@@ -72,7 +73,7 @@ impl SyntaxChecker for UnitCheck
                 {
                     self.valid = false;
                 }
-                else if token.len() < 2
+                else if token.chars().nth(1).is_none()
                 {
                     self.state = UnitCheckState::Colon;
                 }
@@ -83,6 +84,20 @@ impl SyntaxChecker for UnitCheck
             },
             UnitCheckState::Colon if delim => {
                 if token == ":"
+                {
+                    self.state = UnitCheckState::RecallIndex;
+                }
+                else
+                {
+                    self.valid = false;
+                }
+            },
+            UnitCheckState::RecallIndex => {
+                if delim && token == "@"
+                {
+                    self.state = UnitCheckState::Tag;
+                }
+                else if !delim && (token.is_empty() || parse_recall_index(token).is_some())
                 {
                     self.state = UnitCheckState::FinishOrTag;
                 }
@@ -183,6 +198,10 @@ impl SyntaxChecker for UnitCheck
         {
             match self.state
             {
+            UnitCheckState::RecallIndex => {
+                return Err(SyntaxError::Expected(index,
+                        "history index of 1 or more, a tag, or nothing after ':'".to_string()));
+            },
             UnitCheckState::FinishOrTag => {
                 return Err(SyntaxError::Expected(index,
                         "a tag or nothing at all after unit name / recall expression".to_string()));
@@ -214,6 +233,10 @@ impl SyntaxChecker for UnitCheck
         self.state = UnitCheckState::NameOrExpr;
         self.esc_seq = false;
     }
+    fn special_bytes(&self) -> Option<&'static [u8]>
+    {
+        Some(b"_:@")
+    }
 }
 
 #[derive(Debug,Clone)]
@@ -222,22 +245,53 @@ pub struct UnitExpr
     pub prefix: char,
     pub alias: Option<String>,
     pub recall: bool,
+    pub recall_index: usize, // conversions back in the history. 0 for the recall variable
     pub tag: Option<String>,
 }
 
+impl UnitExpr
+{
+    // whether this stands for every unit of the input unit's type. see ALL_UNITS
+    pub fn is_all(&self) -> bool
+    {
+        !self.recall && self.tag.is_none() && self.alias.as_ref().map_or(false, |alias| alias == ALL_UNITS)
+    }
+}
+
 fn process_alias_or_recall(next_token: Option<TokenType>, unit_expr: &mut UnitExpr, tokens_iter: &mut Drain<TokenType>)
     -> Result<Option<TokenType>, ExprParseError>
 {
     match next_token.unwrap()
     {
         TokenType::Normal(alias) => unit_expr.alias = Some(alias),
-        TokenType::Delim(ref delim) if delim == ":" => unit_expr.recall = true,
+        TokenType::Delim(ref delim) if delim == ":" => {
+            unit_expr.recall = true;
+            return process_recall_index(tokens_iter.next(), unit_expr, tokens_iter);
+        },
         token @ _ => unreachable!("unexpected token while parsing alias / recall: {:?}", token),
     };
 
     Ok(tokens_iter.next())
 }
 
+// takes the history index, if any, following a recall ':'
+fn process_recall_index(next_token: Option<TokenType>, unit_expr: &mut UnitExpr, tokens_iter: &mut Drain<TokenType>)
+    -> Result<Option<TokenType>, ExprParseError>
+{
+    match next_token
+    {
+    Some(TokenType::Normal(index)) => {
+        unit_expr.recall_index = match parse_recall_index(&index)
+        {
+        Some(index) => index,
+        None => unreachable!("illegal history index after syntax check"),
+        };
+        Ok(tokens_iter.next())
+    },
+    next_token @ _ => Ok(next_token),
+    }
+}
+
 fn process_tag(next_token: Option<TokenType>, unit_expr: &mut UnitExpr, tokens_iter: &mut Drain<TokenType>)
     -> Result<Option<TokenType>, ExprParseError>
 {
@@ -274,6 +328,7 @@ pub fn parse_unit_expr(token: &String) -> Result<UnitExpr, ExprParseError>
         prefix: NO_PREFIX,
         alias: None,
         recall: false,
+        recall_index: 0,
         tag: None,
     };
 
@@ -285,9 +340,15 @@ pub fn parse_unit_expr(token: &String) -> Result<UnitExpr, ExprParseError>
         let mut alias = tokens_iter.next().unwrap().unwrap();
         let mut new_alias = String::with_capacity(alias.len() - 1);
         let mut alias_iter = alias.chars();
-        let prefix = alias_iter.next().unwrap();
+        let mut prefix = alias_iter.next().unwrap();
 
-        if prefix_as_num(prefix).is_none()
+        // the micro sign and Greek mu are written for micro as often as 'u'
+        if prefix == '\u{00B5}' || prefix == '\u{03BC}'
+        {
+            prefix = 'u';
+        }
+
+        if prefix_as_num(prefix).is_none() && prefix != AUTO_PREFIX
         {
             return Err(ExprParseError::BadPrefix(prefix));
         }
@@ -301,7 +362,15 @@ pub fn parse_unit_expr(token: &String) -> Result<UnitExpr, ExprParseError>
 
         let mut iter_result = tokens_iter.next();
 
-        iter_result = try!(process_alias_or_recall(iter_result, &mut unit_expr, &mut tokens_iter));
+        // the prefix is either joined to the alias or stands alone before a recall
+        if new_alias.is_empty()
+        {
+            iter_result = try!(process_alias_or_recall(iter_result, &mut unit_expr, &mut tokens_iter));
+        }
+        else
+        {
+            unit_expr.alias = Some(new_alias);
+        }
         iter_result = try!(process_tag(iter_result, &mut unit_expr, &mut tokens_iter));
 
         if iter_result.is_some()
@@ -311,7 +380,8 @@ pub fn parse_unit_expr(token: &String) -> Result<UnitExpr, ExprParseError>
     },
     TokenType::Delim(ref delim) if delim == ":" => {
         unit_expr.recall = true;
-        let iter_result = try!(process_tag(tokens_iter.next(), &mut unit_expr, &mut tokens_iter));
+        let iter_result = try!(process_recall_index(tokens_iter.next(), &mut unit_expr, &mut tokens_iter));
+        let iter_result = try!(process_tag(iter_result, &mut unit_expr, &mut tokens_iter));
     },
     TokenType::Normal(alias) => {
         unit_expr.alias = Some(alias);
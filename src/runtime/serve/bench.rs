@@ -0,0 +1,144 @@
+/* runtime/serve/bench.rs
+ * ===
+ * Benchmark of the plan cache under concurrent lookups, run with '--bench-cache'. Pairs of
+ * units of the same type are drawn from the database and every one is resolved into the
+ * cache once. Then, for each count of threads from 1 to 64, every thread looks up the given
+ * number of pairs picked at random and the lookups per second of them all together are
+ * reported. This is done both for a cache of one shard, which serializes writers and counts
+ * every reader in the same place as the single lock it replaced would, and for a sharded
+ * one. Hit counts of each shard of the sharded cache are reported at the end.
+ *
+ * This file is a part of:
+ *
+ * Yucon - General Purpose Unit Converter
+ * Copyright (C) 2016-2017  Blaine Murphy
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use std::io;
+use std::io::Write;
+use std::thread;
+use std::time::Instant;
+
+use ::utils::NO_PREFIX;
+use ::runtime::parse::unit::UnitExpr;
+use ::runtime::units::UnitDatabase;
+use ::runtime::state::Options;
+use ::runtime::serve::cache::{PlanCache, SHARDS};
+
+const THREADS: [usize; 7] = [1, 2, 4, 8, 16, 32, 64];
+// most pairs looked up. all of them fit in the cache
+const PAIRS: usize = 2048;
+const SEED: u64 = 0x9e3779b97f4a7c15;
+
+fn next(state: &mut u64) -> u64
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    state.wrapping_mul(0x2545f4914f6cdd1d)
+}
+
+fn unit_expr(name: &str) -> UnitExpr
+{
+    UnitExpr {
+        prefix: NO_PREFIX,
+        alias: Some(name.to_string()),
+        recall: false,
+        recall_index: 0,
+        tag: None,
+    }
+}
+
+// lookups per second over 'threads' threads each looking up 'lookups' pairs
+fn measure(cache: &PlanCache, pairs: &[(UnitExpr, UnitExpr)], units: &UnitDatabase,
+    threads: usize, lookups: usize) -> f64
+{
+    let started = Instant::now();
+
+    thread::scope(|scope| {
+        for thread in 0..threads
+        {
+            scope.spawn(move || {
+                let mut state = SEED ^ (thread as u64 + 1);
+
+                for _ in 0..lookups
+                {
+                    let &(ref from, ref to) = &pairs[next(&mut state) as usize % pairs.len()];
+                    cache.plan(from, to, units);
+                }
+            });
+        }
+    });
+
+    let elapsed = started.elapsed();
+    (threads * lookups) as f64 / (elapsed.as_secs() as f64 + elapsed.subsec_nanos() as f64 / 1e9)
+}
+
+/* Runs the benchmark described by the program options and reports it to
+ * standard output.
+ */
+pub fn run_job(opts: &Options, units: &UnitDatabase) -> io::Result<()>
+{
+    let lookups = opts.bench_lookups.unwrap_or(0);
+    let mut pairs = Vec::new();
+
+    'all: for from in units.all().iter()
+    {
+        for to in units.all().iter().filter(|to| to.unit_type == from.unit_type)
+        {
+            if pairs.len() == PAIRS
+            {
+                break 'all;
+            }
+            pairs.push((unit_expr(&from.common_name), unit_expr(&to.common_name)));
+        }
+    }
+
+    if pairs.is_empty()
+    {
+        return Err(io::Error::new(io::ErrorKind::InvalidData, "no units to look up"));
+    }
+
+    let single = PlanCache::with_shards(PAIRS, 1);
+    let sharded = PlanCache::with_shards(PAIRS, SHARDS);
+
+    for &(ref from, ref to) in pairs.iter()
+    {
+        single.plan(from, to, units);
+        sharded.plan(from, to, units);
+    }
+
+    let stdout = io::stdout();
+    let mut out = stdout.lock();
+
+    try!(writeln!(out, "{} pairs, {} lookups per thread", pairs.len(), lookups));
+    try!(writeln!(out, "{:>8} {:>16} {:>16} {:>8}", "threads", "1 shard /s", format!("{} shards /s", SHARDS), "ratio"));
+
+    for &threads in THREADS.iter()
+    {
+        let single_rate = measure(&single, &pairs, units, threads, lookups);
+        let sharded_rate = measure(&sharded, &pairs, units, threads, lookups);
+
+        try!(writeln!(out, "{:>8} {:>16.0} {:>16.0} {:>8.2}", threads, single_rate, sharded_rate, sharded_rate / single_rate));
+    }
+
+    try!(writeln!(out, "\n{:>8} {:>8} {:>12} {:>8}", "shard", "plans", "hits", "misses"));
+
+    for (index, stats) in sharded.stats().iter().enumerate()
+    {
+        try!(writeln!(out, "{:>8} {:>8} {:>12} {:>8}", index, stats.plans, stats.hits, stats.misses));
+    }
+
+    Ok(())
+}
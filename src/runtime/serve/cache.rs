@@ -0,0 +1,505 @@
+/* runtime/serve/cache.rs
+ * ===
+ * Conversion plans shared by every connection to the daemon. A plan is resolved the first
+ * time its pair of unit expressions is asked for and reused from then on. Each plan counts
+ * the times it was asked for so that the most used may be saved as the hot set (see
+ * hotset.rs) and resolved again before a restarted daemon takes any connections.
+ *
+ * Connections on many threads look plans up at once, so the cache is split into shards by
+ * the hash of the key and a lookup never waits on a lock. Plans are never dropped from a
+ * shard until the whole cache is, and a shard never holds more than its capacity, so each is
+ * an open addressed table of a fixed number of slots, at least twice its capacity, that are
+ * only ever filled. A new plan is written to the first empty slot of its probe under the
+ * shard's writer lock and published by storing the pointer to it; readers probe without any
+ * lock and stop at the first empty slot. Adding a plan touches only its own slot, however many
+ * the shard holds.
+ *
+ * This file is a part of:
+ *
+ * Yucon - General Purpose Unit Converter
+ * Copyright (C) 2016-2017  Blaine Murphy
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use std::cmp;
+use std::collections::hash_map::DefaultHasher;
+use std::hash::{Hash, Hasher};
+use std::ptr;
+use std::sync::{Arc, Mutex};
+use std::sync::atomic::{AtomicPtr, AtomicU64, AtomicUsize, Ordering};
+
+use ::utils::NO_PREFIX;
+use ::runtime::parse::unit::{parse_unit_expr, UnitExpr};
+use ::runtime::convert::ConversionPlan;
+use ::runtime::units::UnitDatabase;
+
+// shards of a cache made with fn PlanCache::new. a power of two
+pub const SHARDS: usize = 16;
+
+/* struct PlanKey
+ *
+ * Description: a pair of fully recalled unit expressions, each written out as
+ *   it would be typed, eg '_km@metric'. Expressions that mean the same thing
+ *   are written the same way.
+ */
+#[derive(Debug, Clone, PartialEq, Eq, Hash)]
+pub struct PlanKey
+{
+    pub from: String,
+    pub to: String,
+}
+
+impl PlanKey
+{
+    pub fn new(from: &UnitExpr, to: &UnitExpr) -> PlanKey
+    {
+        PlanKey {
+            from: unit_text(from),
+            to: unit_text(to),
+        }
+    }
+
+    /* Parses the key back into unit expressions. None if either side is not a
+     * literal unit expression.
+     */
+    pub fn exprs(&self) -> Option<(UnitExpr, UnitExpr)>
+    {
+        let from = parse_unit_expr(&self.from).ok()?;
+        let to = parse_unit_expr(&self.to).ok()?;
+
+        if from.alias.is_none() || to.alias.is_none()
+        {
+            return None;
+        }
+
+        Some((from, to))
+    }
+}
+
+// writes a literal unit expression as it would be typed, escaping delimiters
+fn unit_text(expr: &UnitExpr) -> String
+{
+    let mut text = String::with_capacity(16);
+
+    if expr.prefix != NO_PREFIX
+    {
+        text.push('_');
+        text.push(expr.prefix);
+    }
+
+    push_escaped(&mut text, expr.alias.as_ref().unwrap());
+
+    if let Some(ref tag) = expr.tag
+    {
+        text.push('@');
+        push_escaped(&mut text, tag);
+    }
+
+    text
+}
+
+fn push_escaped(text: &mut String, name: &str)
+{
+    for ch in name.chars()
+    {
+        if ch == '_' || ch == ':' || ch == '@' || ch == '\\'
+        {
+            text.push('\\');
+        }
+        text.push(ch);
+    }
+}
+
+struct Entry
+{
+    key: PlanKey,
+    plan: Arc<ConversionPlan>,
+    hits: AtomicU64,
+}
+
+/* struct ShardStats
+ *
+ * Description: how a shard of the cache has been used. A hit found its plan
+ *   cached; a miss had to resolve it.
+ */
+#[derive(Debug, Clone, Copy)]
+pub struct ShardStats
+{
+    pub plans: usize,
+    pub hits: u64,
+    pub misses: u64,
+}
+
+// the counters of neighbouring shards are kept off each other's cache lines
+#[repr(align(64))]
+struct Shard
+{
+    slots: Box<[AtomicPtr<Entry>]>, // a power of two of them, filled in place and never emptied
+    len: AtomicUsize,
+    writer: Mutex<()>,
+    hits: AtomicU64,
+    misses: AtomicU64,
+}
+
+impl Shard
+{
+    fn new(capacity: usize) -> Shard
+    {
+        // at most half full, so a probe always ends at an empty slot
+        let slots = cmp::max(capacity * 2, 2).next_power_of_two();
+
+        Shard {
+            slots: (0..slots).map(|_| AtomicPtr::new(ptr::null_mut())).collect::<Vec<_>>().into_boxed_slice(),
+            len: AtomicUsize::new(0),
+            writer: Mutex::new(()),
+            hits: AtomicU64::new(0),
+            misses: AtomicU64::new(0),
+        }
+    }
+
+    /* The entry of a key if the shard has it, or else the empty slot where it
+     * would go. The key's slots are probed in turn from the one its hash picks.
+     */
+    fn probe(&self, key: &PlanKey, hash: u64) -> Result<&Entry, usize>
+    {
+        let mask = self.slots.len() - 1;
+        // the low bits of the hash picked the shard
+        let mut index = (hash >> 32) as usize & mask;
+
+        loop
+        {
+            let entry = self.slots[index].load(Ordering::Acquire);
+
+            if entry.is_null()
+            {
+                return Err(index);
+            }
+
+            // entries are only freed with the shard
+            let entry = unsafe { &*entry };
+
+            if entry.key == *key
+            {
+                return Ok(entry);
+            }
+
+            index = (index + 1) & mask;
+        }
+    }
+
+    fn get(&self, key: &PlanKey, hash: u64) -> Option<&Entry>
+    {
+        self.probe(key, hash).ok()
+    }
+
+    /* Adds a plan to the shard, or counts 'hits' more for it if it is already
+     * there. Returns false if the shard is full.
+     */
+    fn insert(&self, key: PlanKey, hash: u64, plan: Arc<ConversionPlan>, hits: u64, capacity: usize) -> bool
+    {
+        let _writer = self.writer.lock().unwrap();
+
+        // another connection may have resolved the same pair meanwhile
+        let index = match self.probe(&key, hash)
+        {
+        Ok(entry) => {
+            entry.hits.fetch_add(hits, Ordering::Relaxed);
+            return true;
+        },
+        Err(index) => index,
+        };
+
+        if self.len.load(Ordering::Relaxed) >= capacity
+        {
+            return false;
+        }
+
+        let entry = Box::new(Entry { key: key, plan: plan, hits: AtomicU64::new(hits) });
+        // readers that see the pointer see the whole entry
+        self.slots[index].store(Box::into_raw(entry), Ordering::Release);
+        self.len.fetch_add(1, Ordering::Relaxed);
+        true
+    }
+
+    fn len(&self) -> usize
+    {
+        self.len.load(Ordering::Relaxed)
+    }
+
+    // calls 'f' with every entry of the shard
+    fn for_each<F>(&self, mut f: F) where F: FnMut(&Entry)
+    {
+        for slot in self.slots.iter()
+        {
+            let entry = slot.load(Ordering::Acquire);
+
+            if !entry.is_null()
+            {
+                f(unsafe { &*entry });
+            }
+        }
+    }
+}
+
+impl Drop for Shard
+{
+    fn drop(&mut self)
+    {
+        for slot in self.slots.iter_mut()
+        {
+            let entry = *slot.get_mut();
+
+            if !entry.is_null()
+            {
+                unsafe { drop(Box::from_raw(entry)); }
+            }
+        }
+    }
+}
+
+/* struct PlanCache
+ *
+ * Description: the plans resolved so far, up to a fixed number of them spread
+ *   evenly over the shards. Once a shard is full, pairs not yet seen that fall
+ *   in it are resolved for each request instead.
+ */
+pub struct PlanCache
+{
+    shards: Vec<Shard>,
+    capacity: usize, // of each shard
+}
+
+impl PlanCache
+{
+    pub fn new(capacity: usize) -> PlanCache
+    {
+        PlanCache::with_shards(capacity, SHARDS)
+    }
+
+    // as fn new, split into the given number of shards. it must be a power of two
+    pub fn with_shards(capacity: usize, shards: usize) -> PlanCache
+    {
+        assert!(shards.is_power_of_two());
+        let capacity = (capacity + shards - 1) / shards;
+
+        PlanCache {
+            shards: (0..shards).map(|_| Shard::new(capacity)).collect(),
+            capacity: capacity,
+        }
+    }
+
+    // the shard of a key and the key's hash
+    fn shard(&self, key: &PlanKey) -> (&Shard, u64)
+    {
+        let mut hasher = DefaultHasher::new();
+        key.hash(&mut hasher);
+        let hash = hasher.finish();
+
+        (&self.shards[hash as usize & (self.shards.len() - 1)], hash)
+    }
+
+    /* Returns the plan converting between two fully recalled unit expressions,
+     * resolving it if it is not cached yet. Resolving is done without holding
+     * the shard so that other connections are not held up by it.
+     */
+    pub fn plan(&self, from: &UnitExpr, to: &UnitExpr, units: &UnitDatabase) -> Arc<ConversionPlan>
+    {
+        let key = PlanKey::new(from, to);
+        let (shard, hash) = self.shard(&key);
+
+        let cached = shard.get(&key, hash).map(|entry| {
+            entry.hits.fetch_add(1, Ordering::Relaxed);
+            entry.plan.clone()
+        });
+
+        if let Some(plan) = cached
+        {
+            shard.hits.fetch_add(1, Ordering::Relaxed);
+            return plan;
+        }
+
+        shard.misses.fetch_add(1, Ordering::Relaxed);
+
+        let plan = Arc::new(ConversionPlan::from_exprs(from, to, units));
+        shard.insert(key, hash, plan.clone(), 1, self.capacity);
+        plan
+    }
+
+    /* Resolves a plan ahead of any request for it, starting its count at
+     * 'hits'. Returns false if the key does not parse or its shard is full.
+     */
+    pub fn warm(&self, key: PlanKey, hits: u64, units: &UnitDatabase) -> bool
+    {
+        let (from, to) = match key.exprs()
+        {
+        Some(exprs) => exprs,
+        None => return false,
+        };
+
+        let plan = Arc::new(ConversionPlan::from_exprs(&from, &to, units));
+        let (shard, hash) = self.shard(&key);
+        shard.insert(key, hash, plan, hits, self.capacity)
+    }
+
+    // the 'count' most asked for pairs and their counts, most asked for first
+    pub fn hottest(&self, count: usize) -> Vec<(PlanKey, u64)>
+    {
+        let mut all: Vec<(PlanKey, u64)> = Vec::new();
+
+        for shard in self.shards.iter()
+        {
+            shard.for_each(|entry| all.push((entry.key.clone(), entry.hits.load(Ordering::Relaxed))));
+        }
+
+        all.sort_by(|a, b| b.1.cmp(&a.1).then_with(|| a.0.from.cmp(&b.0.from)).then_with(|| a.0.to.cmp(&b.0.to)));
+        all.truncate(count);
+        all
+    }
+
+    pub fn len(&self) -> usize
+    {
+        self.shards.iter().map(|shard| shard.len()).sum()
+    }
+
+    // how each shard has been used so far, in shard order
+    pub fn stats(&self) -> Vec<ShardStats>
+    {
+        self.shards.iter()
+            .map(|shard| ShardStats {
+                plans: shard.len(),
+                hits: shard.hits.load(Ordering::Relaxed),
+                misses: shard.misses.load(Ordering::Relaxed),
+            })
+            .collect()
+    }
+}
+
+#[cfg(test)]
+mod tests
+{
+    use super::*;
+    use std::thread;
+    use ::runtime::units::reader::read_units;
+
+    const NAMES: [&'static str; 4] = ["m", "km", "cm", "ft"];
+
+    fn units() -> UnitDatabase
+    {
+        let cfg = "[meter]\n\taliases = m\n\ttype = length\n\tconv_factor = 1000\n\
+                   [kilometer]\n\taliases = km\n\ttype = length\n\tconv_factor = 1000000\n\
+                   [centimeter]\n\taliases = cm\n\ttype = length\n\tconv_factor = 10\n\
+                   [foot]\n\taliases = ft\n\ttype = length\n\tconv_factor = 304.8\n";
+        let mut units = UnitDatabase::new();
+
+        for unit in read_units(cfg.as_bytes(), &mut |_| {})
+        {
+            units.add(unit.init.unit, &unit.aliases, &unit.tags);
+        }
+        units.freeze();
+        units
+    }
+
+    // every ordered pair of NAMES
+    fn pairs() -> Vec<(UnitExpr, UnitExpr)>
+    {
+        let mut pairs = Vec::new();
+
+        for from in NAMES.iter()
+        {
+            for to in NAMES.iter()
+            {
+                pairs.push((parse_unit_expr(&from.to_string()).unwrap(), parse_unit_expr(&to.to_string()).unwrap()));
+            }
+        }
+
+        pairs
+    }
+
+    fn result(plan: &ConversionPlan) -> f64
+    {
+        plan.convert(2.0).result.unwrap()
+    }
+
+    #[test]
+    fn concurrent_plans_agree()
+    {
+        const THREADS: usize = 8;
+        const ROUNDS: usize = 50;
+
+        let units = Arc::new(units());
+        let cache = Arc::new(PlanCache::new(64));
+        let pairs = Arc::new(pairs());
+
+        let threads: Vec<_> = (0..THREADS)
+            .map(|thread| {
+                let (units, cache, pairs) = (units.clone(), cache.clone(), pairs.clone());
+
+                thread::spawn(move || {
+                    for round in 0..ROUNDS
+                    {
+                        // each thread walks the pairs from a different place
+                        for index in 0..pairs.len()
+                        {
+                            let (ref from, ref to) = pairs[(index + thread * 3 + round) % pairs.len()];
+                            let plan = cache.plan(from, to, &units);
+                            assert_eq!(result(&plan), result(&ConversionPlan::from_exprs(from, to, &units)));
+                        }
+                    }
+                })
+            })
+            .collect();
+
+        for thread in threads
+        {
+            thread.join().unwrap();
+        }
+
+        let calls = (THREADS * ROUNDS * pairs.len()) as u64;
+        assert_eq!(cache.len(), pairs.len());
+
+        let stats = cache.stats();
+        assert_eq!(stats.iter().map(|shard| shard.plans).sum::<usize>(), pairs.len());
+        assert_eq!(stats.iter().map(|shard| shard.hits + shard.misses).sum::<u64>(), calls);
+
+        let hottest = cache.hottest(pairs.len() + 1);
+        assert_eq!(hottest.len(), pairs.len());
+        assert_eq!(hottest.iter().map(|&(_, hits)| hits).sum::<u64>(), calls);
+
+        // once cached, a pair always gets the same plan
+        for &(ref from, ref to) in pairs.iter()
+        {
+            assert!(Arc::ptr_eq(&cache.plan(from, to, &units), &cache.plan(from, to, &units)));
+        }
+    }
+
+    #[test]
+    fn full_shards_resolve_each_request()
+    {
+        let units = units();
+        let cache = PlanCache::with_shards(4, 1);
+
+        for &(ref from, ref to) in pairs().iter()
+        {
+            assert_eq!(result(&cache.plan(from, to, &units)), result(&ConversionPlan::from_exprs(from, to, &units)));
+        }
+
+        assert_eq!(cache.len(), 4);
+        assert_eq!(cache.hottest(10).len(), 4);
+        assert!(!cache.warm(PlanKey { from: "ft".to_string(), to: "ft".to_string() }, 1, &units));
+
+        // a pair cached first is still there
+        let (ref from, ref to) = pairs()[0];
+        assert!(Arc::ptr_eq(&cache.plan(from, to, &units), &cache.plan(from, to, &units)));
+        assert!(cache.warm(PlanKey::new(from, to), 5, &units));
+    }
+}
@@ -0,0 +1,99 @@
+/* runtime/serve/hotset.rs
+ * ===
+ * The hot set: the pairs of unit expressions the daemon was asked to convert between most
+ * often, saved so that a restarted daemon can resolve their plans before it takes any
+ * connections. The file is plain text, one pair per line, most asked for first:
+ *
+ *   <count>\t<input unit expression>\t<output unit expression>
+ *
+ * eg '1042\tin\t_km'. Lines that do not read this way are skipped.
+ *
+ * This file is a part of:
+ *
+ * Yucon - General Purpose Unit Converter
+ * Copyright (C) 2016-2017  Blaine Murphy
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use std::fs;
+use std::fs::File;
+use std::io;
+use std::io::{BufRead, BufReader, BufWriter};
+use std::io::Write;
+
+use ::runtime::serve::cache::PlanKey;
+
+/* Reads a hot set saved by fn store. A missing file is an empty hot set.
+ */
+pub fn load(path: &str) -> io::Result<Vec<(PlanKey, u64)>>
+{
+    let file = match File::open(path)
+    {
+    Ok(file) => file,
+    Err(ref err) if err.kind() == io::ErrorKind::NotFound => return Ok(Vec::new()),
+    Err(err) => return Err(err),
+    };
+
+    let mut pairs = Vec::new();
+
+    for line in BufReader::new(file).lines()
+    {
+        let line = try!(line);
+        let mut fields = line.split('\t');
+
+        let hits = match fields.next().and_then(|field| field.parse::<u64>().ok())
+        {
+        Some(hits) => hits,
+        None => continue,
+        };
+
+        match (fields.next(), fields.next(), fields.next())
+        {
+        (Some(from), Some(to), None) if !from.is_empty() && !to.is_empty() => {
+            pairs.push((PlanKey { from: from.to_string(), to: to.to_string() }, hits));
+        },
+        _ => continue,
+        };
+    }
+
+    Ok(pairs)
+}
+
+/* Saves a hot set. It is written beside the old one and renamed over it so that
+ * a daemon stopped midway never leaves a partial file behind.
+ */
+pub fn store(path: &str, pairs: &[(PlanKey, u64)]) -> io::Result<()>
+{
+    let mut temp_path = path.to_string();
+    temp_path.push_str(".tmp");
+
+    {
+        let mut file = BufWriter::new(try!(File::create(&temp_path)));
+
+        for &(ref key, hits) in pairs.iter()
+        {
+            // a tab or newline in a unit name would break the line apart
+            if key.from.contains(|ch| ch == '\t' || ch == '\n') || key.to.contains(|ch| ch == '\t' || ch == '\n')
+            {
+                continue;
+            }
+
+            try!(write!(file, "{}\t{}\t{}\n", hits, key.from, key.to));
+        }
+
+        let file = try!(file.into_inner().map_err(|err| err.into_error()));
+        try!(file.sync_all());
+    }
+
+    fs::rename(&temp_path, path)
+}
@@ -0,0 +1,425 @@
+/* runtime/serve module
+ * ===
+ * Daemon mode. Listens on a TCP address and converts each line sent on a connection exactly
+ * as batch mode would, writing the results back on the same connection. Each connection
+ * has its own recall variables and format; conversion plans are shared between all of them
+ * (see cache.rs).
+ *
+ * Several units databases may be served at once with '--tenant <name>=<file>' (see
+ * tenant.rs). A client chooses one with '@db <name>', for the rest of its connection, or by
+ * beginning a single line with it, eg '@db aero 1 nmi km'. '@reload <name>' reloads one
+ * from its file. Connections that choose none use the default database.
+ *
+ * With '--hotset <file>', the most used plans of the default database are saved every so often and when the daemon
+ * is stopped, and resolved again when it starts before it takes any connections, so that
+ * requests right after a restart are as quick as they were before it. The daemon stops on
+ * SIGINT or SIGTERM, reporting how the cache was used. See bench.rs for a benchmark of the
+ * cache under many threads.
+ *
+ * This file is a part of:
+ *
+ * Yucon - General Purpose Unit Converter
+ * Copyright (C) 2016-2017  Blaine Murphy
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+pub mod bench;
+pub mod cache;
+pub mod hotset;
+pub mod tenant;
+
+use std::fmt::Write;
+use std::io;
+use std::io::{BufRead, BufReader};
+use std::io::Write as IoWrite;
+use std::net::{TcpListener, TcpStream};
+use std::slice;
+use std::sync::Arc;
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::thread;
+use std::time::{Duration, Instant};
+
+use ::utils::TokenType;
+use ::runtime::{Interpreter, InterpretErr, is_command, tokenize_line};
+use ::runtime::parse::{ConvPrimitive, to_conv_primitive};
+use ::runtime::convert::{Conversion, ConversionFmt, ConversionPlan};
+use ::runtime::units::UnitDatabase;
+use ::runtime::units::intern;
+use ::runtime::state::Options;
+use ::runtime::serve::cache::PlanCache;
+use ::runtime::serve::tenant::{Tenant, Tenants};
+
+// most plans cached at once for each database
+const CACHE_CAPACITY: usize = 4096;
+// how often the listener and idle connections check whether to stop
+const POLL_INTERVAL: Duration = Duration::from_millis(100);
+// how often the hot set is saved while running
+const SAVE_INTERVAL: Duration = Duration::from_secs(60);
+
+static STOPPING: AtomicBool = AtomicBool::new(false);
+
+#[cfg(unix)]
+mod signals
+{
+    use std::sync::atomic::Ordering;
+
+    const SIGINT: i32 = 2;
+    const SIGTERM: i32 = 15;
+
+    extern "C"
+    {
+        fn signal(signum: i32, handler: extern "C" fn(i32)) -> usize;
+    }
+
+    extern "C" fn on_stop(_signum: i32)
+    {
+        super::STOPPING.store(true, Ordering::SeqCst);
+    }
+
+    pub fn catch_stop()
+    {
+        unsafe
+        {
+            signal(SIGINT, on_stop);
+            signal(SIGTERM, on_stop);
+        }
+    }
+}
+
+#[cfg(not(unix))]
+mod signals
+{
+    // the daemon is stopped by ending the process. the hot set is still saved periodically
+    pub fn catch_stop() {}
+}
+
+fn stopping() -> bool
+{
+    STOPPING.load(Ordering::SeqCst)
+}
+
+/* Runs the daemon described by the program options until it is signalled to
+ * stop. 'units' is served as the default database. Any other databases are
+ * loaded and the hot set, if any, is loaded and its plans resolved before the
+ * address is bound.
+ */
+pub fn run_job(opts: &Options, units: &UnitDatabase) -> io::Result<()>
+{
+    let tenants = try!(Tenants::load(units, &opts.tenants, CACHE_CAPACITY, opts.fold_names));
+
+    for tenant in tenants.iter().skip(1)
+    {
+        writeln!(io::stderr(), "Loaded {} units as \'{}\'", tenant.current().units().all().len(), tenant.name).ok();
+    }
+
+    if !opts.tenants.is_empty()
+    {
+        let (names, records) = intern::shared().len();
+        writeln!(io::stderr(), "Sharing {} names and {} unit records between {} databases",
+                 names, records, opts.tenants.len() + 1).ok();
+    }
+
+    if let Some(ref path) = opts.hotset_path
+    {
+        let default = tenants.default().current();
+        let cache = &default.cache;
+        let started = Instant::now();
+        let pairs = try!(hotset::load(path));
+
+        // counts are halved on every restart so that the hot set follows traffic
+        let warmed = pairs.into_iter()
+            .filter(|&(ref key, hits)| cache.warm(key.clone(), hits / 2, default.units()))
+            .count();
+
+        writeln!(io::stderr(), "Warmed {} plans from \'{}\' in {:.1} ms", warmed, path,
+                 started.elapsed().as_secs() as f64 * 1e3 + started.elapsed().subsec_nanos() as f64 / 1e6).ok();
+    }
+
+    let listener = try!(TcpListener::bind(opts.serve_addr.as_ref().unwrap().as_str()));
+    try!(listener.set_nonblocking(true));
+    signals::catch_stop();
+
+    writeln!(io::stderr(), "Listening on {}", try!(listener.local_addr())).ok();
+
+    thread::scope(|scope| {
+        let mut last_save = Instant::now();
+
+        while !stopping()
+        {
+            match listener.accept()
+            {
+            Ok((stream, _)) => {
+                let tenants = &tenants;
+                scope.spawn(move || {
+                    if let Err(err) = serve_client(stream, tenants, opts)
+                    {
+                        writeln!(io::stderr(), "Error: connection dropped: {}", err).ok();
+                    }
+                });
+            },
+            Err(ref err) if err.kind() == io::ErrorKind::WouldBlock => thread::sleep(POLL_INTERVAL),
+            Err(err) => {
+                // eg out of file descriptors. other connections may still be served
+                writeln!(io::stderr(), "Error: could not accept connection: {}", err).ok();
+                thread::sleep(POLL_INTERVAL);
+            },
+            };
+
+            if opts.hotset_path.is_some() && last_save.elapsed() >= SAVE_INTERVAL
+            {
+                save_hotset(&tenants, opts);
+                last_save = Instant::now();
+            }
+        }
+
+        // connections see the stop within one poll interval and close
+    });
+
+    save_hotset(&tenants, opts);
+
+    for tenant in tenants.iter()
+    {
+        let generation = tenant.current();
+        let stats = generation.cache.stats();
+        writeln!(io::stderr(), "Cached {} plans for \'{}\' over {} shards: {} hits, {} misses",
+                 generation.cache.len(), tenant.name, stats.len(),
+                 stats.iter().map(|shard| shard.hits).sum::<u64>(),
+                 stats.iter().map(|shard| shard.misses).sum::<u64>()).ok();
+    }
+    Ok(())
+}
+
+fn save_hotset(tenants: &Tenants, opts: &Options)
+{
+    if let Some(ref path) = opts.hotset_path
+    {
+        if let Err(err) = hotset::store(path, &tenants.default().current().cache.hottest(opts.hotset_size))
+        {
+            writeln!(io::stderr(), "Error: could not save hot set to \'{}\': {}", path, err).ok();
+        }
+    }
+}
+
+/* Converts lines from one connection until it closes, sends 'exit', or the
+ * daemon stops.
+ */
+fn serve_client(stream: TcpStream, tenants: &Tenants, opts: &Options) -> io::Result<()>
+{
+    try!(stream.set_nonblocking(false));
+    try!(stream.set_read_timeout(Some(POLL_INTERVAL)));
+
+    let mut output = try!(stream.try_clone());
+    let mut input = BufReader::new(stream);
+    let mut interpreter: Interpreter<_, _> = Interpreter::using_streams(io::empty(), io::sink());
+    let mut line: Vec<u8> = Vec::with_capacity(128);
+    let mut tenant = tenants.default();
+
+    interpreter.format = opts.format;
+    interpreter.autoscale = opts.autoscale;
+
+    loop
+    {
+        // a timed out read keeps what it got in 'line' and picks up after it
+        match input.read_until(b'\n', &mut line)
+        {
+        Ok(0) => return Ok(()),
+        Ok(..) => {},
+        Err(ref err) if err.kind() == io::ErrorKind::WouldBlock ||
+                        err.kind() == io::ErrorKind::TimedOut ||
+                        err.kind() == io::ErrorKind::Interrupted => {
+            if stopping()
+            {
+                return Ok(());
+            }
+            continue;
+        },
+        Err(err) => return Err(err),
+        };
+
+        let reply = respond(&String::from_utf8_lossy(&line), &mut interpreter, tenants, &mut tenant);
+        line.clear();
+
+        match reply
+        {
+        Some(text) => try!(output.write_all(text.as_bytes())),
+        None => return Ok(()),
+        };
+    }
+}
+
+/* Executes or converts a single line as batch mode would and returns the text
+ * to send back. None if the line was 'exit'. Lines are converted with the
+ * connection's database 'tenant' unless they choose another with '@db'.
+ */
+fn respond<'t, 'a, I, O>(line: &str, interpreter: &mut Interpreter<I, O>, tenants: &'t Tenants<'a>,
+    tenant: &mut &'t Tenant<'a>) -> Option<String> where I: io::Read, O: io::Write
+{
+    let mut tokens = match tokenize_line(line.trim_right_matches(|ch| ch == '\n' || ch == '\r'))
+    {
+    Ok(tokens) => tokens,
+    Err(InterpretErr::BlankLine) => return Some(String::new()),
+    Err(err) => return Some(format!("Error: {}\n", err)),
+    };
+
+    let mut line_tenant = *tenant;
+
+    match tokens[0].peek().as_str()
+    {
+    "@db" | "@reload" if tokens.len() < 2 => return Some(format!("Error: {}\n", InterpretErr::IncompleteErr)),
+    "@db" => {
+        line_tenant = match tenants.get(tokens[1].peek())
+        {
+        Some(chosen) => chosen,
+        None => return Some(format!("Error: no units database named \'{}\'\n", tokens[1].peek())),
+        };
+
+        if tokens.len() == 2
+        {
+            *tenant = line_tenant;
+            return Some(String::new());
+        }
+
+        // the rest of the line is converted with the chosen database alone
+        tokens.drain(..2);
+    },
+    "@reload" => {
+        if tokens.len() > 2
+        {
+            return Some(format!("Error: {}\n", InterpretErr::UnrecognizedCmd(tokens[2].peek().clone())));
+        }
+
+        return Some(match tenants.get(tokens[1].peek())
+        {
+        Some(chosen) => match chosen.reload()
+        {
+        Ok(count) => format!("Reloaded {} units as \'{}\'\n", count, chosen.name),
+        Err(err) => format!("Error: could not reload \'{}\': {}\n", chosen.name, err),
+        },
+        None => format!("Error: no units database named \'{}\'\n", tokens[1].peek()),
+        });
+    },
+    _ => {},
+    };
+
+    let generation = line_tenant.current();
+    answer(tokens, interpreter, &generation.cache, generation.units())
+}
+
+/* As fn respond, with a single database and plan cache. Used by modes that
+ * convert line by line with a warm cache, eg follow mode.
+ */
+pub fn respond_with<I, O>(line: &str, interpreter: &mut Interpreter<I, O>, cache: &PlanCache, units: &UnitDatabase)
+    -> Option<String> where I: io::Read, O: io::Write
+{
+    let tokens = match tokenize_line(line.trim_right_matches(|ch| ch == '\n' || ch == '\r'))
+    {
+    Ok(tokens) => tokens,
+    Err(InterpretErr::BlankLine) => return Some(String::new()),
+    Err(err) => return Some(format!("Error: {}\n", err)),
+    };
+
+    answer(tokens, interpreter, cache, units)
+}
+
+// executes or converts a line once it is tokenized
+fn answer<I, O>(tokens: Vec<TokenType>, interpreter: &mut Interpreter<I, O>, cache: &PlanCache, units: &UnitDatabase)
+    -> Option<String> where I: io::Read, O: io::Write
+{
+    if is_command(tokens[0].peek())
+    {
+        return match interpreter.execute(tokens)
+        {
+        Err(InterpretErr::ExitSig) => None,
+        Err(InterpretErr::BlankLine) |
+        Err(InterpretErr::HelpSig) |
+        Err(InterpretErr::VersionSig) => Some(String::new()),
+        Err(cmd_mesg @ InterpretErr::CmdSuccess(..)) => Some(format!("{}\n", cmd_mesg)),
+        Err(InterpretErr::ReplaySig(prims)) => {
+            let mut conversions = Vec::new();
+            for prim in prims.iter()
+            {
+                conversions.extend(convert_cached(prim, interpreter.format, cache, units));
+            }
+            Some(format_conversions(&conversions))
+        },
+        Err(err) => Some(format!("Error: {}\n", err)),
+        Ok(..) => unreachable!("command line executed as a conversion"),
+        };
+    }
+
+    if tokens.len() < 3
+    {
+        return Some(format!("Error: {}\n", InterpretErr::IncompleteErr));
+    }
+
+    let mut conv_primitive = match to_conv_primitive(&tokens)
+    {
+    Ok(prim) => prim,
+    Err(err) => return Some(format!("In token \'{}\': {}\n", tokens[err.failed_at].peek(), err)),
+    };
+
+    if let Some(err) = interpreter.perform_recall(&mut conv_primitive)
+    {
+        return Some(format!("Error: {}\n", err));
+    }
+
+    let conversions = convert_cached(&conv_primitive, interpreter.format, cache, units);
+    let text = format_conversions(&conversions);
+
+    interpreter.update_recall(&conversions);
+    Some(text)
+}
+
+// converts every value of the primitive into every output unit with plans from the cache
+fn convert_cached(conv_primitive: &ConvPrimitive, format: ConversionFmt, cache: &PlanCache, units: &UnitDatabase)
+    -> Vec<Conversion>
+{
+    let mut plans = Vec::with_capacity(conv_primitive.output_units.len());
+    for output_unit in conv_primitive.output_units.iter()
+    {
+        if output_unit.is_all()
+        {
+            // the units of a type are planned for each request rather than cached under '*'
+            let all = ConversionPlan::from_exprs_all(&conv_primitive.input_unit, slice::from_ref(output_unit), units);
+            plans.extend(all.into_iter().map(Arc::new));
+        }
+        else
+        {
+            plans.push(cache.plan(&conv_primitive.input_unit, output_unit, units));
+        }
+    }
+
+    let mut conversions = Vec::with_capacity(conv_primitive.input_vals.len() * plans.len());
+    for value_expr in conv_primitive.input_vals.iter()
+    {
+        for plan in plans.iter()
+        {
+            let mut conversion = plan.convert(value_expr.value);
+            conversion.format = format;
+            conversions.push(conversion);
+        }
+    }
+
+    conversions
+}
+
+fn format_conversions(conversions: &Vec<Conversion>) -> String
+{
+    let mut text = String::with_capacity(conversions.len() * 24);
+    for conversion in conversions.iter()
+    {
+        write!(text, "{}\n", conversion).unwrap();
+    }
+
+    text
+}
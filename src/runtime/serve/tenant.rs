@@ -0,0 +1,191 @@
+/* runtime/serve/tenant.rs
+ * ===
+ * The units databases a daemon serves. Besides the usual units.cfg, which is the 'default'
+ * database, the daemon may load any number of named variants of it with '--tenant', eg an
+ * aerospace set and a legacy imperial set, and clients choose one for their connection or
+ * for a single line (see fn respond in mod.rs). Each database has a cache of its own plans.
+ *
+ * Databases are reloaded one at a time from their files while the daemon runs. A reload
+ * reads the file into a new generation of the database and swaps it in; lines already
+ * being converted finish with the generation they started with. The new generation's cache
+ * is warmed with the pairs of the old one. Names and unit records that are the same in
+ * several databases are shared between them (see runtime/units/intern.rs).
+ *
+ * This file is a part of:
+ *
+ * Yucon - General Purpose Unit Converter
+ * Copyright (C) 2016-2017  Blaine Murphy
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use std::io;
+use std::sync::{Arc, Mutex, RwLock};
+use std::thread;
+
+use ::runtime::units::UnitDatabase;
+use ::runtime::units::config::{load_units_list, load_units_file};
+use ::runtime::units::intern;
+use ::runtime::serve::cache::PlanCache;
+
+// name of the database loaded from the usual units.cfg
+pub const DEFAULT_TENANT: &'static str = "default";
+
+// the database loaded at startup is borrowed until it is first reloaded
+enum Units<'a>
+{
+    Stock(&'a UnitDatabase),
+    Loaded(UnitDatabase),
+}
+
+/* struct Generation
+ *
+ * Description: a database as it was loaded at one time and the plans resolved
+ *   from it. Replaced whole when the database is reloaded.
+ */
+pub struct Generation<'a>
+{
+    units: Units<'a>,
+    pub cache: PlanCache,
+}
+
+impl<'a> Generation<'a>
+{
+    pub fn units(&self) -> &UnitDatabase
+    {
+        match self.units
+        {
+        Units::Stock(units) => units,
+        Units::Loaded(ref units) => units,
+        }
+    }
+}
+
+pub struct Tenant<'a>
+{
+    pub name: String,
+    path: Option<String>, // None for the default database, found as at startup
+    current: RwLock<Arc<Generation<'a>>>,
+    reloading: Mutex<()>,
+    capacity: usize,
+    fold: bool, // index folded names when reloading. see units/fold.rs
+}
+
+impl<'a> Tenant<'a>
+{
+    fn new(name: String, path: Option<String>, units: Units<'a>, capacity: usize, fold: bool) -> Tenant<'a>
+    {
+        Tenant {
+            name: name,
+            path: path,
+            current: RwLock::new(Arc::new(Generation { units: units, cache: PlanCache::new(capacity) })),
+            reloading: Mutex::new(()),
+            capacity: capacity,
+            fold: fold,
+        }
+    }
+
+    // the generation to convert a line with
+    pub fn current(&self) -> Arc<Generation<'a>>
+    {
+        self.current.read().unwrap().clone()
+    }
+
+    /* Loads the database again from its file and swaps it in. Returns how many
+     * units it has. The old generation is kept if the file cannot be read.
+     */
+    pub fn reload(&self) -> io::Result<usize>
+    {
+        // two reloads of the same database at once would only repeat the work
+        let _reloading = self.reloading.lock().unwrap();
+
+        let units = match self.path
+        {
+        Some(ref path) => try!(load_units_file(path, self.fold)),
+        None => match load_units_list(self.fold)
+        {
+        Some(units) => units,
+        None => return Err(io::Error::new(io::ErrorKind::NotFound, "units.cfg could not be read")),
+        },
+        };
+
+        let count = units.all().len();
+        let generation = Generation { units: Units::Loaded(units), cache: PlanCache::new(self.capacity) };
+
+        // plans of the old generation may name units the new one no longer has. they are resolved again
+        let old = self.current();
+        for (key, hits) in old.cache.hottest(self.capacity)
+        {
+            generation.cache.warm(key, hits, generation.units());
+        }
+
+        *self.current.write().unwrap() = Arc::new(generation);
+        drop(old);
+
+        // the old generation is freed once the last line converted with it is done
+        intern::shared().purge();
+        Ok(count)
+    }
+}
+
+/* struct Tenants
+ *
+ * Description: every database the daemon serves, the default one first.
+ */
+pub struct Tenants<'a>
+{
+    tenants: Vec<Tenant<'a>>,
+}
+
+impl<'a> Tenants<'a>
+{
+    /* Loads the databases named in 'paths' alongside the default database
+     * 'stock', each on its own thread, indexing their folded names if 'fold' is
+     * set. Fails if any file cannot be read.
+     */
+    pub fn load(stock: &'a UnitDatabase, paths: &[(String, String)], capacity: usize, fold: bool)
+        -> io::Result<Tenants<'a>>
+    {
+        let loaded: Vec<io::Result<UnitDatabase>> = thread::scope(|scope| {
+            let loaders: Vec<_> = paths.iter()
+                .map(|&(_, ref path)| scope.spawn(move || load_units_file(path, fold)))
+                .collect();
+
+            loaders.into_iter().map(|loader| loader.join().unwrap()).collect()
+        });
+
+        let mut tenants = vec![Tenant::new(DEFAULT_TENANT.to_string(), None, Units::Stock(stock), capacity, fold)];
+
+        for (&(ref name, ref path), units) in paths.iter().zip(loaded.into_iter())
+        {
+            let units = try!(units.map_err(|err| io::Error::new(err.kind(), format!("\'{}\': {}", path, err))));
+            tenants.push(Tenant::new(name.clone(), Some(path.clone()), Units::Loaded(units), capacity, fold));
+        }
+
+        Ok(Tenants { tenants: tenants })
+    }
+
+    pub fn get(&self, name: &str) -> Option<&Tenant<'a>>
+    {
+        self.tenants.iter().find(|tenant| tenant.name == name)
+    }
+
+    pub fn default(&self) -> &Tenant<'a>
+    {
+        &self.tenants[0]
+    }
+
+    pub fn iter<'b>(&'b self) -> ::std::slice::Iter<'b, Tenant<'a>>
+    {
+        self.tenants.iter()
+    }
+}
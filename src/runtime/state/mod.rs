@@ -1,11 +1,36 @@
 use runtime::convert::ConversionFmt;
 use runtime::InterpretErr;
+use runtime::serve::tenant::DEFAULT_TENANT;
 use std::env;
+use yucon_core::exact::Rounding;
+use yucon_core::kernel::Ratio;
 
 pub struct Options
 {
-    interactive: bool,
-    format: ConversionFmt,
+    pub interactive: bool,
+    pub batch: bool,
+    pub format: ConversionFmt,
+    pub input_path: Option<String>,
+    pub output_path: Option<String>,
+    pub resume: bool,
+    pub progress: bool,
+    pub follow_path: Option<String>,
+    pub window: Option<usize>, // lines of a batch grouped by pair of units before conversion
+    pub autoscale: bool,
+    pub fold_names: bool, // also find units by their folded names. see units/fold.rs
+    pub json: bool,
+    pub field: Option<String>,
+    pub from_unit: Option<String>,
+    pub to_unit: Option<String>,
+    pub int_bits: Option<u32>, // integer mode with counts of this many bits
+    pub count_scale: Ratio,
+    pub rounding: Rounding,
+    pub serve_addr: Option<String>,
+    pub tenants: Vec<(String, String)>, // names and files of the databases served besides the default
+    pub hotset_path: Option<String>,
+    pub hotset_size: usize, // pairs saved in the hot set
+    pub verify_samples: Option<usize>, // random values per conversion checked by --verify
+    pub bench_lookups: Option<usize>, // lookups per thread made by --bench-cache
 }
 
 impl Options
@@ -14,7 +39,39 @@ impl Options
     {
         Options {
             interactive: true,
+            batch: false,
             format: ConversionFmt::Desc,
+            input_path: None,
+            output_path: None,
+            resume: false,
+            progress: false,
+            follow_path: None,
+            window: None,
+            autoscale: false,
+            fold_names: false,
+            json: false,
+            field: None,
+            from_unit: None,
+            to_unit: None,
+            int_bits: None,
+            count_scale: Ratio::from_int(1),
+            rounding: Rounding::HalfEven,
+            serve_addr: None,
+            tenants: Vec::new(),
+            hotset_path: None,
+            hotset_size: 256,
+            verify_samples: None,
+            bench_lookups: None,
+        }
+    }
+
+    // fetches the argument of an option that takes one. eg the path in '--input path'
+    fn opt_arg(opt: &String, args: &mut env::Args) -> Result<String, InterpretErr>
+    {
+        match args.next()
+        {
+        Some(arg) => Ok(arg),
+        None => Err(InterpretErr::MissingOptArg(opt.clone())),
         }
     }
 
@@ -39,6 +96,92 @@ impl Options
                 {
                 "--help" => return Err(InterpretErr::HelpSig),
                 "--version" => return Err(InterpretErr::VersionSig),
+                "--input" => opts.input_path = Some(try!(Options::opt_arg(&arg, &mut args))),
+                "--output" => opts.output_path = Some(try!(Options::opt_arg(&arg, &mut args))),
+                "--resume" => opts.resume = true,
+                "--progress" => opts.progress = true,
+                "--follow" => opts.follow_path = Some(try!(Options::opt_arg(&arg, &mut args))),
+                "--window" => {
+                    let lines = try!(Options::opt_arg(&arg, &mut args));
+                    opts.window = match lines.parse::<usize>()
+                    {
+                    Ok(lines) if lines > 0 => Some(lines),
+                    _ => return Err(InterpretErr::BadOptArg(arg, lines)),
+                    };
+                },
+                "--autoscale" => opts.autoscale = true,
+                "--fold-names" => opts.fold_names = true,
+                "--json" => opts.json = true,
+                "--field" => opts.field = Some(try!(Options::opt_arg(&arg, &mut args))),
+                "--from" => opts.from_unit = Some(try!(Options::opt_arg(&arg, &mut args))),
+                "--to" => opts.to_unit = Some(try!(Options::opt_arg(&arg, &mut args))),
+                "--int" => {
+                    let int_type = try!(Options::opt_arg(&arg, &mut args));
+                    opts.int_bits = match int_type.as_ref()
+                    {
+                    "i32" => Some(32),
+                    "i64" => Some(64),
+                    _ => return Err(InterpretErr::BadOptArg(arg, int_type)),
+                    };
+                },
+                "--scale" => {
+                    let scale = try!(Options::opt_arg(&arg, &mut args));
+                    opts.count_scale = match Ratio::from_decimal(&scale)
+                    {
+                    Some(ref ratio) if ratio.numer() > 0 => *ratio,
+                    _ => return Err(InterpretErr::BadOptArg(arg, scale)),
+                    };
+                },
+                "--round" => {
+                    let mode = try!(Options::opt_arg(&arg, &mut args));
+                    opts.rounding = match Rounding::from_name(&mode)
+                    {
+                    Some(rounding) => rounding,
+                    None => return Err(InterpretErr::BadOptArg(arg, mode)),
+                    };
+                },
+                "--serve" => opts.serve_addr = Some(try!(Options::opt_arg(&arg, &mut args))),
+                "--tenant" => {
+                    let tenant = try!(Options::opt_arg(&arg, &mut args));
+                    let (name, path) = match tenant.find('=')
+                    {
+                    Some(split) => (tenant[..split].to_string(), tenant[split + 1..].to_string()),
+                    None => return Err(InterpretErr::BadOptArg(arg, tenant)),
+                    };
+
+                    if name.is_empty() || path.is_empty() || name == DEFAULT_TENANT
+                        || opts.tenants.iter().any(|&(ref other, _)| *other == name)
+                    {
+                        return Err(InterpretErr::BadOptArg(arg, tenant));
+                    }
+
+                    opts.tenants.push((name, path));
+                },
+                "--hotset" => opts.hotset_path = Some(try!(Options::opt_arg(&arg, &mut args))),
+                "--hotset-size" => {
+                    let size = try!(Options::opt_arg(&arg, &mut args));
+                    opts.hotset_size = match size.parse::<usize>()
+                    {
+                    Ok(size) => size,
+                    Err(..) => return Err(InterpretErr::BadOptArg(arg, size)),
+                    };
+                },
+                "--verify" => {
+                    let samples = try!(Options::opt_arg(&arg, &mut args));
+                    opts.verify_samples = match samples.parse::<usize>()
+                    {
+                    Ok(samples) => Some(samples),
+                    Err(..) => return Err(InterpretErr::BadOptArg(arg, samples)),
+                    };
+                },
+                "--bench-cache" => {
+                    let lookups = try!(Options::opt_arg(&arg, &mut args));
+                    opts.bench_lookups = match lookups.parse::<usize>()
+                    {
+                    Ok(lookups) if lookups > 0 => Some(lookups),
+                    _ => return Err(InterpretErr::BadOptArg(arg, lookups)),
+                    };
+                },
                 _ => return Err(InterpretErr::UnknownLongOpt(arg)),
                 };
             }
@@ -69,6 +212,7 @@ impl Options
                     {
                         match ch
                         {
+                        'b' => opts.batch = true,
                         's' => opts.format = ConversionFmt::Short,
                         'l' => opts.format = ConversionFmt::Long,
                         _ => return Err(InterpretErr::UnknownShortOpt(ch)),
@@ -95,6 +239,30 @@ impl Options
             }
         }
 
+        // files, resuming, and batch tuning are only for the modes that use them, rather than ignored
+        let reads = opts.batch || opts.json || opts.int_bits.is_some();
+        if opts.input_path.is_some() && !reads
+        {
+            return Err(InterpretErr::BadOptArg(String::from("--input"), String::from("needs -b, --json, or --int")));
+        }
+        if opts.output_path.is_some() && !reads && opts.follow_path.is_none()
+        {
+            return Err(InterpretErr::BadOptArg(String::from("--output"),
+                                               String::from("needs -b, --json, --int, or --follow")));
+        }
+        if opts.resume && !opts.batch
+        {
+            return Err(InterpretErr::BadOptArg(String::from("--resume"), String::from("needs -b")));
+        }
+        if opts.progress && !opts.batch
+        {
+            return Err(InterpretErr::BadOptArg(String::from("--progress"), String::from("needs -b")));
+        }
+        if opts.window.is_some() && !opts.batch
+        {
+            return Err(InterpretErr::BadOptArg(String::from("--window"), String::from("needs -b")));
+        }
+
         Ok((opts, extras))
     }
 }
\ No newline at end of file
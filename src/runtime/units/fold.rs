@@ -0,0 +1,94 @@
+/* units/fold.rs
+ * ===
+ * Folding of unit names for loose lookup. Units are named exactly in units.cfg, which is case
+ * sensitive, but people and data feeds spell them inconsistently: \'µm\' for \'um\', \'N·m\'
+ * for \'Nm\', \'KWH\' for \'kWh\'. A folded name is the name with
+ *
+ *   1. compatibility forms replaced by plain ones. Eg the micro sign and Greek mu become
+ *      \'u\', superscript digits become digits, and degree signs are dropped
+ *   2. case folded
+ *   3. punctuation and spaces that only join words stripped. Eg \'·\', \'-\', \'.\', \' \'.
+ *      \'/\' is kept since \'m/s\' and \'ms\' are different units
+ *
+ * The table below only covers the characters seen in unit symbols rather than all of Unicode.
+ * A units database may be given an index of folded names (see fn UnitDatabase::fold_names),
+ * which is only searched for a name that is not found as it was given.
+ *
+ * This file is a part of:
+ *
+ * Yucon - General Purpose Unit Converter
+ * Copyright (C) 2016-2017  Blaine Murphy
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// the plain form of a character, if it has a compatibility form used in unit symbols
+fn plain_form(ch: char) -> Option<&'static str>
+{
+    let plain = match ch
+    {
+    '\u{00B5}' | '\u{03BC}' => "u", // micro sign, Greek small mu
+    '\u{00B0}' | '\u{00BA}' => "", // degree sign, masculine ordinal often typed for it. '°C' is 'C'
+    '\u{2103}' => "c",
+    '\u{2109}' => "f",
+    '\u{2126}' | '\u{03A9}' => "ohm",
+    '\u{212A}' => "k", // Kelvin sign
+    '\u{212B}' | '\u{00C5}' => "a", // angstrom sign, A with ring
+    '\u{00B9}' | '\u{2081}' => "1",
+    '\u{00B2}' | '\u{2082}' => "2",
+    '\u{00B3}' | '\u{2083}' => "3",
+    '\u{2070}' | '\u{2080}' => "0",
+    '\u{2074}' | '\u{2084}' => "4",
+    '\u{00BD}' => "1/2",
+    '\u{00BC}' => "1/4",
+    '\u{2044}' | '\u{2215}' => "/", // fraction and division slashes
+    '\u{2113}' => "l", // script small l, used for litre
+    _ => return None,
+    };
+
+    Some(plain)
+}
+
+// whether a character only joins the words of a name and is dropped
+fn is_joiner(ch: char) -> bool
+{
+    match ch
+    {
+    '\u{00B7}' | '\u{22C5}' | '\u{2022}' | '\u{2219}' | // middle dot, dot operator, bullets
+    '\u{00D7}' | '*' | // multiplication signs
+    '-' | '\u{2010}' | '\u{2011}' | '\u{2012}' | '\u{2013}' | '\u{2014}' | '\u{2212}' |
+    '.' | '_' | '\'' | '\u{2019}' => true,
+    _ => ch.is_whitespace(),
+    }
+}
+
+/* Writes the folded form of 'name' into 'folded', which is cleared first. Folding a name
+ * twice gives the same result as folding it once.
+ */
+pub fn fold_name(name: &str, folded: &mut String)
+{
+    folded.clear();
+
+    for ch in name.chars()
+    {
+        if is_joiner(ch)
+        {
+            continue;
+        }
+
+        match plain_form(ch)
+        {
+        Some(plain) => folded.push_str(plain),
+        None => folded.extend(ch.to_lowercase()),
+        };
+    }
+}
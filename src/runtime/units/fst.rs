@@ -0,0 +1,373 @@
+/* runtime/units/fst.rs
+ * ===
+ * Builds the compact, read-only dictionary from unit names to unit indices that is read by
+ * yucon_core's fst.rs, a minimized acyclic finite state transducer. Names sharing a beginning
+ * share the states for it and names sharing an ending share the states for that too, so large
+ * catalogs of names like 'cubic foot', 'cubic inch', 'square foot', ... cost a few bytes per
+ * name rather than a map entry and a string each. The index of a name is the sum of the
+ * outputs along its path, pushed as close to the start as they can go so that they are
+ * shared as well. See yucon_core's fst.rs for the layout of the bytes.
+ *
+ * This file is also compiled into yucon_core's build.rs, which builds the dictionary of the
+ * default units with it.
+ *
+ * This file is a part of:
+ *
+ * Yucon - General Purpose Unit Converter
+ * Copyright (C) 2016-2017  Blaine Murphy
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use std::cmp;
+use std::collections::HashMap;
+use yucon_core::fst;
+use yucon_core::fst::FINAL;
+
+#[derive(Debug, Clone, PartialEq, Eq, Hash)]
+struct Transition
+{
+    byte: u8,
+    output: u32,
+    target: usize, // address of the next state once it is written
+}
+
+#[derive(Debug, Clone, PartialEq, Eq, Hash, Default)]
+struct State
+{
+    is_final: bool,
+    final_output: u32,
+    transitions: Vec<Transition>,
+}
+
+/* struct Builder
+ *
+ * Description: builds an Fst from names given in sorted order. States along
+ *   the path of the last name are kept open since the next name may still add
+ *   to them; the rest are written as soon as no later name can reach them,
+ *   and a state already written identically is reused instead.
+ */
+pub struct Builder
+{
+    bytes: Vec<u8>,
+    written: HashMap<State, usize>,
+    open: Vec<State>, // open[i] is reached by the first i bytes of the last name
+    last: Vec<u8>,
+    count: u64,
+    longest: usize,
+}
+
+impl Builder
+{
+    pub fn new() -> Builder
+    {
+        Builder {
+            bytes: Vec::new(),
+            written: HashMap::new(),
+            open: vec![State::default()],
+            last: Vec::new(),
+            count: 0,
+            longest: 0,
+        }
+    }
+
+    /* Adds a name. Names must be added in increasing byte order; returns false
+     * and adds nothing if this one is not after the last.
+     */
+    pub fn insert(&mut self, name: &[u8], index: u32) -> bool
+    {
+        if self.count > 0 && name <= &self.last[..]
+        {
+            return false;
+        }
+
+        let shared = self.last.iter().zip(name.iter()).take_while(|&(a, b)| a == b).count();
+        self.close_after(shared);
+
+        // push outputs on the shared path down to what this name has in common with them
+        let mut output = index;
+        for depth in 0..shared
+        {
+            let (common, rest) = {
+                let transition = self.open[depth].transitions.last_mut().unwrap();
+                let common = cmp::min(transition.output, output);
+                let rest = transition.output - common;
+                transition.output = common;
+                (common, rest)
+            };
+
+            output -= common;
+
+            if rest > 0
+            {
+                let next = &mut self.open[depth + 1];
+                for transition in next.transitions.iter_mut()
+                {
+                    transition.output += rest;
+                }
+                if next.is_final
+                {
+                    next.final_output += rest;
+                }
+            }
+        }
+
+        if name.len() == shared
+        {
+            // only the empty name can end on the shared path
+            let state = &mut self.open[shared];
+            state.is_final = true;
+            state.final_output = output;
+        }
+        else
+        {
+            for (offset, byte) in name[shared..].iter().enumerate()
+            {
+                let first = offset == 0;
+                self.open.last_mut().unwrap().transitions.push(Transition {
+                    byte: *byte,
+                    output: if first { output } else { 0 },
+                    target: 0,
+                });
+                self.open.push(State::default());
+            }
+
+            self.open.last_mut().unwrap().is_final = true;
+        }
+
+        self.last.clear();
+        self.last.extend_from_slice(name);
+        self.count += 1;
+        self.longest = cmp::max(self.longest, name.len());
+        true
+    }
+
+    // writes the open states deeper than 'depth', which no later name can reach
+    fn close_after(&mut self, depth: usize)
+    {
+        while self.open.len() > depth + 1
+        {
+            let state = self.open.pop().unwrap();
+            let address = self.write(state);
+            self.open.last_mut().unwrap().transitions.last_mut().unwrap().target = address;
+        }
+    }
+
+    fn write(&mut self, state: State) -> usize
+    {
+        if let Some(address) = self.written.get(&state)
+        {
+            return *address;
+        }
+
+        let address = self.bytes.len();
+        self.bytes.push(if state.is_final { FINAL } else { 0 });
+
+        if state.is_final
+        {
+            push_varint(&mut self.bytes, state.final_output as u64);
+        }
+
+        push_varint(&mut self.bytes, state.transitions.len() as u64);
+
+        for transition in state.transitions.iter()
+        {
+            self.bytes.push(transition.byte);
+            push_varint(&mut self.bytes, transition.output as u64);
+            push_varint(&mut self.bytes, (address - transition.target) as u64);
+        }
+
+        self.written.insert(state, address);
+        address
+    }
+
+    pub fn finish(mut self) -> Fst
+    {
+        self.close_after(0);
+        let root = self.open.pop().unwrap();
+        let root = self.write(root);
+
+        let mut bytes = self.bytes;
+        for value in [root as u64, self.count, self.longest as u64].iter()
+        {
+            for offset in 0..8
+            {
+                bytes.push((value >> (8 * offset)) as u8);
+            }
+        }
+        bytes.shrink_to_fit();
+
+        Fst { bytes: bytes }
+    }
+}
+
+fn push_varint(bytes: &mut Vec<u8>, mut value: u64)
+{
+    while value >= 0x80
+    {
+        bytes.push(value as u8 | 0x80);
+        value >>= 7;
+    }
+    bytes.push(value as u8);
+}
+
+/* struct Fst
+ *
+ * Description: a built dictionary, which owns its bytes and reads them with
+ *   yucon_core's Fst
+ */
+#[derive(Debug, Clone)]
+pub struct Fst
+{
+    bytes: Vec<u8>,
+}
+
+impl Fst
+{
+    /* Builds a dictionary from names in increasing byte order. Names out of
+     * order are left out.
+     */
+    pub fn from_sorted<'a, I>(names: I) -> Fst where I: IntoIterator<Item = (&'a [u8], u32)>
+    {
+        let mut builder = Builder::new();
+
+        for (name, index) in names
+        {
+            builder.insert(name, index);
+        }
+
+        builder.finish()
+    }
+
+    // the bytes as they may be stored and read back with yucon_core's Fst::from_bytes
+    pub fn as_bytes(&self) -> &[u8]
+    {
+        &self.bytes
+    }
+
+    pub fn reader(&self) -> fst::Fst
+    {
+        fst::Fst::from_bytes(self.as_bytes()).expect("a built dictionary has its trailer")
+    }
+
+    // the index of a name, if it is in the dictionary
+    pub fn get(&self, name: &[u8]) -> Option<u32>
+    {
+        self.reader().get(name)
+    }
+
+    // every name beginning with 'prefix' and its index, in byte order
+    pub fn starting_with(&self, prefix: &[u8]) -> Vec<(Vec<u8>, u32)>
+    {
+        let reader = self.reader();
+        let mut name = vec![0; cmp::max(reader.longest(), prefix.len())];
+        let mut found = Vec::new();
+
+        reader.starting_with(prefix, &mut name, |name, index| found.push((name.to_vec(), index)));
+        found
+    }
+}
+
+#[cfg(test)]
+mod tests
+{
+    use super::*;
+
+    // shared prefixes and suffixes, with indexes in no particular order
+    const NAMES: [(&'static str, u32); 12] = [
+        ("cm", 7), ("foot", 3), ("km", 12), ("m", 0), ("meter", 0), ("meters", 9),
+        ("mi", 40), ("mile", 40), ("miles", 1), ("millimeter", 5), ("min", 2), ("nm", 7)];
+
+    fn build() -> Fst
+    {
+        Fst::from_sorted(NAMES.iter().map(|&(name, index)| (name.as_bytes(), index)))
+    }
+
+    #[test]
+    fn get_finds_only_the_names()
+    {
+        let fst = build();
+
+        for &(name, index) in NAMES.iter()
+        {
+            assert_eq!(fst.get(name.as_bytes()), Some(index), "{}", name);
+        }
+
+        for name in ["", "c", "mil", "milli", "mete", "metersx", "z", "kmm", "n"].iter()
+        {
+            assert_eq!(fst.get(name.as_bytes()), None, "{}", name);
+        }
+    }
+
+    #[test]
+    fn starting_with_lists_names_in_order()
+    {
+        let fst = build();
+
+        for prefix in ["", "m", "mi", "mil", "mile", "miles", "meter", "k", "x", "milesx"].iter()
+        {
+            let expected: Vec<(Vec<u8>, u32)> = NAMES.iter()
+                .filter(|&&(name, _)| name.starts_with(prefix))
+                .map(|&(name, index)| (name.as_bytes().to_vec(), index))
+                .collect();
+
+            assert_eq!(fst.starting_with(prefix.as_bytes()), expected, "{}", prefix);
+        }
+    }
+
+    #[test]
+    fn bytes_read_back()
+    {
+        let fst = build();
+        let reader = fst::Fst::from_bytes(fst.as_bytes()).unwrap();
+
+        assert_eq!(reader.len(), NAMES.len());
+        assert_eq!(reader.longest(), "millimeter".len());
+        assert_eq!(reader.get(b"miles"), Some(1));
+
+        assert!(fst::Fst::from_bytes(&fst.as_bytes()[..fst::TRAILER - 1]).is_none());
+        assert!(fst::Fst::from_bytes(&[]).is_none());
+    }
+
+    #[test]
+    fn builder_rejects_names_out_of_order()
+    {
+        let mut builder = Builder::new();
+
+        assert!(builder.insert(b"b", 1));
+        assert!(!builder.insert(b"a", 2));
+        assert!(!builder.insert(b"b", 3));
+        assert!(builder.insert(b"ba", 4));
+
+        let fst = builder.finish();
+        assert_eq!(fst.get(b"a"), None);
+        assert_eq!(fst.get(b"b"), Some(1));
+        assert_eq!(fst.reader().len(), 2);
+    }
+
+    #[test]
+    fn many_names()
+    {
+        let names: Vec<String> = (0..2000).map(|index| format!("u{}", index)).collect();
+        let mut sorted: Vec<(&[u8], u32)> = names.iter().enumerate().map(|(index, name)| (name.as_bytes(), index as u32)).collect();
+        sorted.sort();
+
+        let fst = Fst::from_sorted(sorted.iter().cloned());
+
+        for &(name, index) in sorted.iter()
+        {
+            assert_eq!(fst.get(name), Some(index));
+        }
+
+        assert_eq!(fst.starting_with(b"u199").len(), 11);
+    }
+}
@@ -0,0 +1,152 @@
+/* units/intern.rs
+ * ===
+ * Interner shared by every units database in the process. A daemon serving several
+ * databases (see runtime/serve/tenant.rs) would otherwise hold a copy of each name and unit
+ * record for each of them, though most are the same in every variant of units.cfg. Names
+ * and records are handed out here instead, so identical ones are stored once however many
+ * databases hold them. Entries held by no database are dropped by fn purge.
+ *
+ * Records are only shared across databases. Two identical records within one database are
+ * still two units, eg the same unit under two tags, and listings and the FST indices tell
+ * them apart by address, so the second is given its own record.
+ *
+ * The names and the records are each behind a single lock, taken once per name or record
+ * added. Databases loaded at the same time, eg tenants reloaded together, are serialized on
+ * it for those steps, and fn purge holds it while it walks every entry.
+ *
+ * This file is a part of:
+ *
+ * Yucon - General Purpose Unit Converter
+ * Copyright (C) 2016-2017  Blaine Murphy
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use std::collections::{HashMap, HashSet};
+use std::sync::{Arc, Mutex, OnceLock};
+
+use ::runtime::units::Unit;
+
+/* struct UnitKey
+ *
+ * Description: every field of a unit, with floats by their bits, so that
+ *   records are only shared when they are identical to the bit.
+ */
+#[derive(PartialEq, Eq, Hash)]
+struct UnitKey
+{
+    common_name: Arc<String>,
+    conv_factor: u64,
+    dimensions: u8,
+    inverse: bool,
+    unit_type: &'static str,
+    zero_point: u64,
+    exact_conv: Option<(i128, i128)>,
+    exact_zero: Option<(i128, i128)>,
+    has_aliases: bool,
+    has_tags: bool,
+}
+
+impl UnitKey
+{
+    fn new(unit: &Unit) -> UnitKey
+    {
+        UnitKey {
+            common_name: unit.common_name.clone(),
+            conv_factor: unit.conv_factor.to_bits(),
+            dimensions: unit.dimensions,
+            inverse: unit.inverse,
+            unit_type: unit.unit_type,
+            zero_point: unit.zero_point.to_bits(),
+            exact_conv: unit.exact_conv.map(|ratio| (ratio.numer(), ratio.denom())),
+            exact_zero: unit.exact_zero.map(|ratio| (ratio.numer(), ratio.denom())),
+            has_aliases: unit.has_aliases,
+            has_tags: unit.has_tags,
+        }
+    }
+}
+
+pub struct Interner
+{
+    names: Mutex<HashSet<Arc<String>>>,
+    units: Mutex<HashMap<UnitKey, Arc<Unit>>>,
+}
+
+// the interner of the process
+pub fn shared() -> &'static Interner
+{
+    static SHARED: OnceLock<Interner> = OnceLock::new();
+
+    SHARED.get_or_init(|| Interner {
+        names: Mutex::new(HashSet::new()),
+        units: Mutex::new(HashMap::new()),
+    })
+}
+
+impl Interner
+{
+    // the shared copy of a name, eg an alias, tag, or common name
+    pub fn name(&self, name: &Arc<String>) -> Arc<String>
+    {
+        let mut names = self.names.lock().unwrap();
+
+        if let Some(shared) = names.get(name)
+        {
+            return shared.clone();
+        }
+
+        names.insert(name.clone());
+        name.clone()
+    }
+
+    /* The shared copy of a unit record, unless the database adding it already
+     * holds that copy, given as the addresses of the shared records it holds.
+     * Its common name should be interned first.
+     */
+    pub fn unit(&self, unit: Unit, held: &mut HashSet<usize>) -> Arc<Unit>
+    {
+        let key = UnitKey::new(&unit);
+        let mut units = self.units.lock().unwrap();
+
+        if let Some(shared) = units.get(&key)
+        {
+            if held.insert(&**shared as *const Unit as usize)
+            {
+                return shared.clone();
+            }
+
+            // identical to one of the database's own
+            return Arc::new(unit);
+        }
+
+        let shared = Arc::new(unit);
+        held.insert(&*shared as *const Unit as usize);
+        units.insert(key, shared.clone());
+        shared
+    }
+
+    /* Drops the names and units no database holds any more, eg the aliases of a
+     * database once it is frozen or everything of one that was reloaded.
+     */
+    pub fn purge(&self)
+    {
+        // units hold their common names, so they go first
+        self.units.lock().unwrap().retain(|_, unit| Arc::strong_count(unit) > 1);
+        self.names.lock().unwrap().retain(|name| Arc::strong_count(name) > 1);
+    }
+
+    // how many names and units are held
+    pub fn len(&self) -> (usize, usize)
+    {
+        (self.names.lock().unwrap().len(), self.units.lock().unwrap().len())
+    }
+}
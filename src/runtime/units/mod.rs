@@ -20,53 +20,158 @@
  */
 
 pub mod config;
+pub mod fold;
+pub mod fst;
+pub mod intern;
+pub mod reader;
 
-use std::collections::BTreeMap;
-use std::rc::Rc;
-
-// unit types Yucon recognizes
-// statically allocated so that we do not waste memory storing duplicate data
-pub static UNIT_TYPES: [&'static str; 12] = ["area",
-                                             "energy",
-                                             "force",
-                                             "fuel economy",
-                                             "length",
-                                             "mass",
-                                             "power",
-                                             "pressure",
-                                             "speed",
-                                             "temperature",
-                                             "torque",
-                                             "volume",];
-
-
-#[derive(Debug)]
-pub struct Unit
+use std::collections::{BTreeMap, BTreeSet, HashMap, HashSet};
+use std::io;
+use std::io::Write;
+use std::sync::Arc;
+
+use yucon_core::convert::Factors;
+use yucon_core::exact::ExactFactors;
+
+use self::fold::fold_name;
+use self::fst::Fst;
+
+// the unit types, the units themselves, and their properties as read are shared with yucon_core's build.rs
+pub use self::reader::{Unit, UnitInit, PREFERRED_TAG};
+
+impl Unit
+{
+    // the numbers the conversion core needs from this unit
+    pub fn factors(&self) -> Factors
+    {
+        Factors {
+            conv_factor: self.conv_factor,
+            zero_point: self.zero_point,
+            dimensions: self.dimensions,
+            inverse: self.inverse,
+        }
+    }
+
+    // the exact numbers for integer conversions. None if a literal did not fit
+    pub fn exact_factors(&self) -> Option<ExactFactors>
+    {
+        Some(ExactFactors {
+            conv_factor: self.exact_conv?,
+            zero_point: self.exact_zero?,
+            inverse: self.inverse,
+        })
+    }
+}
+
+/* enum Aliases
+ *
+ * Description: the names of the units in one namespace. A map while units are
+ *   being added, then frozen into an FST mapping each name to the unit's index
+ *   in the database, which takes a small fraction of the memory. See fst.rs.
+ */
+enum Aliases
 {
-    pub common_name: Rc<String>,
-    pub conv_factor: f64,
-    pub dimensions: u8,
-    pub inverse: bool,
-    pub unit_type: &'static str, //life time is static because the type strings are embedded
-    pub zero_point: f64,
-    pub has_aliases: bool,
-    pub has_tags: bool,
+    Open(BTreeMap<Arc<String>, Arc<Unit>>),
+    Frozen(Fst),
 }
 
-impl Unit
+impl Aliases
 {
-    pub fn new() -> Unit
+    fn new() -> Aliases
+    {
+        Aliases::Open(BTreeMap::new())
+    }
+
+    fn get(&self, name: &String, units: &Vec<Arc<Unit>>) -> Option<Arc<Unit>>
+    {
+        match *self
+        {
+        Aliases::Open(ref map) => map.get(name).cloned(),
+        Aliases::Frozen(ref fst) => fst.get(name.as_bytes()).map(|index| units[index as usize].clone()),
+        }
+    }
+
+    fn contains_key(&self, name: &String) -> bool
+    {
+        match *self
+        {
+        Aliases::Open(ref map) => map.contains_key(name),
+        Aliases::Frozen(ref fst) => fst.get(name.as_bytes()).is_some(),
+        }
+    }
+
+    fn insert(&mut self, name: Arc<String>, unit: Arc<Unit>)
+    {
+        match *self
+        {
+        Aliases::Open(ref mut map) => { map.insert(name, unit); },
+        Aliases::Frozen(..) => unreachable!("unit added to a frozen units database"),
+        };
+    }
+
+    // 'indices' gives the index in the database of each unit, by address
+    fn freeze(&mut self, indices: &HashMap<*const Unit, u32>)
+    {
+        let fst = match *self
+        {
+        Aliases::Open(ref map) => {
+            // maps iterate in key order, which for strings is byte order
+            Fst::from_sorted(map.iter().map(|(name, unit)| (name.as_bytes(), indices[&(&**unit as *const Unit)])))
+        },
+        Aliases::Frozen(..) => return,
+        };
+
+        *self = Aliases::Frozen(fst);
+    }
+
+    // every name and the index of its unit. only once frozen
+    fn indexed(&self) -> Vec<(Vec<u8>, u32)>
+    {
+        match *self
+        {
+        Aliases::Open(..) => unreachable!("names of a units database listed before it was frozen"),
+        Aliases::Frozen(ref fst) => fst.starting_with(b""),
+        }
+    }
+
+    /* The names of this namespace folded (see fold.rs) and frozen. A folded name that the
+     * names of two different units share is left out and reported, so that it is never
+     * resolved to either of them.
+     */
+    fn folded(&self, tag: &str, units: &Vec<Arc<Unit>>) -> Aliases
     {
-        Unit {
-            common_name: Rc::new(String::new()),
-            conv_factor: 1.0,
-            dimensions: 1,
-            inverse: false,
-            unit_type: UNIT_TYPES[0],
-            zero_point: 0.0,
-            has_aliases: false,
-            has_tags: false,
+        let mut folded_names: BTreeMap<String, u32> = BTreeMap::new();
+        let mut ambiguous: BTreeSet<String> = BTreeSet::new();
+        let mut folded = String::with_capacity(32);
+
+        for (name, index) in self.indexed()
+        {
+            fold_name(&String::from_utf8_lossy(&name), &mut folded);
+
+            if folded.is_empty() || ambiguous.contains(&folded)
+            {
+                continue;
+            }
+
+            match folded_names.get(&folded).cloned()
+            {
+            Some(other_index) if other_index != index => {
+                writeln!(io::stderr(), "*** WARNING *** Names of different units are the same when folded. Neither will be found by it.\n\
+                                        Tag: \'{}\'    Folded name: \'{}\'    Units: \'{}\' and \'{}\'",
+                         tag,
+                         folded,
+                         units[other_index as usize].common_name,
+                         units[index as usize].common_name
+                ).ok();
+                folded_names.remove(&folded);
+                ambiguous.insert(folded.clone());
+            },
+            Some(..) => {},
+            None => { folded_names.insert(folded.clone(), index); },
+            };
         }
+
+        Aliases::Frozen(Fst::from_sorted(folded_names.iter().map(|(name, &index)| (name.as_bytes(), index))))
     }
 }
 
@@ -80,37 +185,60 @@ impl Unit
  * implemented in the future.
  *
  * Fields:
- *   - aliases: associative map between all unit names / aliases in the program\
- *       and the correct unit
+ *   - default_namespace, namespaces: the names / aliases of the units, untagged
+ *       and by tag. See enum Aliases
  *
  *   - units: linear container for all units in the program so that they may
  *       be easily listed at user's request.
  *
+ *   - types: the units of each type, in the order they were added. Built by
+ *       fn freeze for converting into every unit of a type.
+ *
+ *   - folded: the names of every namespace folded, if built by fn fold_names.
+ *       Only searched for names not found as given.
+ *
+ *   - held: the addresses of the shared records in units, so that one is not
+ *       shared twice within the database. See fn Interner::unit. Dropped by fn
+ *       freeze.
+ *
  */
 pub struct UnitDatabase
 {
     // TODO make default_namespace part of the namespaces tree
-    default_namespace: BTreeMap<Rc<String>, Rc<Unit>>,
-    namespaces: BTreeMap<Rc<String>, BTreeMap<Rc<String>, Rc<Unit>>>,
-    units: Vec<Rc<Unit>>,
-    preferred_namespace: Rc<String>,
-    //default_namespace_: Rc<String>
+    default_namespace: Aliases,
+    namespaces: BTreeMap<Arc<String>, Aliases>,
+    units: Vec<Arc<Unit>>,
+    types: BTreeMap<&'static str, Vec<Arc<Unit>>>,
+    preferred_namespace: Arc<String>,
+    folded: Option<FoldedNames>,
+    held: HashSet<usize>,
+    //default_namespace_: Arc<String>
+}
+
+// the names of a units database folded for loose lookup. see fn UnitDatabase::fold_names
+struct FoldedNames
+{
+    default_namespace: Aliases,
+    namespaces: BTreeMap<Arc<String>, Aliases>,
 }
 
 impl UnitDatabase
 {
     pub fn new() -> UnitDatabase
     {
-        let preferred = Rc::new("us".to_string());
-        //let default = Rc::new("default".to_string());
+        let preferred = Arc::new(PREFERRED_TAG.to_string());
+        //let default = Arc::new("default".to_string());
         let mut namespaces_ = BTreeMap::new();
-        namespaces_.insert(preferred.clone(), BTreeMap::new());
+        namespaces_.insert(preferred.clone(), Aliases::new());
         //namespaces_.insert(default.clone(), BTreeMap::new());
 
-        UnitDatabase { default_namespace: BTreeMap::new(),
+        UnitDatabase { default_namespace: Aliases::new(),
                        namespaces: namespaces_,
                        units: Vec::new(),
+                       types: BTreeMap::new(),
                        preferred_namespace: preferred,
+                       folded: None,
+                       held: HashSet::new(),
                        /*default_namespace_: default,*/ }
     }
 
@@ -121,15 +249,15 @@ impl UnitDatabase
      */
     fn check_collisions(&self,
                         unit: &Unit,
-                        aliases: &Vec<Rc<String>>,
-                        tags: &Vec<Rc<String>>) -> Option<(Rc<String>, Rc<String>)>
+                        aliases: &Vec<Arc<String>>,
+                        tags: &Vec<Arc<String>>) -> Option<(Arc<String>, Arc<String>)>
     {
         if !unit.has_tags
         {
             if self.default_namespace.contains_key(&unit.common_name)
             {
                 return Some(
-                    (Rc::new("default".to_string()), unit.common_name.clone())
+                    (Arc::new("default".to_string()), unit.common_name.clone())
                 );
             }
             for alias in aliases.iter()
@@ -137,7 +265,7 @@ impl UnitDatabase
                 if self.default_namespace.contains_key(alias)
                 {
                     return Some(
-                        (Rc::new("default".to_string()), alias.clone())
+                        (Arc::new("default".to_string()), alias.clone())
                     );
                 }
             }
@@ -207,8 +335,9 @@ impl UnitDatabase
     Success: None
     Failure: Some
     */
-    pub fn add(&mut self, unit: Unit, aliases: &Vec<Rc<String>>, tags: &Vec<Rc<String>>) -> Option<Unit>
+    pub fn add(&mut self, unit: Unit, aliases: &Vec<Arc<String>>, tags: &Vec<Arc<String>>) -> Option<Unit>
     {
+        trace_span!("UnitDatabase::add");
         if let Some(collision) = self.check_collisions(&unit, aliases, tags)
         {
             let (tag, name) = collision;
@@ -221,7 +350,11 @@ impl UnitDatabase
             return Some(unit);
         }
 
-        let unit_rc = Rc::new(unit);
+        // identical names and records are shared with any other database. see intern.rs
+        let interner = intern::shared();
+        let mut unit = unit;
+        unit.common_name = interner.name(&unit.common_name);
+        let unit_rc = interner.unit(unit, &mut self.held);
         self.units.push(unit_rc.clone());
 
         if unit_rc.has_tags
@@ -238,7 +371,7 @@ impl UnitDatabase
                 }
                 else
                 {
-                    self.namespaces.insert(tag.clone(), BTreeMap::new());
+                    self.namespaces.insert(interner.name(tag), Aliases::new());
                     self.namespaces.get_mut(tag).unwrap()
                 };
 
@@ -246,7 +379,7 @@ impl UnitDatabase
 
                 for alias in aliases.iter()
                 {
-                    namespace.insert(alias.clone(), unit_rc.clone());
+                    namespace.insert(interner.name(alias), unit_rc.clone());
                 }
             }
         }
@@ -256,29 +389,101 @@ impl UnitDatabase
 
             for alias in aliases.iter()
             {
-                self.default_namespace.insert(alias.clone(), unit_rc.clone());
+                self.default_namespace.insert(interner.name(alias), unit_rc.clone());
             }
         }
 
         None
     }
 
-    pub fn query(&self, name: &String, tag: Option<&String>) -> Option<Rc<Unit>>
+    /* Freezes the names of every namespace into FSTs once all units have been
+     * added and indexes the units by type. No units may be added after.
+     */
+    pub fn freeze(&mut self)
+    {
+        trace_span!("UnitDatabase::freeze");
+        let indices: HashMap<*const Unit, u32> = self.units.iter().enumerate()
+            .map(|(index, unit)| (&**unit as *const Unit, index as u32))
+            .collect();
+
+        self.default_namespace.freeze(&indices);
+        for namespace in self.namespaces.values_mut()
+        {
+            namespace.freeze(&indices);
+        }
+
+        for unit in self.units.iter()
+        {
+            self.types.entry(unit.unit_type).or_insert_with(Vec::new).push(unit.clone());
+        }
+
+        self.held = HashSet::new();
+    }
+
+    /* Builds the index of folded names (see fold.rs) so that names which are not found as
+     * given may be found by their folded form, eg 'N·m' as 'Nm'. Folded names that the
+     * names of different units share are reported and left out. Only once frozen.
+     */
+    pub fn fold_names(&mut self)
+    {
+        trace_span!("UnitDatabase::fold_names");
+        let default_namespace = self.default_namespace.folded("default", &self.units);
+        let namespaces = self.namespaces.iter()
+            .map(|(tag, namespace)| (tag.clone(), namespace.folded(tag, &self.units)))
+            .collect();
+
+        self.folded = Some(FoldedNames { default_namespace: default_namespace, namespaces: namespaces });
+    }
+
+    // every unit of a type, in the order they were added
+    pub fn of_type(&self, unit_type: &str) -> &[Arc<Unit>]
+    {
+        match self.types.get(unit_type)
+        {
+        Some(units) => units,
+        None => &[],
+        }
+    }
+
+    // every unit in the database, in the order they were added
+    pub fn all(&self) -> &Vec<Arc<Unit>>
+    {
+        &self.units
+    }
+
+    /* Finds the unit with a name, in the tagged namespace if a tag is given. A name that is
+     * not found as given is folded and looked up again if the folded names were indexed.
+     */
+    pub fn query(&self, name: &String, tag: Option<&String>) -> Option<Arc<Unit>>
+    {
+        let unit_result = self.search(&self.default_namespace, &self.namespaces, name, tag);
+
+        if unit_result.is_some()
+        {
+            return unit_result;
+        }
+
+        match self.folded
+        {
+        Some(ref folded) => {
+            let mut folded_name = String::with_capacity(name.len());
+            fold_name(name, &mut folded_name);
+            self.search(&folded.default_namespace, &folded.namespaces, &folded_name, tag)
+        },
+        None => None,
+        }
+    }
+
+    fn search(&self, default_namespace: &Aliases, namespaces: &BTreeMap<Arc<String>, Aliases>,
+        name: &String, tag: Option<&String>) -> Option<Arc<Unit>>
     {
         //println!("name: {:?}    tag: {:?}", name, tag);
-        let unit_result = if tag.is_some()
+        if tag.is_some()
         {
             // if the unit was tagged, search only in the tagged namespace
-            if let Some(namespace) = self.namespaces.get(tag.unwrap())
+            if let Some(namespace) = namespaces.get(tag.unwrap())
             {
-                if let Some(unit_rc) = namespace.get(&Rc::new(name.clone()))
-                {
-                    Some(unit_rc.clone())
-                }
-                else
-                {
-                    None
-                }
+                namespace.get(name, &self.units)
             }
             else
             {
@@ -291,177 +496,30 @@ impl UnitDatabase
             // 1. Preferred tag
             // 2. Default namespace
             // 3. All registered namespaces in alphabetical order
-            let mut inner_result = if let Some(unit) = self.namespaces.get(&self.preferred_namespace).unwrap().get(name)
-            {
-                Some(unit.clone())
-            }
-            else
-            {
-                None
-            };
+            let mut inner_result = namespaces.get(&self.preferred_namespace).unwrap().get(name, &self.units);
 
             if inner_result.is_none()
             {
-                inner_result = if let Some(unit) = self.default_namespace.get(name)
-                {
-                    Some(unit.clone())
-                }
-                else
-                {
-                    None
-                }
+                inner_result = default_namespace.get(name, &self.units);
             }
 
             if inner_result.is_none()
             {
-                for (registered_tag, namespace) in self.namespaces.iter()
+                for (registered_tag, namespace) in namespaces.iter()
                 {
                     if registered_tag.eq(&self.preferred_namespace)
                     {
                         continue;
                     }
-                    if let Some(unit) = namespace.get(name)
+                    if let Some(unit) = namespace.get(name, &self.units)
                     {
-                        inner_result = Some(unit.clone());
+                        inner_result = Some(unit);
                         break;
                     }
                 }
             }
 
             inner_result
-        };
-        /*
-        if let Some(unit_rc) = self.default_namespace.get(&Rc::new(name.clone()))
-        {
-            return Some(unit_rc.clone());
         }
-        */
-
-        unit_result
     }
 }
-
-// TODO refactor to make unit field private to ensure no initialization occurs without proper tracking
-pub struct UnitInit
-{
-    pub unit: Unit,
-    default_name: bool,
-    default_conv: bool,
-    default_dims: bool,
-    default_inv: bool,
-    default_type: bool,
-    default_zpt: bool,
-}
-
-impl UnitInit
-{
-    pub fn new() -> UnitInit
-    {
-        UnitInit
-        {
-            unit: Unit::new(),
-            default_name: true,
-            default_conv: true,
-            default_dims: true,
-            default_inv: true,
-            default_type: true,
-            default_zpt: true
-        }
-    }
-
-    pub fn set_common_name(&mut self, name: String)
-    {
-        if self.default_name
-        {
-            self.unit.common_name = Rc::new(name);
-            self.default_name = false;
-        }
-        else
-        {
-            unreachable!();
-            // the code is written such that there should never be an attempt
-            // to assign a common_name twice. encountering a new common name
-            // in config triggers a flush of the current unit and starts a new one.
-        }
-    }
-
-    pub fn set_conv_factor(&mut self, conv_factor: f64)
-    {
-        if self.default_conv
-        {
-            self.unit.conv_factor = conv_factor;
-            self.default_conv = false;
-        }
-        else
-        {
-            println!("\n*** WARNING ***\n\
-                  For unit {}: attemtped to assign conv_factor twice. Ignoring this attempt.\n",
-                     self.unit.common_name);
-        }
-    }
-
-    pub fn set_dimensions(&mut self, dimensions: u8)
-    {
-        if self.default_dims
-        {
-            self.unit.dimensions = dimensions;
-            self.default_dims = false;
-        }
-        else
-        {
-            println!("\n*** WARNING ***\n\
-                  For unit {}: attemtped to assign dimensions twice. Ignoring this attempt.\n",
-                     self.unit.common_name);
-        }
-    }
-
-    pub fn set_inverse(&mut self, inverse: bool)
-    {
-        if self.default_inv
-        {
-            self.unit.inverse = inverse;
-            self.default_inv = false;
-        }
-        else
-        {
-            println!("\n*** WARNING ***\n\
-                  For unit {}: attemtped to assign inverse twice. Ignoring this attempt.\n",
-                     self.unit.common_name);
-        }
-    }
-
-    pub fn set_unit_type(&mut self, unit_type: &'static str)
-    {
-        if self.default_type
-        {
-            self.unit.unit_type = unit_type;
-            self.default_type = false;
-        }
-        else
-        {
-            println!("\n*** WARNING ***\n\
-                  For unit {}: attemtped to assign unit_type twice. Ignoring this attempt.\n",
-                     self.unit.common_name);
-        }
-    }
-
-    pub fn set_zero_point(&mut self, zero_point: f64)
-    {
-        if self.default_zpt
-        {
-            self.unit.zero_point = zero_point;
-            self.default_zpt = false;
-        }
-        else
-        {
-            println!("\n*** WARNING ***\n\
-                  For unit {}: attemtped to assign zero_point twice. Ignoring this attempt.\n",
-                     self.unit.common_name);
-        }
-    }
-
-    pub fn is_well_formed(&self) -> bool
-    {
-        !(self.default_name || self.default_conv || self.default_type)
-    }
-}
\ No newline at end of file
@@ -0,0 +1,1465 @@
+/* runtime/units/reader.rs
+ * ===
+ * Reads the units.cfg file into units: the syntax of its lines, the properties of a unit, and
+ * the conv_factors given in terms of other units, which are resolved into plain factors once
+ * the whole file has been read. Adding the units to a database is left to config.rs.
+ *
+ * yucon_core/build.rs compiles the stock units.cfg with this same file, included with
+ * #[path], so that the static table and a database loaded at runtime cannot disagree about
+ * what the file means. It must therefore use nothing of this crate but ::utils and the parts
+ * of yucon_core that build.rs includes too (prefix.rs and scalar.rs), and it reports warnings
+ * and errors to the caller rather than printing them.
+ *
+ * This file is part of:
+ *
+ * Yucon - General Purpose Unit Converter
+ * Copyright (C) 2016-2017  Blaine Murphy
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use std::error::Error;
+use std::fmt;
+use std::fmt::Display;
+use std::fmt::Formatter;
+use std::io::BufRead;
+use std::sync::Arc;
+use std::collections::HashMap;
+use std::num::ParseFloatError;
+
+use ::utils::*;
+use yucon_core::scalar::{Ratio, Scalar};
+
+// unit types Yucon recognizes
+// statically allocated so that we do not waste memory storing duplicate data
+pub static UNIT_TYPES: [&'static str; 12] = ["area",
+                                             "energy",
+                                             "force",
+                                             "fuel economy",
+                                             "length",
+                                             "mass",
+                                             "power",
+                                             "pressure",
+                                             "speed",
+                                             "temperature",
+                                             "torque",
+                                             "volume",];
+
+
+// tag searched first for units queried without one
+pub const PREFERRED_TAG: &'static str = "us";
+
+#[derive(Debug)]
+pub struct Unit
+{
+    pub common_name: Arc<String>,
+    pub conv_factor: f64,
+    pub dimensions: u8,
+    pub inverse: bool,
+    pub unit_type: &'static str, //life time is static because the type strings are embedded
+    pub zero_point: f64,
+    pub exact_conv: Option<Ratio>, // exact values of the decimal literals, if they fit
+    pub exact_zero: Option<Ratio>,
+    pub has_aliases: bool,
+    pub has_tags: bool,
+}
+
+impl Unit
+{
+    pub fn new() -> Unit
+    {
+        Unit {
+            common_name: Arc::new(String::new()),
+            conv_factor: 1.0,
+            dimensions: 1,
+            inverse: false,
+            unit_type: UNIT_TYPES[0],
+            zero_point: 0.0,
+            exact_conv: Some(Ratio::from_int(1)),
+            exact_zero: Some(Ratio::from_int(0)),
+            has_aliases: false,
+            has_tags: false,
+        }
+    }
+}
+
+// TODO refactor to make unit field private to ensure no initialization occurs without proper tracking
+pub struct UnitInit
+{
+    pub unit: Unit,
+    default_name: bool,
+    default_conv: bool,
+    default_dims: bool,
+    default_inv: bool,
+    default_type: bool,
+    default_zpt: bool,
+}
+
+impl UnitInit
+{
+    pub fn new() -> UnitInit
+    {
+        UnitInit
+        {
+            unit: Unit::new(),
+            default_name: true,
+            default_conv: true,
+            default_dims: true,
+            default_inv: true,
+            default_type: true,
+            default_zpt: true
+        }
+    }
+
+    pub fn set_common_name(&mut self, name: String)
+    {
+        if self.default_name
+        {
+            self.unit.common_name = Arc::new(name);
+            self.default_name = false;
+        }
+        else
+        {
+            unreachable!();
+            // the code is written such that there should never be an attempt
+            // to assign a common_name twice. encountering a new common name
+            // in config triggers a flush of the current unit and starts a new one.
+        }
+    }
+
+    pub fn set_conv_factor<F: FnMut(&str)>(&mut self, conv_factor: f64, exact: Option<Ratio>, report: &mut F)
+    {
+        if self.default_conv
+        {
+            self.unit.conv_factor = conv_factor;
+            self.unit.exact_conv = exact;
+            self.default_conv = false;
+        }
+        else
+        {
+            report(&format!("\n*** WARNING ***\n\
+                  For unit {}: attemtped to assign conv_factor twice. Ignoring this attempt.\n",
+                     self.unit.common_name));
+        }
+    }
+
+    // whether a conv_factor has been given yet
+    pub fn has_conv_factor(&self) -> bool
+    {
+        !self.default_conv
+    }
+
+    pub fn set_dimensions<F: FnMut(&str)>(&mut self, dimensions: u8, report: &mut F)
+    {
+        if self.default_dims
+        {
+            self.unit.dimensions = dimensions;
+            self.default_dims = false;
+        }
+        else
+        {
+            report(&format!("\n*** WARNING ***\n\
+                  For unit {}: attemtped to assign dimensions twice. Ignoring this attempt.\n",
+                     self.unit.common_name));
+        }
+    }
+
+    pub fn set_inverse<F: FnMut(&str)>(&mut self, inverse: bool, report: &mut F)
+    {
+        if self.default_inv
+        {
+            self.unit.inverse = inverse;
+            self.default_inv = false;
+        }
+        else
+        {
+            report(&format!("\n*** WARNING ***\n\
+                  For unit {}: attemtped to assign inverse twice. Ignoring this attempt.\n",
+                     self.unit.common_name));
+        }
+    }
+
+    pub fn set_unit_type<F: FnMut(&str)>(&mut self, unit_type: &'static str, report: &mut F)
+    {
+        if self.default_type
+        {
+            self.unit.unit_type = unit_type;
+            self.default_type = false;
+        }
+        else
+        {
+            report(&format!("\n*** WARNING ***\n\
+                  For unit {}: attemtped to assign unit_type twice. Ignoring this attempt.\n",
+                     self.unit.common_name));
+        }
+    }
+
+    pub fn set_zero_point<F: FnMut(&str)>(&mut self, zero_point: f64, exact: Option<Ratio>, report: &mut F)
+    {
+        if self.default_zpt
+        {
+            self.unit.zero_point = zero_point;
+            self.unit.exact_zero = exact;
+            self.default_zpt = false;
+        }
+        else
+        {
+            report(&format!("\n*** WARNING ***\n\
+                  For unit {}: attemtped to assign zero_point twice. Ignoring this attempt.\n",
+                     self.unit.common_name));
+        }
+    }
+
+    pub fn is_well_formed(&self) -> bool
+    {
+        !(self.default_name || self.default_conv || self.default_type)
+    }
+}
+
+/* enum ParsePropertyError
+ *
+ * Description: ParsePropertyError is an error sum type for use when parsing
+ *   the units.cfg file. The errors it encompasses are:
+ *
+ *     - SyntaxError: returned when a line violates syntax rules. (see syntax
+ *         rules for units.cfg)
+ *
+ *     - NoSuchProperty: returned when the key in a key-value pair does not
+ *         match any known unit properties
+ *
+ *     - NoSuchType: returned when type requested by the user (eg "length") is
+ *         not recognized
+ *
+ *     - EmptyField: returned when the value in a key value pair is empty.
+ *         Technically this a subset of SyntaxError but it is difficult to
+ *         determine during tonization and much easier to detect during sematic
+ *         analysis.
+ *
+ *     - InvalidField: returned when the value in a key value pair was not a
+ *         (legal) number as expected
+ *
+ * Usage:
+ *   SyntaxError(usize, String):
+ *     - usize  : column number at which syntax error occurred.
+ *     - String : message describing the violation.
+ *
+ *   NoSuchProperty(String):
+ *     - String : the unrecognized key
+ *
+ *   NoSuchType(String):
+ *     - String : the unrecognized type
+ *
+ *   EmptyField(String):
+ *     - String : the property that which recieved a blank field
+ *
+ *   InvalidField(std::num::ParseFloatError):
+ *     - std::num::ParseFloatError : the underlying error from attempting to
+ *                 parse a line as a number
+ */
+#[derive(Debug)]
+enum ParsePropertyError
+{
+    SyntaxError(SyntaxError),
+    NoSuchProperty(String),
+    NoSuchType    (String),
+    EmptyField    (String),
+    InvalidField  (ParseFloatError),
+}
+
+impl Error for ParsePropertyError
+{
+    fn description(&self) -> &str
+    {
+        match *self
+        {
+        ParsePropertyError::SyntaxError(ref err)    => err.description(),
+        ParsePropertyError::NoSuchProperty(_) => "no such unit property exists",
+        ParsePropertyError::NoSuchType(_)     => "no such unit type is recognized by Yucon",
+        ParsePropertyError::EmptyField(_)     => "expected value(s) after delimiters \'=\' and \'[\'",
+        ParsePropertyError::InvalidField(ref err)   => err.description(),
+        }
+    }
+
+    fn cause(&self) -> Option<&Error>
+    {
+        match *self
+        {
+        ParsePropertyError::InvalidField(ref err) => Some( err ),
+        _ => None,
+        }
+    }
+}
+
+impl Display for ParsePropertyError
+{
+    fn fmt( &self, f: &mut Formatter ) -> fmt::Result
+    {
+        match *self
+        {
+        ParsePropertyError::SyntaxError(ref err)       => write!(f, "{}", err),
+        ParsePropertyError::InvalidField(ref err )     => write!(f, "bad field value: {}", err.description() ),
+        ParsePropertyError::EmptyField(ref prop )      => write!(f, "for property \'{}\': {}", prop, self.description() ),
+        ParsePropertyError::NoSuchType(ref unit_type ) => write!(f, "at token \'{}\': {}", unit_type, self.description() ),
+        ParsePropertyError::NoSuchProperty(ref prop )  => write!(f, "at token \'{}\': {}", prop, self.description() ),
+        }
+    }
+}
+
+impl From<ParseFloatError> for ParsePropertyError
+{
+    fn from(err: ParseFloatError) -> ParsePropertyError
+    {
+        ParsePropertyError::InvalidField( err )
+    }
+}
+
+impl From<SyntaxError> for ParsePropertyError
+{
+    fn from(err: SyntaxError) -> ParsePropertyError
+    {
+        ParsePropertyError::SyntaxError(err)
+    }
+}
+// END ParsePropertyError
+
+/* enum UnitProperty
+ *
+ * Description: sum type for describing the properties of units. used to make
+ *   conveniently representable as computer-friendly object code, allowing
+ *   easy analysis and return values for functions. See Yucon docs for more
+ *   details on unit properties. Properties encompassed:
+ *
+ *     - CommonName: the units common name denoted in []
+ *
+ *     - UnitType: the unit's type eg. length, volume, etc
+ *
+ *     - ConvFactor: the unit's value in the base unit used for conversion
+ *
+ *     - ConvRef: the unit's value as a multiple of another unit
+ *
+ *     - Aliases: the unit's aliases and/or abreviations
+ *
+ *     - ZeroPoint: the unit's zero point if 0 units != 0 base units
+ *
+ *     - Dimensions: the unit's dimensions. eg meter has 1 but square meter has 2
+ *
+ *     - Inverse: if the unit is inverse of base unit eg. mpg and L/100km
+ */
+#[derive(Debug)]
+enum UnitProperty
+{
+    CommonName (String),
+    UnitType   (&'static str),
+    ConvFactor (f64, Option<Ratio>),
+    ConvRef    (ConvRef),
+    Aliases    (Vec<Arc<String>>),
+    Tags       (Vec<Arc<String>>),
+    ZeroPoint  (f64, Option<Ratio>),
+    Dimensions (u8),
+    Inverse    (bool),
+}
+
+/* struct ConvRef
+ *
+ * Description: a conv_factor given as a multiple of another unit, eg
+ *   'conv_factor = 660 ft' or 'conv_factor = 1/12 foot'. Units defined this
+ *   way are held back until the whole file has been read and then resolved
+ *   into plain factors. See fn resolve_refs.
+ */
+#[derive(Debug)]
+struct ConvRef
+{
+    num: f64,
+    den: f64,
+    exact: Option<Ratio>, // num / den exactly, if it fits
+    unit: String,
+}
+
+/* enum PropCheckState
+ *
+ * Description: Sum type for the states of the UnitPropertyCheck syntax. Used
+ *   instead of numeric constants to make each state strictly separate via
+ *   Rust's type system and avoid programmer error of overlapping constants.
+ *     - OpenBrace  : expecting [
+ *     - CloseBrace : expecting ]
+ *     - Equals     : expecting =
+ *     - Comma      : expecting ,
+ *     - Key        : expecting first token of line
+ *     - CommonName : expecting token between []
+ *     - Value      : expecting token(s) after =
+ *     - Validate   : expecting only trailing whitespace or comments
+ */
+#[derive(Debug)]
+enum PropCheckState
+{
+    OpenBrace,
+    CloseBrace,
+    Equals,
+    Comma,
+    Key,
+    CommonName,
+    Value,
+    Validate,
+}
+
+/* struct UnitPropertyCheck
+ *
+ * Description: UnitPropertyCheck is the syntax for the units.cfg file. See
+ *   above for exact details on unit declaration syntax.
+ *
+ * Fields:
+ *   - line    : the line currently be analyzed. carried for debug purposes
+ *   - esc_set : tracks whether the next character during tokenization will
+ *               escaped or not. true if it will be, false otherwise.
+ *   - single_val_field : tracks whether a key value pair expects exactly one
+ *               value or can recieve a list. true if it expects exactly
+ *               one, false otherwise. NOTE: only "aliases" can have a list
+ *   - state   : tracks what to expect next. eg [, key, value, etc
+ *   - valid   : tracks whether the syntax was vioalted at any point. true if
+ *               it is valid syntax, false otherwise.
+ */
+#[derive(Debug)]
+struct UnitPropertyCheck<'a>
+{
+    line: &'a str,
+    esc_set: bool,
+    single_val_field: bool,
+    state: PropCheckState,
+    valid: bool,
+}
+
+impl<'a> UnitPropertyCheck<'a>
+{
+    /* Creates and returns new syntax checker for the given line.
+     *
+     * Parameters:
+     *   - from_line : line of text to be checked
+     */
+    fn new(from_line: &'a str) -> UnitPropertyCheck
+    {
+        UnitPropertyCheck { line:    from_line,
+                            single_val_field: false,
+                            esc_set: false,
+                            state:   PropCheckState::Key,
+                            valid:   true }
+    }
+
+    /* Checks if the given delimiter was expected. Returns Ok(true) if it was
+     * or a SyntaxError if it was not. Conceptually just a finite state machine.
+     *
+     * Parameters:
+     *   - token : token to be checked. token is assumed to be a delimiter
+     *   - index : line index where tokenization left off
+     */
+    fn check_delim(&mut self, token: &str, index: usize) -> bool
+    {
+        match self.state
+        {
+        PropCheckState::OpenBrace => {
+            if token == "["
+            {
+                self.state = PropCheckState::CommonName;
+            }
+            else
+            {
+                self.valid = false;
+                return false;
+            }
+        },
+        PropCheckState::CloseBrace => {
+            if token == "]"
+            {
+                self.state = PropCheckState::Validate;
+            }
+            else
+            {
+                self.valid = false;
+                return false;
+            }
+        },
+        PropCheckState::Equals => {
+            if token == "="
+            {
+                self.state = PropCheckState::Value;
+            }
+            else
+            {
+                self.valid = false;
+                return false;
+            }
+        },
+        PropCheckState::Comma => {
+            if token == ","
+            {
+                self.state = PropCheckState::Value;
+            }
+            else
+            {
+                self.valid = false;
+                return false;
+            }
+        },
+        PropCheckState::Validate => {
+            self.valid = false;
+            return false;
+        },
+        _ => {
+            println!("FATAL PARSE ERROR!\n\
+                      In line {:?}\n\
+                      At index {}\n\
+                      Syntax state: {:?}\n\
+                      This error should never occur. Please report!",
+                      self.line,
+                      index,
+                      self);
+            panic!("syntax check reached impossible state");
+        }
+        };
+
+        true
+    }
+
+    /* Checks if the given token was expected. Returns Ok(true) if it was
+     * or a SyntaxError if it was not. Conceptually just a finite state machine.
+     *
+     * Parameters:
+     *   - token : token to be checked. token is assumed to not be a delimiter
+     *   - index : line index where tokenization left off
+     */
+    fn check_normal(&mut self, token: &str, index: usize) -> bool
+    {
+        match self.state
+        {
+        PropCheckState::Key => {
+            if token.trim().is_empty()
+            {
+                self.state = PropCheckState::OpenBrace;
+            }
+            else if token.trim() == "aliases" || token.trim() == "tags"
+            {
+                self.state = PropCheckState::Equals;
+            }
+            else
+            {
+                self.state = PropCheckState::Equals;
+                self.single_val_field = true;
+            }
+        },
+        PropCheckState::Value => {
+            if self.single_val_field
+            {
+                self.state = PropCheckState::Validate;
+            }
+            else
+            {
+                self.state = PropCheckState::Comma;
+            }
+        },
+        PropCheckState::CommonName => {
+            self.state = PropCheckState::CloseBrace;
+        },
+        PropCheckState::Validate => {
+            if !token.trim().is_empty()
+            {
+                self.valid = false;
+                return false;
+            }
+        },
+        _ => {
+            println!("FATAL PARSE ERROR!\n\
+                      In line {:?}\n\
+                      At index {}\n\
+                      Syntax state: {:?}\n\
+                      This error should never occur. Please report!",
+                      self.line,
+                      index,
+                      self);
+            panic!("syntax check reached impossible state");
+        },
+        };
+
+        true
+    }
+}
+
+// See SyntaxChecker trait summary of the methods below
+impl<'a> SyntaxChecker for UnitPropertyCheck<'a>
+{
+    fn feed_token(&mut self, token: &str, delim: bool, index: usize) -> bool
+    {
+        if delim
+        {
+            return self.check_delim(token, index);
+        }
+        else
+        {
+            self.check_normal(token, index)
+        }
+    }
+
+    fn assert_valid(&self, index: usize, more_tokens: bool) -> Result<(), SyntaxError>
+    {
+        // the following states are both invalid exit states and possible error states
+        if !more_tokens || !self.valid
+        {
+            match self.state
+            {
+            PropCheckState::CloseBrace => {
+                return Err(SyntaxError::Expected(index, "\']\'".to_string()));
+            },
+            PropCheckState::Equals => {
+                return Err(SyntaxError::Expected(index, "\'=\'".to_string()));
+            },
+            PropCheckState::CommonName => {
+                return Err(SyntaxError::Expected(index, "token after \'[\'".to_string()));
+            },
+            _ => (), // all others may not meet criteria. do nothing
+            };
+        }
+
+        // the following are valid exit states but may still be error states
+        if !self.valid
+        {
+            match self.state
+            {
+            PropCheckState::OpenBrace => {
+                return Err(SyntaxError::Expected(index, "\'[\'".to_string()));
+            },
+            PropCheckState::Comma => {
+                return Err(SyntaxError::Expected(index, "\',\'".to_string()));
+            },
+            PropCheckState::Validate => {
+                return Err(SyntaxError::Expected(index, "whitespace or comment".to_string()));
+            },
+            _ => (), // Key and Value states are always okay to exit on. Just do nothing
+            };
+        }
+
+        Ok(())
+    }
+
+    fn is_esc(&self, ch: char) -> bool
+    {
+        ch == '\\'
+    }
+
+    fn is_comment(&self, ch: char) -> bool
+    {
+        ch == '#'
+    }
+
+    fn is_delim(&self, ch: char) -> bool
+    {
+        ch == '[' ||
+        ch == ']' ||
+        ch == ',' ||
+        ch == '='
+    }
+
+    fn is_preserved_delim(&self, ch: char) -> bool
+    {
+        false
+    }
+
+    fn esc_char(&self) -> char
+    {
+        '\\'
+    }
+
+    fn valid(&self) -> bool
+    {
+        self.valid
+    }
+
+    fn esc_set(&self) -> bool
+    {
+        self.esc_set
+    }
+
+    fn set_esc(&mut self, set: bool)
+    {
+        self.esc_set = set;
+    }
+
+    fn reset(&mut self)
+    {
+        self.valid = true;
+        self.state = PropCheckState::Key;
+        self.esc_set = false;
+    }
+    fn special_bytes(&self) -> Option<&'static [u8]>
+    {
+        Some(b"[],=#")
+    }
+}
+
+/* Returns the reference to the matching statically allocated unit type string
+ * or returns error if that type is not recognized. Helper function for
+ * fn parse_key_value to separate out the search code and avoid code blob.
+ *
+ * Paramemters:
+ *   - requested_type : type denoted in a "type =" unit property
+ */
+fn get_unit_type(requested_type: String) -> Result<&'static str, ParsePropertyError>
+{
+    { // scope to avoid borrow problem when handing string to NoSuchType error
+    let user_type = requested_type.as_str();
+
+    for unit_type in UNIT_TYPES.iter()
+    {
+        if *unit_type == user_type
+        {
+            return Ok(*unit_type);
+        }
+    }
+    } // end borrow scope
+
+    Err(ParsePropertyError::NoSuchType(requested_type))
+}
+
+/* Parses value part of a key-value pair as a number. Helper function for
+ * fn parse_key_value to avoid duplicate code. Returns (bool, f64) tuple
+ * if the field was empty or a valid number, InvalidField error otherwise.
+ * The bool part of the return is false if the field was not empty / valid
+ * and true if it was empty (Option::None). Helper function for
+ * fn parse_key_value to avoid duplicated code for numeric key-value pairs.
+ *
+ * Parameters:
+ *   - field : token retrieved directly from an iterator and thus is Option
+ */
+fn field_as_num(field: Option<TokenType>) -> Result<(bool, f64), ParsePropertyError>
+{
+    let token = match field
+    {
+        None      => return Ok((true, ::std::f64::NAN)),
+        Some(val) => val,
+    };
+
+    let value = try!(token.unwrap().parse::<f64>());
+
+    Ok((false, value))
+}
+
+/* As fn field_as_num, also parsing the field's decimal literal exactly for
+ * integer conversions. The exact value is None if it does not fit.
+ */
+fn field_as_exact(field: Option<TokenType>) -> Result<(bool, f64, Option<Ratio>), ParsePropertyError>
+{
+    let token = match field
+    {
+        None      => return Ok((true, ::std::f64::NAN, None)),
+        Some(val) => val.unwrap(),
+    };
+
+    let value = try!(token.parse::<f64>());
+
+    Ok((false, value, Ratio::from_decimal(&token)))
+}
+
+/* Parses the multiple of a unit in a conv_factor, a decimal or a fraction of
+ * two decimals, eg '660' or '1/12'. Returns its numerator, denominator, and
+ * exact value, or None if it is not a multiple.
+ */
+fn parse_multiple(text: &str) -> Option<(f64, f64, Option<Ratio>)>
+{
+    let mut parts = text.splitn(2, '/');
+    let num_text = parts.next().unwrap();
+    let den_text = parts.next().unwrap_or("1");
+
+    let num = num_text.trim().parse::<f64>().ok()?;
+    let den = den_text.trim().parse::<f64>().ok()?;
+
+    if den == 0.0
+    {
+        return None;
+    }
+
+    let exact = match (Ratio::from_decimal(num_text), Ratio::from_decimal(den_text))
+    {
+    (Some(num), Some(den)) => num.div(den),
+    _ => None,
+    };
+
+    Some((num, den, exact))
+}
+
+/* As fn field_as_exact for the conv_factor property, which may also be given
+ * in terms of another unit: an optional multiple of it followed by its name.
+ * A fraction alone is a plain factor. Anything else is taken as the name of a
+ * unit, which is looked up once the whole file has been read.
+ */
+fn field_as_conv(field: Option<TokenType>) -> Result<(bool, UnitProperty), ParsePropertyError>
+{
+    let token = match field
+    {
+        None      => return Ok((true, UnitProperty::ConvFactor(::std::f64::NAN, None))),
+        Some(val) => val.unwrap(),
+    };
+
+    if let Ok(value) = token.parse::<f64>()
+    {
+        return Ok((false, UnitProperty::ConvFactor(value, Ratio::from_decimal(&token))));
+    }
+
+    let (multiple, unit) = match token.find(char::is_whitespace)
+    {
+        Some(at) => (&token[..at], token[at..].trim()),
+        None     => (&token[..], ""),
+    };
+
+    let conv_ref = match parse_multiple(multiple)
+    {
+        Some((num, den, exact)) => {
+            if unit.is_empty()
+            {
+                let value = match exact { Some(ratio) => ratio.to_f64(), None => num / den };
+                return Ok((false, UnitProperty::ConvFactor(value, exact)));
+            }
+
+            ConvRef { num: num, den: den, exact: exact, unit: unit.to_string() }
+        },
+        None => ConvRef { num: 1.0, den: 1.0, exact: Some(Ratio::from_int(1)), unit: token.clone() },
+    };
+
+    Ok((false, UnitProperty::ConvRef(conv_ref)))
+}
+
+/* Parses a key-value unit property. Returns the associated unit property if it
+ * is a valid pair or error if:
+ *   - the key is not a recognized property
+ *   - the value is missing
+ *   - type mismatch for the value
+ * Helper function for fn parse_line to separate out the semantic analysis and
+ * avoid a code glut.
+ *
+ * Parameters:
+ *   - tokens : vector of tokens to be parsed. blank tokens expected to be
+ *              filtered and syntax expected to have already been validated
+ */
+fn parse_key_value<F: FnMut(&str)>(mut tokens: Vec<TokenType>, report: &mut F) -> Result<UnitProperty, ParsePropertyError>
+{
+    let mut tokens_iter = tokens.drain(..);
+    let mut field_empty = true;
+    let key = tokens_iter.next().unwrap().unwrap();
+
+    let unit_property = match key.as_str()
+    {
+    "aliases" => {
+        let mut aliases = Vec::new();
+
+        for token in tokens_iter
+        {
+            match token
+            {
+            TokenType::Normal(tok) => {
+                aliases.push(Arc::new(tok));
+                field_empty = false;
+            }
+            _ => (),
+            };
+        }
+
+        UnitProperty::Aliases(aliases)
+    },
+    "tags" => {
+        let mut tags = Vec::new();
+
+        for token in tokens_iter
+        {
+            match token
+            {
+                TokenType::Normal(tok) => {
+                    tags.push(Arc::new(tok));
+                    field_empty = false;
+                }
+                _ => (),
+            };
+        }
+
+        UnitProperty::Tags(tags)
+    },
+    "conv_factor" => {
+        tokens_iter.next();
+        let (empty, conv_factor) = try!(field_as_conv(tokens_iter.next()));
+        field_empty = empty;
+        conv_factor
+    },
+    "dimensions" => {
+        tokens_iter.next();
+        let (empty, reqested_dims) = try!(field_as_num(tokens_iter.next()));
+        field_empty = empty;
+        let dims: u8 = if reqested_dims <= u8::max_value() as f64
+        {
+            reqested_dims as u8
+        }
+        else
+        {
+            // @TODO Change this a formal error as the default is already 1.
+            report(&format!("\n*** WARNING ***\n\
+                             Requested {} dimensions for a unit. \
+                             Yucon allows at most 255. Using default (1).",
+                             reqested_dims));
+            1
+        };
+        UnitProperty::Dimensions(dims)
+    },
+    "inverse" => {
+        tokens_iter.next();
+        let (empty, value) = try!(field_as_num(tokens_iter.next()));
+        field_empty = empty;
+        let inverse = if value == 0.0
+        {
+            false
+        }
+        else
+        {
+            true
+        };
+        UnitProperty::Inverse(inverse)
+    }
+    "type" => {
+        tokens_iter.next();
+
+        let unit_type = match tokens_iter.next()
+        {
+            None      => UNIT_TYPES[0], // technically an error but this will be caught later by the empty field check
+            Some(val) => {
+                field_empty = false;
+                try!(get_unit_type(val.unwrap()))
+            },
+        };
+
+        UnitProperty::UnitType(unit_type)
+    },
+    "zero_point" => {
+        tokens_iter.next();
+        let (empty, zero_point, exact) = try!(field_as_exact(tokens_iter.next()));
+        field_empty = empty;
+        UnitProperty::ZeroPoint(zero_point, exact)
+    },
+    _ => return Err(ParsePropertyError::NoSuchProperty(key)),
+    };
+
+    if field_empty
+    {
+        return Err(ParsePropertyError::EmptyField(key));
+    }
+
+    Ok(unit_property)
+}
+
+/* Parses the common name unit property. Returns the common name if it exists.
+ * wrapped in a UnitProperty. Returns EmptyField if the common name is not given
+ * Helper function for fn parse_line to separate out semantic analysis and avoid
+ * a code glut.
+ *
+ * Parameters:
+ *   - tokens : vector of TokenType wrapped tokens. this vector is expected to
+ *              have empty tokens filtered out and to have common name syntax
+ *              already validated
+ */
+fn parse_common_name(mut tokens: Vec<TokenType>) -> Result<UnitProperty, ParsePropertyError>
+{
+    // after filtering, the common name field should have exactly 3 tokens
+    // '[', 'name', ']' less or more and we have a problem
+    if tokens.len() != 3
+    {
+        return Err(ParsePropertyError::EmptyField("common name".to_string()));
+    }
+
+    let mut tokens_iter = tokens.drain(..);
+    tokens_iter.next();
+    let common_name = tokens_iter.next().unwrap().unwrap();
+
+    Ok(UnitProperty::CommonName(common_name))
+}
+
+/* Parses a line from the units.cfg file and returns the unit property described
+ * if any as program internal object code. Seeing as lines may be purely
+ * whitespace or comments, Option<UnitProperty> is returned instead of
+ * UnitProperty directly. Returns an appropriate error for malformed lines that
+ * violate syntax or sematics.
+ *
+ * Valid unit properties are as follows:
+ *   - Common Name        : "[name]"
+ *   - Aliases            : "aliases = alt1, alt2, alt3"
+ *   - Type               : "type = <unit type>"
+ *   - Converseion Factor : "conv_factor = 1.2345" or "conv_factor = 660 ft"
+ *   - Dimensions         : "dimensions = 3"
+ *   - Inverse            : "inverse = 1"
+ *   - Zero Point         : "zero_point = 1.234e5"
+ *
+ * These are only basic examples. See "doc/UnitsCFG_Explained.md" for
+ * full units.cfg syntax and semantics specification .
+ *
+ * Parameters:
+ *   - line   : line of input to parse
+ *   - report : receives any warnings
+ */
+fn parse_line<F: FnMut(&str)>(line: &str, report: &mut F) -> Result<Option<UnitProperty>, ParsePropertyError>
+{
+    trace_span!("parse_line");
+    let mut syntax_check = UnitPropertyCheck::new(line);
+    let mut raw_tokens = try!(tokenize(line, &mut syntax_check));
+    let mut tokens: Vec<TokenType> = Vec::with_capacity(raw_tokens.len());
+
+    for raw_tok in raw_tokens.drain(..)
+    {
+        let new_tok = match raw_tok
+        {
+        TokenType::Delim(tok) => {
+            TokenType::Delim(tok.trim().to_string())
+        },
+        TokenType::Normal(tok) => {
+            TokenType::Normal(tok.trim().to_string())
+        },
+        };
+
+        if new_tok.is_empty()
+        {
+            continue;
+        }
+
+        tokens.push(new_tok);
+    }
+
+    // if line was whitespace or comment
+    // fn tokenize ensures at least one empty token for blank or comment lines
+    if tokens.len() == 0 // tokens.len() == 1 && tokens[0].is_empty()
+    {
+        return Ok(None);
+    }
+
+    // tokens.retain(|tok| !tok.is_empty());
+    let mut common_name = true;
+
+    match tokens[0]
+    {
+    TokenType::Delim(ref tok) => {
+        if tok != "["
+        {
+            println!("FATAL PARSE ERROR!\n\
+                      In line {:?},\n\
+                      tokenized as {:?}\n\
+                      This error should never occur. Please report!",
+                      line,
+                      tokens);
+            panic!("illegal delimiter begins line after syntax verification");
+        }
+    },
+    TokenType::Normal(_) => common_name = false,
+    };
+
+    let unit_property = if common_name
+    {
+        try!(parse_common_name(tokens))
+    }
+    else
+    {
+        try!(parse_key_value(tokens, report))
+    };
+
+    Ok(Some(unit_property))
+}
+
+/* struct PendingUnit
+ *
+ * Description: a unit read from units.cfg, held with its names until the
+ *   whole file has been read. conv_ref is set if its conv_factor refers to
+ *   another unit, until it has been resolved.
+ */
+pub struct PendingUnit
+{
+    pub init: UnitInit,
+    pub aliases: Vec<Arc<String>>,
+    pub tags: Vec<Arc<String>>,
+    conv_ref: Option<ConvRef>,
+}
+
+// progress resolving a held back unit. see fn resolve_ref
+#[derive(Clone, Copy)]
+enum RefState
+{
+    Unvisited,
+    Visiting,
+    Resolved(f64, Option<Ratio>),
+    Failed,
+}
+
+/* Holds back a unit until every unit has been read, since a conv_factor may
+ * refer to a unit further down the file. See fn resolve_refs.
+ */
+fn hold_unit(pending: &mut Vec<PendingUnit>, new_unit: UnitInit,
+             aliases: &Vec<Arc<String>>, tags: &Vec<Arc<String>>, conv_ref: Option<ConvRef>)
+{
+    // a unit missing properties is reported when it is added. it may not be referred to
+    let conv_ref = if new_unit.is_well_formed() { conv_ref } else { None };
+
+    pending.push(PendingUnit {
+        init: new_unit,
+        aliases: aliases.clone(),
+        tags: tags.clone(),
+        conv_ref: conv_ref,
+    });
+}
+
+/* Resolves the conv_factors of the units held back by fn hold_unit that refer
+ * to other units into plain factors, so conversions never see the references,
+ * and returns every unit in the order they were read. The references form a
+ * graph which is evaluated depth first, each factor being computed once from
+ * the factor of the unit it refers to.
+ *
+ * A unit is left out, with an error, if it refers to a unit which does not
+ * exist, is of another type, or was left out itself, or if its references
+ * lead back around to it.
+ */
+fn resolve_refs<F: FnMut(&str)>(mut pending: Vec<PendingUnit>, report: &mut F) -> Vec<PendingUnit>
+{
+    let mut names: HashMap<String, Vec<usize>> = HashMap::new();
+
+    for (index, unit) in pending.iter().enumerate()
+    {
+        if !unit.init.is_well_formed()
+        {
+            continue;
+        }
+
+        for name in Some(&unit.init.unit.common_name).into_iter().chain(unit.aliases.iter())
+        {
+            let units = names.entry((**name).clone()).or_insert_with(Vec::new);
+
+            if units.last() != Some(&index)
+            {
+                units.push(index);
+            }
+        }
+    }
+
+    let mut states: Vec<RefState> = pending.iter()
+        .map(|unit| match unit.conv_ref
+        {
+        Some(..) => RefState::Unvisited,
+        None => RefState::Resolved(unit.init.unit.conv_factor, unit.init.unit.exact_conv),
+        })
+        .collect();
+    let mut path = Vec::new();
+
+    for index in 0..pending.len()
+    {
+        resolve_ref(index, &pending, &names, &mut states, &mut path, report);
+    }
+
+    let mut units = Vec::with_capacity(pending.len());
+
+    for (mut unit, state) in pending.drain(..).zip(states.into_iter())
+    {
+        if unit.conv_ref.is_none()
+        {
+            units.push(unit);
+        }
+        else if let RefState::Resolved(conv_factor, exact) = state
+        {
+            unit.init.unit.conv_factor = conv_factor;
+            unit.init.unit.exact_conv = exact;
+            unit.conv_ref = None;
+            units.push(unit);
+        }
+    }
+
+    units
+}
+
+/* The unit a name in a conv_factor refers to, searched for as fn
+ * UnitDatabase::query would find it once the units are added: in the
+ * preferred tag, then untagged, then in the other tags in alphabetical
+ * order, the first in the file within each.
+ */
+fn find_ref(name: &str, pending: &[PendingUnit], names: &HashMap<String, Vec<usize>>) -> Option<usize>
+{
+    let rank = |index: usize| {
+        let unit = &pending[index];
+        let tagged = |name: &str| unit.init.unit.has_tags && unit.tags.iter().any(|tag| tag.as_str() == name);
+
+        if tagged(PREFERRED_TAG)
+        {
+            (0, None)
+        }
+        else if !unit.init.unit.has_tags || tagged("default")
+        {
+            (1, None)
+        }
+        else
+        {
+            (2, unit.tags.iter().min().map(|tag| tag.as_str()))
+        }
+    };
+
+    match names.get(name)
+    {
+    Some(units) => units.iter().cloned().min_by_key(|&index| (rank(index), index)),
+    None => None,
+    }
+}
+
+/* Resolves the conv_factor of one held back unit, first resolving the unit it
+ * refers to if that is held back too. 'path' holds the units being resolved
+ * further up, so a unit met again while it is on the path closes a cycle.
+ */
+fn resolve_ref<F: FnMut(&str)>(index: usize, pending: &[PendingUnit], names: &HashMap<String, Vec<usize>>,
+                               states: &mut Vec<RefState>, path: &mut Vec<usize>, report: &mut F)
+                               -> Option<(f64, Option<Ratio>)>
+{
+    match states[index]
+    {
+    RefState::Resolved(conv_factor, exact) => return Some((conv_factor, exact)),
+    RefState::Failed => return None,
+    RefState::Visiting => {
+        let start = path.iter().position(|&at| at == index).unwrap();
+        let mut cycle = String::new();
+
+        for &at in path[start..].iter()
+        {
+            cycle.push_str(&pending[at].init.unit.common_name);
+            cycle.push_str(" -> ");
+            states[at] = RefState::Failed;
+        }
+        cycle.push_str(&pending[index].init.unit.common_name);
+
+        report(&format!("\n*** ERROR ***\n\
+                  Failed to add units {}: their conv_factors refer to each other in a cycle.\n",
+                  cycle));
+        return None;
+    },
+    RefState::Unvisited => {},
+    };
+
+    let unit = &pending[index].init.unit;
+    let conv_ref = pending[index].conv_ref.as_ref().unwrap(); // units without one start out resolved
+    states[index] = RefState::Visiting;
+    path.push(index);
+
+    // the unit referred to: its type, whether it is inverse, and its factors
+    let target = if let Some(target) = find_ref(&conv_ref.unit, pending, names)
+    {
+        let resolved = resolve_ref(target, pending, names, states, path, report);
+        let target_unit = &pending[target].init.unit;
+        resolved.map(|(conv_factor, exact)| (target_unit.unit_type, target_unit.inverse, conv_factor, exact))
+    }
+    else
+    {
+        report(&format!("\n*** ERROR ***\n\
+                  Failed to add unit {}: conv_factor refers to unknown unit \'{}\'.\n",
+                  unit.common_name, conv_ref.unit));
+        None
+    };
+
+    path.pop();
+
+    let result = match target
+    {
+    Some((unit_type, inverse, conv_factor, exact)) => {
+        if unit_type != unit.unit_type || inverse != unit.inverse
+        {
+            report(&format!("\n*** ERROR ***\n\
+                      Failed to add unit {}: conv_factor refers to unit \'{}\' of another type.\n",
+                      unit.common_name, conv_ref.unit));
+            None
+        }
+        else
+        {
+            let exact = match (conv_ref.exact, exact)
+            {
+            (Some(multiple), Some(exact)) => multiple.mul(exact),
+            _ => None,
+            };
+            let conv_factor = match exact
+            {
+            Some(exact) => exact.to_f64(),
+            None => conv_factor * conv_ref.num / conv_ref.den,
+            };
+
+            Some((conv_factor, exact))
+        }
+    },
+    None => {
+        // a unit on a cycle has already been reported with it
+        if let RefState::Visiting = states[index]
+        {
+            if names.contains_key(&conv_ref.unit)
+            {
+                report(&format!("\n*** ERROR ***\n\
+                          Failed to add unit {}: conv_factor refers to unit \'{}\' which was left out.\n",
+                          unit.common_name, conv_ref.unit));
+            }
+        }
+        None
+    },
+    };
+
+    states[index] = match result
+    {
+    Some((conv_factor, exact)) => RefState::Resolved(conv_factor, exact),
+    None => RefState::Failed,
+    };
+
+    result
+}
+
+/* Reads the units of a units.cfg file in the order they are given, with every
+ * conv_factor given in terms of another unit resolved. Units missing mandatory
+ * properties are returned too, for the caller to report when adding them.
+ * Warnings and errors in the file are given to 'report' as they are found.
+ */
+pub fn read_units<R: BufRead, F: FnMut(&str)>(mut units_cfg: R, report: &mut F) -> Vec<PendingUnit>
+{
+    let mut line = String::with_capacity(80); // standard terminal width. all lines in stock units.cfg will fit in this.
+    let mut line_num = -1;
+    let mut first_unit = true;
+
+    let mut new_unit = UnitInit::new();
+    let mut aliases: Vec<Arc<String>> = Vec::new();
+    let mut tags: Vec<Arc<String>> = Vec::new();
+    let mut conv_ref: Option<ConvRef> = None;
+    let mut pending: Vec<PendingUnit> = Vec::new();
+
+    while units_cfg.read_line(&mut line).unwrap() > 0
+    {
+        line_num += 1;
+
+        match parse_line(&line, report)
+        {
+        Ok(wrapper) => {
+            if let Some(prop) = wrapper
+            {
+                match prop
+                {
+                UnitProperty::CommonName(name) => {
+                    if first_unit
+                    {
+                        new_unit.set_common_name(name);
+                        first_unit = false;
+                    }
+                    else
+                    {
+                        hold_unit(&mut pending, new_unit, &aliases, &tags, conv_ref.take());
+                        new_unit = UnitInit::new();
+                        new_unit.set_common_name(name);
+                        aliases = Vec::new();
+                        tags = Vec::new();
+                    }
+                },
+                UnitProperty::Aliases(other_names) => {
+                    if new_unit.unit.has_aliases
+                    {
+                        report(&format!("\n*** WARNING ***\n\
+                                         For unit {}: attempted to assign aliases twice. Ignoring this attempt.\n",
+                                         new_unit.unit.common_name));
+                    }
+                    else
+                    {
+                        new_unit.unit.has_aliases = true;
+                        aliases = other_names;
+                    }
+                },
+                UnitProperty::Tags(tags_) => {
+                    if new_unit.unit.has_tags
+                    {
+                        report(&format!("\n*** WARNING ***\n\
+                                         For unit {}: attempted to assign tags twice. Ignoring this attempt.\n",
+                                         new_unit.unit.common_name));
+                    }
+                    else
+                    {
+                        new_unit.unit.has_tags = true;
+                        tags = tags_;
+                    }
+                },
+                UnitProperty::UnitType(unit_type)     => new_unit.set_unit_type(unit_type, report),
+                UnitProperty::ConvFactor(conv_factor, exact) => new_unit.set_conv_factor(conv_factor, exact, report),
+                UnitProperty::ConvRef(reference) => {
+                    if !new_unit.has_conv_factor()
+                    {
+                        conv_ref = Some(reference);
+                    }
+                    new_unit.set_conv_factor(::std::f64::NAN, None, report); // the factor is filled in by fn resolve_refs
+                },
+                UnitProperty::ZeroPoint(zero_point, exact)   => new_unit.set_zero_point(zero_point, exact, report),
+                UnitProperty::Dimensions(dimensions)  => new_unit.set_dimensions(dimensions, report),
+                UnitProperty::Inverse(inverse)        => new_unit.set_inverse(inverse, report),
+                };
+            };
+        },
+        Err(err) => {
+            report(&format!("\n*** ERROR ***\n\
+                             In line {}: \"{}\": \
+                             {}\n", line_num, line.trim_right(), err));
+        },
+        };
+
+        line.clear();
+    }
+
+    // units added when a new section begins
+    // last unit in file will not be added without this
+    hold_unit(&mut pending, new_unit, &aliases, &tags, conv_ref);
+    resolve_refs(pending, report)
+}
+
+#[cfg(test)]
+mod tests
+{
+    use super::*;
+
+    // the names of the units read from 'cfg' with their conv_factors, and the errors reported
+    fn read(cfg: &str) -> (Vec<(String, f64)>, Vec<String>)
+    {
+        let mut reports = Vec::new();
+        let units = read_units(cfg.as_bytes(), &mut |message| reports.push(message.to_string()));
+        let units = units.iter().map(|unit| ((*unit.init.unit.common_name).clone(), unit.init.unit.conv_factor)).collect();
+
+        (units, reports)
+    }
+
+    #[test]
+    fn references_resolve()
+    {
+        let (units, reports) = read("[yard]\n\ttype = length\n\tconv_factor = 3 foot\n\
+                                     [inch]\n\taliases = in\n\ttype = length\n\tconv_factor = 25.4\n\
+                                     [foot]\n\ttype = length\n\tconv_factor = 12 in\n\
+                                     [thou]\n\ttype = length\n\tconv_factor = 1/1000 in\n");
+
+        assert!(reports.is_empty(), "{:?}", reports);
+        assert_eq!(units, vec![("yard".to_string(), 914.4), ("inch".to_string(), 25.4),
+                               ("foot".to_string(), 304.8), ("thou".to_string(), 0.0254)]);
+    }
+
+    #[test]
+    fn cycles_are_left_out()
+    {
+        let (units, reports) = read("[a]\n\ttype = length\n\tconv_factor = 2 b\n\
+                                     [b]\n\ttype = length\n\tconv_factor = 1/2 a\n\
+                                     [c]\n\ttype = length\n\tconv_factor = 3 a\n\
+                                     [d]\n\ttype = length\n\tconv_factor = 5\n\
+                                     [e]\n\ttype = length\n\tconv_factor = 2 e\n");
+
+        assert_eq!(units, vec![("d".to_string(), 5.0)]);
+
+        let cycles: Vec<&String> = reports.iter().filter(|report| report.contains("in a cycle")).collect();
+        assert_eq!(cycles.len(), 2, "{:?}", reports);
+        assert!(cycles[0].contains("units a -> b -> a:"), "{}", cycles[0]);
+        assert!(cycles[1].contains("units e -> e:"), "{}", cycles[1]);
+
+        // c refers into the cycle without being on it
+        assert!(reports.iter().any(|report| report.contains("unit c: conv_factor refers to unit \'a\' which was left out")),
+                "{:?}", reports);
+    }
+}
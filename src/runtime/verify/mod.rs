@@ -0,0 +1,478 @@
+/* runtime/verify module
+ * ===
+ * Differential check of the fast conversion paths. Every pair of units of the same type in
+ * the database is converted under every combination of metric prefixes, with edge case and
+ * random values, by a reference and by each fast path:
+ *
+ *   plan  - ConversionPlan, as used by every mode but integer mode
+ *   slice - Kernel::apply_all, the slice form of the same kernels
+ *   auto  - ConversionPlan with an automatic output prefix, checked against the reference
+ *           with the prefix it chose, and for a result in [1, 1000^dimensions)
+ *   int   - integer mode's exact IntPlan, on integer values. It is exact where the others
+ *           round, so it is measured in counts against the rounded reference instead.
+ *           Conversions whose exact arithmetic needs more than 128 bits are counted apart;
+ *           integer mode reports those as out of range
+ *
+ * The reference is the stage by stage conversion the program had before any of them, kept
+ * here as it was. Results are reported as distributions of the distance to the reference,
+ * along with every disagreement about whether or how a conversion failed. Values are drawn
+ * from a fixed seed so that runs are repeatable.
+ *
+ * This file is a part of:
+ *
+ * Yucon - General Purpose Unit Converter
+ * Copyright (C) 2016-2017  Blaine Murphy
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use std::f64;
+use std::fmt;
+use std::fmt::Display;
+use std::io;
+use std::sync::Arc;
+
+use yucon_core::convert::{INPUT, OUTPUT, check_input, check_output};
+use yucon_core::exact::{IntPlan, Rounding};
+use yucon_core::kernel::{Kernel, Ratio};
+use yucon_core::prefix::{prefix_exponent, prefix_scale};
+
+use ::utils::{NO_PREFIX, AUTO_PREFIX, prefix_as_num};
+use ::runtime::convert::{ConversionError, ConversionPlan};
+use ::runtime::units::{Unit, UnitDatabase};
+use ::runtime::state::Options;
+
+// every prefix, including none
+static PREFIXES: [char; 21] = ['Y', 'Z', 'E', 'P', 'T', 'G', 'M', 'k', 'h', 'D', NO_PREFIX,
+                               'd', 'c', 'm', 'u', 'n', 'p', 'f', 'a', 'z', 'y'];
+
+// values every conversion is tried with, besides those found for each pair
+static EDGE_VALUES: [f64; 16] = [0.0, -0.0, 1.0, -1.0, 1000.0, 0.001,
+                                 f64::MIN_POSITIVE, -f64::MIN_POSITIVE, 5e-324, 1e-310,
+                                 f64::MAX, -f64::MAX, f64::INFINITY, f64::NEG_INFINITY, f64::NAN, 1e300];
+
+// counts every integer conversion is tried with
+static EDGE_COUNTS: [i64; 9] = [0, 1, -1, 1000, -1000, 2147483647, -2147483648, 1 << 53, -(1 << 53)];
+
+const SEED: u64 = 0x9e3779b97f4a7c15;
+// upper bounds of the buckets of a distribution. the last holds everything above
+const BUCKETS: [u64; 6] = [0, 1, 2, 4, 16, 256];
+// disagreements listed in full for each path
+const EXAMPLES: usize = 5;
+
+/* The conversion as it was done before plans and kernels, stage for stage.
+ * See runtime/convert for the stages.
+ */
+fn reference(input: f64, from_prefix: char, from: &Unit, to_prefix: char, to: &Unit) -> Result<f64, ConversionError>
+{
+    if (!input.is_normal()) && (input != 0.0)
+    {
+        return Err(ConversionError::OutOfRange(INPUT));
+    }
+
+    let mut output_val = input * prefix_as_num(from_prefix).unwrap().powi(from.dimensions as i32); // S1
+
+    if from.inverse
+    {
+        output_val = 1.0 / output_val; // S2
+    }
+
+    output_val *= from.conv_factor; // S3
+    output_val += from.zero_point - to.zero_point; // S4
+    output_val /= to.conv_factor; // S5
+
+    if to.inverse
+    {
+        output_val = 1.0 / output_val; // S6
+    }
+
+    output_val /= prefix_as_num(to_prefix).unwrap().powi(to.dimensions as i32); // S7
+
+    if (!output_val.is_normal()) && (output_val != 0.0)
+    {
+        return Err(ConversionError::OutOfRange(OUTPUT));
+    }
+
+    Ok(output_val)
+}
+
+// xorshift64*. only needs to be repeatable and spread out
+struct Rng(u64);
+
+impl Rng
+{
+    fn next(&mut self) -> u64
+    {
+        self.0 ^= self.0 >> 12;
+        self.0 ^= self.0 << 25;
+        self.0 ^= self.0 >> 27;
+        self.0.wrapping_mul(0x2545f4914f6cdd1d)
+    }
+
+    // a value of random sign with a magnitude spread evenly over 1e-300 to 1e300
+    fn value(&mut self) -> f64
+    {
+        let fraction = (self.next() >> 11) as f64 / (1u64 << 53) as f64;
+        let magnitude = 10f64.powf(fraction * 600.0 - 300.0);
+        if self.next() & 1 == 0 { magnitude } else { -magnitude }
+    }
+
+    // a count of random sign with a magnitude of up to 2^53
+    fn count(&mut self) -> i64
+    {
+        let bits = self.next() % 54;
+        let magnitude = (self.next() >> (64 - bits.max(1))) as i64;
+        if self.next() & 1 == 0 { magnitude } else { -magnitude }
+    }
+}
+
+// orders floats as integers so that neighbours differ by one. both zeros are 0
+fn ordered(value: f64) -> i64
+{
+    let bits = value.to_bits() as i64;
+    if bits < 0 { i64::min_value() - bits } else { bits }
+}
+
+fn ulps(a: f64, b: f64) -> u64
+{
+    (ordered(a) as i128 - ordered(b) as i128).abs() as u64
+}
+
+// a conversion written as it would be typed, for reports
+fn describe(value: f64, from_prefix: char, from: &Unit, to_prefix: char, to: &Unit) -> String
+{
+    let prefixed = |prefix: char, unit: &Unit| if prefix == NO_PREFIX
+    {
+        unit.common_name.as_ref().clone()
+    }
+    else
+    {
+        format!("_{}{}", prefix, unit.common_name)
+    };
+
+    format!("{:e} {} {}", value, prefixed(from_prefix, from), prefixed(to_prefix, to))
+}
+
+/* struct Tally
+ *
+ * Description: how one path compared against the reference: the distribution
+ *   of distances where both converted, the worst of them, and the cases where
+ *   the two disagreed on an error.
+ */
+struct Tally
+{
+    name: &'static str,
+    unit: &'static str,
+    compared: u64,
+    buckets: [u64; 7],
+    worst: u64,
+    worst_case: Option<String>,
+    diverged: u64,
+    examples: Vec<String>,
+    overflowed: u64, // exact results past 128 bits, a known limit of integer mode
+    overflow_case: Option<String>,
+}
+
+impl Tally
+{
+    fn new(name: &'static str, unit: &'static str) -> Tally
+    {
+        Tally {
+            name: name,
+            unit: unit,
+            compared: 0,
+            buckets: [0; 7],
+            worst: 0,
+            worst_case: None,
+            diverged: 0,
+            examples: Vec::new(),
+            overflowed: 0,
+            overflow_case: None,
+        }
+    }
+
+    fn distance<F: Fn() -> String>(&mut self, distance: u64, case: F)
+    {
+        self.compared += 1;
+        let bucket = BUCKETS.iter().position(|bound| distance <= *bound).unwrap_or(BUCKETS.len());
+        self.buckets[bucket] += 1;
+
+        if distance > self.worst
+        {
+            self.worst = distance;
+            self.worst_case = Some(case());
+        }
+    }
+
+    fn diverge<F: Fn() -> String>(&mut self, case: F)
+    {
+        self.compared += 1;
+        self.diverged += 1;
+
+        if self.examples.len() < EXAMPLES
+        {
+            self.examples.push(case());
+        }
+    }
+
+    // compares a floating point result against the reference
+    fn compare<F: Fn() -> String>(&mut self, expected: Result<f64, ConversionError>,
+        actual: Result<f64, ConversionError>, case: F)
+    {
+        match (expected, actual)
+        {
+        (Ok(expected), Ok(actual)) => self.distance(ulps(expected, actual), case),
+        (Err(expected), Err(actual)) if expected == actual => self.compared += 1,
+        (expected, actual) => self.diverge(|| format!("{}: expected {:?}, got {:?}", case(), expected, actual)),
+        };
+    }
+}
+
+impl Display for Tally
+{
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result
+    {
+        try!(write!(f, "{:<6}{:>12}", self.name, self.compared));
+        for count in self.buckets.iter()
+        {
+            try!(write!(f, "{:>11}", count));
+        }
+        try!(write!(f, "{:>10}\n", self.diverged));
+
+        if let Some(ref case) = self.worst_case
+        {
+            try!(write!(f, "  worst: {} {} off in {}\n", self.worst, self.unit, case));
+        }
+        for example in self.examples.iter()
+        {
+            try!(write!(f, "  diverged: {}\n", example));
+        }
+        if let Some(ref case) = self.overflow_case
+        {
+            try!(write!(f, "  overflowed 128 bits: {}, eg {}\n", self.overflowed, case));
+        }
+
+        Ok(())
+    }
+}
+
+// values tried with one conversion: the edge values, those at the output's limits, and random ones
+fn values_for(from_prefix: char, from: &Unit, to_prefix: char, to: &Unit, rng: &mut Rng, samples: usize) -> Vec<f64>
+{
+    let mut values = EDGE_VALUES.to_vec();
+
+    // inputs just inside and outside of the range of outputs. exact only for linear units
+    if let Ok(ratio) = reference(1.0, from_prefix, from, to_prefix, to)
+    {
+        for limit in [f64::MAX, f64::MIN_POSITIVE].iter()
+        {
+            let value = limit / ratio.abs();
+            values.push(value * 0.999);
+            values.push(value * 1.001);
+        }
+    }
+
+    for _ in 0..samples
+    {
+        values.push(rng.value());
+    }
+
+    values
+}
+
+// the exact scale of a prefix, as integer mode uses it
+fn exact_prefix(prefix: char, dimensions: u8) -> Option<Ratio>
+{
+    Ratio::pow10(prefix_exponent(prefix)? * dimensions as i32)
+}
+
+/* Checks integer mode's exact plan for one conversion against the reference
+ * rounded to a whole count. Skipped for units whose numbers it cannot use.
+ */
+fn verify_int(from_prefix: char, from: &Unit, to_prefix: char, to: &Unit, rng: &mut Rng, samples: usize, tally: &mut Tally)
+{
+    let plan = (|| IntPlan::new(exact_prefix(from_prefix, from.dimensions)?, &from.exact_factors()?,
+                                exact_prefix(to_prefix, to.dimensions)?, &to.exact_factors()?,
+                                Ratio::from_int(1), Rounding::HalfEven))();
+    let plan = match plan
+    {
+    Some(plan) => plan,
+    None => return,
+    };
+
+    let mut counts = EDGE_COUNTS.to_vec();
+    for _ in 0..samples
+    {
+        counts.push(rng.count());
+    }
+
+    for count in counts
+    {
+        let case = || describe(count as f64, from_prefix, from, to_prefix, to);
+
+        match (plan.apply(count), reference(count as f64, from_prefix, from, to_prefix, to))
+        {
+        // beyond 2^53 the reference no longer holds whole counts
+        (Some(exact), Ok(approx)) if approx.abs() < 9007199254740992.0 => {
+            tally.distance((exact - approx.round() as i128).abs() as u64, case);
+        },
+        (Some(..), Ok(..)) => {},
+        (None, Err(..)) => tally.compared += 1,
+        // integer mode only ever writes counts that fit 64 bits
+        (None, Ok(approx)) if approx.abs() < 9.2e18 => {
+            tally.compared += 1;
+            tally.overflowed += 1;
+            if tally.overflow_case.is_none()
+            {
+                tally.overflow_case = Some(format!("{}, expected {}", case(), approx));
+            }
+        },
+        (None, Ok(..)) => {},
+        (Some(exact), Err(err)) => {
+            tally.diverge(|| format!("{}: expected {:?}, got {}", case(), err, exact));
+        },
+        };
+    }
+}
+
+// the prefixes an automatic prefix is chosen from, smallest first
+static ENGINEERING: [char; 17] = ['y', 'z', 'a', 'f', 'p', 'n', 'u', 'm', NO_PREFIX,
+                                  'k', 'M', 'G', 'T', 'P', 'E', 'Z', 'Y'];
+
+/* Checks a result converted with an automatic prefix. It should be in
+ * [1, 1000^dimensions) unless the prefix is the smallest or largest. Within
+ * rounding of a boundary neither neighbouring prefix may manage that, eg
+ * 999.9999999999999 rounding to 1000 with one and 0.9999999999999999 with the
+ * next; only a neighbour that would have been in range is an error. Returns
+ * that neighbour.
+ */
+fn auto_miss(value: f64, from_prefix: char, from: &Unit, result: f64, prefix: char, to: &Unit) -> Option<char>
+{
+    let bound = 1000f64.powi(to.dimensions as i32);
+    let in_range = |result: f64| result == 0.0 || result.abs() >= 1.0 && result.abs() < bound;
+    let index = ENGINEERING.iter().position(|ch| *ch == prefix).unwrap();
+
+    let neighbour = if result.abs() < 1.0 && result != 0.0 && index > 0
+    {
+        ENGINEERING[index - 1]
+    }
+    else if result.abs() >= bound && index < ENGINEERING.len() - 1
+    {
+        ENGINEERING[index + 1]
+    }
+    else
+    {
+        return None;
+    };
+
+    match reference(value, from_prefix, from, neighbour, to)
+    {
+    Ok(other) if in_range(other) => Some(neighbour),
+    _ => None,
+    }
+}
+
+/* Runs every check and writes the report to standard output. Fails if any path
+ * disagreed with the reference about an error.
+ */
+pub fn run_job(opts: &Options, units: &UnitDatabase) -> io::Result<()>
+{
+    let samples = opts.verify_samples.unwrap_or(0);
+    let mut rng = Rng(SEED);
+    let mut plan_tally = Tally::new("plan", "ulps");
+    let mut slice_tally = Tally::new("slice", "ulps");
+    let mut auto_tally = Tally::new("auto", "ulps");
+    let mut int_tally = Tally::new("int", "counts");
+    let mut pairs = 0;
+
+    let all: &Vec<Arc<Unit>> = units.all();
+
+    for from in all.iter()
+    {
+        for to in all.iter().filter(|to| to.unit_type == from.unit_type)
+        {
+            pairs += 1;
+
+            for &from_prefix in PREFIXES.iter()
+            {
+                for &to_prefix in PREFIXES.iter()
+                {
+                    let values = values_for(from_prefix, from, to_prefix, to, &mut rng, samples);
+                    let plan = ConversionPlan::for_units(from_prefix, from, to_prefix, to);
+                    let kernel: Kernel<f64> = Kernel::new(prefix_scale(from_prefix, from.dimensions).unwrap(), &from.factors(),
+                                                          prefix_scale(to_prefix, to.dimensions).unwrap(), &to.factors())
+                                                  .unwrap();
+                    let mut outputs = vec![None; values.len()];
+                    kernel.apply_all(&values, &mut outputs);
+
+                    for (value, output) in values.iter().zip(outputs.iter())
+                    {
+                        let value = *value;
+                        let case = || describe(value, from_prefix, from, to_prefix, to);
+                        let expected = reference(value, from_prefix, from, to_prefix, to);
+
+                        plan_tally.compare(expected, plan.convert(value).result, &case);
+
+                        let sliced = check_input(value).and_then(|_| check_output(output.unwrap()));
+                        slice_tally.compare(expected, sliced, &case);
+                    }
+
+                    if to_prefix == NO_PREFIX
+                    {
+                        let auto_plan = ConversionPlan::for_units(from_prefix, from, AUTO_PREFIX, to);
+
+                        for value in values.iter()
+                        {
+                            let value = *value;
+                            let conversion = auto_plan.convert(value);
+                            let chosen = conversion.to_prefix();
+                            let case = || describe(value, from_prefix, from, chosen, to);
+
+                            let miss = match conversion.result
+                            {
+                            Ok(result) => auto_miss(value, from_prefix, from, result, chosen, to),
+                            Err(..) => None,
+                            };
+
+                            match miss
+                            {
+                            Some(better) => auto_tally.diverge(|| format!("{}: should have chosen \'{}\'", case(), better)),
+                            None => auto_tally.compare(reference(value, from_prefix, from, chosen, to), conversion.result, &case),
+                            };
+                        }
+                    }
+
+                    verify_int(from_prefix, from, to_prefix, to, &mut rng, samples, &mut int_tally);
+                }
+            }
+        }
+    }
+
+    println!("Checked {} pairs of units under {} pairs of prefixes against the reference", pairs,
+             PREFIXES.len() * PREFIXES.len());
+    println!("{:<6}{:>12}{:>11}{:>11}{:>11}{:>11}{:>11}{:>11}{:>11}{:>10}",
+             "path", "compared", "0", "1", "2", "3-4", "5-16", "17-256", ">256", "diverged");
+
+    for tally in [&plan_tally, &slice_tally, &auto_tally, &int_tally].iter()
+    {
+        print!("{}", tally);
+    }
+
+    let diverged = plan_tally.diverged + slice_tally.diverged + auto_tally.diverged + int_tally.diverged;
+
+    if diverged > 0
+    {
+        return Err(io::Error::new(io::ErrorKind::Other, format!("{} conversions diverged from the reference", diverged)));
+    }
+
+    Ok(())
+}
@@ -0,0 +1,237 @@
+/* trace module
+ * ===
+ * Optional span instrumentation, enabled with the 'trace' cargo feature. Spans are recorded
+ * around the main stages of loading, parsing, and conversion and written on exit as Chrome
+ * trace-event JSON, viewable in chrome://tracing or Perfetto.
+ *
+ * Usage:
+ *   trace_span!("name") at the top of a block records a span from that point to the end of
+ *   the block. trace_until_exit!() at the top of main writes the trace when main returns.
+ *   Without the feature both macros expand to nothing and the recorder is not compiled.
+ *
+ * Each thread records into its own buffer behind a lock of its own, which only the writer of
+ * the trace takes as well, once, so recording a span never waits on other threads and traces
+ * of parallel batch runs show real contention rather than the tracer's own. A buffer is listed
+ * when its thread records its first span and is read from there when the trace is written, so
+ * threads still running on exit are traced too, up to the last span they ended, eg the batch
+ * stages left waiting on input after an 'exit'.
+ *
+ * This file is a part of:
+ *
+ * Yucon - General Purpose Unit Converter
+ * Copyright (C) 2016-2017  Blaine Murphy
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#[cfg(feature = "trace")]
+macro_rules! trace_span
+{
+    ($name:expr) => { let _trace_span = ::trace::Span::enter($name); };
+}
+
+#[cfg(not(feature = "trace"))]
+macro_rules! trace_span
+{
+    ($name:expr) => {};
+}
+
+#[cfg(feature = "trace")]
+macro_rules! trace_until_exit
+{
+    () => { let _trace_exit = ::trace::ExitGuard; };
+}
+
+#[cfg(not(feature = "trace"))]
+macro_rules! trace_until_exit
+{
+    () => {};
+}
+
+#[cfg(feature = "trace")]
+pub use self::recorder::*;
+
+#[cfg(feature = "trace")]
+mod recorder
+{
+    use std::env;
+    use std::fs::File;
+    use std::io;
+    use std::io::{BufWriter, Write};
+    use std::mem;
+    use std::sync::{Arc, Mutex};
+    use std::sync::OnceLock;
+    use std::sync::atomic::{AtomicU64, Ordering};
+    use std::time::Instant;
+
+    // spans kept per thread. later spans are counted but dropped to bound memory
+    const MAX_SPANS_PER_THREAD: usize = 1 << 20;
+
+    struct Event
+    {
+        name: &'static str,
+        start_ns: u64,
+        dur_ns: u64,
+    }
+
+    struct ThreadTrace
+    {
+        tid: u64,
+        events: Vec<Event>,
+        dropped: u64,
+    }
+
+    static EPOCH: OnceLock<Instant> = OnceLock::new();
+    static NEXT_TID: AtomicU64 = AtomicU64::new(1);
+    // the buffer of every thread that has recorded a span, running or not
+    static THREADS: Mutex<Vec<Arc<Mutex<ThreadTrace>>>> = Mutex::new(Vec::new());
+
+    thread_local!
+    {
+        static LOCAL: Arc<Mutex<ThreadTrace>> = register();
+    }
+
+    // lists the buffer of a thread recording its first span
+    fn register() -> Arc<Mutex<ThreadTrace>>
+    {
+        let local = Arc::new(Mutex::new(ThreadTrace {
+            tid: NEXT_TID.fetch_add(1, Ordering::Relaxed),
+            events: Vec::new(),
+            dropped: 0,
+        }));
+
+        if let Ok(mut threads) = THREADS.lock()
+        {
+            threads.push(local.clone());
+        }
+
+        local
+    }
+
+    fn now_ns() -> u64
+    {
+        EPOCH.get_or_init(Instant::now).elapsed().as_nanos() as u64
+    }
+
+    /* struct Span
+     *
+     * Description: guard for a span in progress. Records the span in the
+     *   current thread's buffer when dropped.
+     */
+    pub struct Span
+    {
+        name: &'static str,
+        start_ns: u64,
+    }
+
+    impl Span
+    {
+        pub fn enter(name: &'static str) -> Span
+        {
+            Span { name: name, start_ns: now_ns() }
+        }
+    }
+
+    impl Drop for Span
+    {
+        fn drop(&mut self)
+        {
+            let end_ns = now_ns();
+            let event = Event { name: self.name, start_ns: self.start_ns, dur_ns: end_ns - self.start_ns };
+
+            // try_with: spans may end while the thread's storage is being torn down
+            LOCAL.try_with(|local| {
+                let mut local = match local.lock()
+                {
+                Ok(local) => local,
+                Err(..) => return,
+                };
+
+                if local.events.len() < MAX_SPANS_PER_THREAD
+                {
+                    local.events.push(event);
+                }
+                else
+                {
+                    local.dropped += 1;
+                }
+            }).ok();
+        }
+    }
+
+    // writes the trace when dropped. see trace_until_exit!()
+    pub struct ExitGuard;
+
+    impl Drop for ExitGuard
+    {
+        fn drop(&mut self)
+        {
+            if let Err(err) = write_trace()
+            {
+                writeln!(io::stderr(), "*** WARNING *** Failed to write trace: {}", err).ok();
+            }
+        }
+    }
+
+    // takes the spans recorded so far out of every thread's buffer
+    fn take_all() -> Vec<ThreadTrace>
+    {
+        let threads = THREADS.lock().unwrap();
+
+        threads.iter().filter_map(|local| local.lock().ok()).map(|mut local| {
+            let dropped = local.dropped;
+            local.dropped = 0;
+
+            ThreadTrace { tid: local.tid, events: mem::replace(&mut local.events, Vec::new()), dropped: dropped }
+        }).collect()
+    }
+
+    /* Writes every span recorded so far as trace-event JSON to the file named by
+     * $YUCON_TRACE, or 'yucon-trace.json' in the working directory. Call once on
+     * exit from the main thread. Spans threads end after this are not written.
+     */
+    pub fn write_trace() -> io::Result<()>
+    {
+        let finished = take_all();
+        let path = env::var("YUCON_TRACE").unwrap_or("yucon-trace.json".to_string());
+        let mut out = BufWriter::new(try!(File::create(&path)));
+        let mut first = true;
+
+        try!(write!(out, "{{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"));
+
+        for thread in finished.iter()
+        {
+            for event in thread.events.iter()
+            {
+                try!(write!(out, "{}{{\"name\":\"{}\",\"ph\":\"X\",\"pid\":1,\"tid\":{},\"ts\":{:.3},\"dur\":{:.3}}}",
+                            if first { "" } else { ",\n" },
+                            event.name,
+                            thread.tid,
+                            event.start_ns as f64 / 1000.0,
+                            event.dur_ns as f64 / 1000.0));
+                first = false;
+            }
+
+            if thread.dropped > 0
+            {
+                try!(write!(out, "{}{{\"name\":\"spans dropped\",\"ph\":\"C\",\"pid\":1,\"tid\":{},\"ts\":0,\"args\":{{\"count\":{}}}}}",
+                            if first { "" } else { ",\n" },
+                            thread.tid,
+                            thread.dropped));
+                first = false;
+            }
+        }
+
+        try!(write!(out, "\n]}}\n"));
+        out.flush()
+    }
+}
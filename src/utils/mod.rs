@@ -129,6 +129,12 @@ impl Display for SyntaxError
  *
  *   fn reset(&mut self)
  *     Resets this syntax to its default state.
+ *
+ *   fn special_bytes(&self) -> Option<&'static [u8]>
+ *     Returns every byte this syntax splits on, that is its delimiters and
+ *     comment chars, so that tokenize may skip runs of ordinary bytes in bulk
+ *     on ASCII lines without escapes. Optional trait. Returning None (the
+ *     default) always uses the char-by-char path.
  */
 pub trait SyntaxChecker
 {
@@ -143,6 +149,11 @@ pub trait SyntaxChecker
     fn esc_set(&self) -> bool;
     fn set_esc(&mut self, set: bool);
     fn reset(&mut self);
+
+    fn special_bytes(&self) -> Option<&'static [u8]>
+    {
+        None
+    }
 }
 
 const DELIM: bool = true; // constant for indicated delimiter to SyntaxChecker trait
@@ -223,12 +234,21 @@ impl TokenType
  */
 pub fn tokenize<S: SyntaxChecker>(line: &str, checker: &mut S) -> Result<Vec<TokenType>, SyntaxError>
 {
+    trace_span!("tokenize");
     if line.is_empty()
     {
         let mut tokens = Vec::with_capacity(1);
         tokens.push(TokenType::Normal(String::new()));
         return Ok(tokens);
     }
+    if let Some(special) = checker.special_bytes()
+    {
+        if is_plain_ascii(line.as_bytes(), checker.esc_char() as u8)
+        {
+            return tokenize_ascii(line, special, checker);
+        }
+    }
+
     let mut buffer = String::with_capacity(line.len()); // biggest token is possible is the line unmodified
     let mut tokens = Vec::with_capacity(5); // unit properties contain at least 3 tokens, CommonName 5. avoids excessive reallocation
     let mut delim_pushed = false;
@@ -339,35 +359,304 @@ pub fn tokenize<S: SyntaxChecker>(line: &str, checker: &mut S) -> Result<Vec<Tok
     Ok(tokens)
 }
 
-pub const NO_PREFIX: char = '\0';
+/* ASCII fast path of fn tokenize. Lines reaching here contain only ASCII and
+ * no escape char, so char indices equal byte indices and the escape / preserved
+ * delimiter rules never apply. Instead of feeding every char through the
+ * checker, the line is scanned a word at a time for the checker's special
+ * bytes and the ordinary runs in between are sliced out directly. Produces the
+ * same tokens, checker calls and errors as the char-by-char path.
+ */
+fn tokenize_ascii<S: SyntaxChecker>(line: &str, special: &[u8], checker: &mut S) -> Result<Vec<TokenType>, SyntaxError>
+{
+    let bytes = line.as_bytes();
+    let mut tokens = Vec::with_capacity(5);
+    let mut delim_pushed = false;
+    let mut token_start: usize = 0;
+    let mut scan_from: usize = 0;
+
+    while let Some(index) = find_special(bytes, scan_from, special)
+    {
+        let ch = bytes[index] as char;
+        scan_from = index + 1;
+
+        if checker.is_delim(ch)
+        {
+            let new_token = line[token_start..index].to_string();
+            checker.feed_token(&new_token, !DELIM, index);
+            tokens.push(TokenType::Normal(new_token));
+
+            let new_token = ch.to_string();
+            checker.feed_token(&new_token, DELIM, index);
+            tokens.push(TokenType::Delim(new_token));
+
+            delim_pushed = true;
+            token_start = scan_from;
+        }
+        else if checker.is_comment(ch)
+        {
+            let new_token = line[token_start..index].to_string();
+            checker.feed_token(&new_token, !DELIM, index);
+            tokens.push(TokenType::Normal(new_token));
+            try!(checker.assert_valid(index, true));
+            return Ok(tokens); // if we reach a comment, immediately exit
+        }
+        else
+        {
+            // special to the scanner but ordinary to the syntax. keep going
+            continue;
+        }
+
+        try!(checker.assert_valid(index, true));
+    }
 
-pub fn prefix_as_num(prefix: char) -> Option<f64>
+    let last = bytes.len() - 1;
+
+    if token_start < bytes.len()
+    {
+        let new_token = line[token_start..].to_string();
+        checker.feed_token(&new_token, !DELIM, last);
+        tokens.push(TokenType::Normal(new_token));
+    }
+    else if delim_pushed
+    {
+        let new_token = String::new();
+        checker.feed_token(&new_token, !DELIM, last);
+        tokens.push(TokenType::Normal(new_token));
+    }
+
+    try!(checker.assert_valid(last, false));
+
+    Ok(tokens)
+}
+
+// SWAR (SIMD within a register) constants. every byte lane set to 0x01 / 0x80
+const LANE_LO: u64 = 0x0101010101010101;
+const LANE_HI: u64 = 0x8080808080808080;
+
+fn load_word(bytes: &[u8], at: usize) -> u64
 {
-    let num: f64 = match prefix
+    let mut word = [0u8; 8];
+    word.copy_from_slice(&bytes[at..at + 8]);
+    u64::from_le_bytes(word)
+}
+
+/* Classifies 8 bytes at once. Returns a mask with the high bit of a lane set
+ * if that lane equals any of the special bytes. Lanes above the first match
+ * may hold false positives from borrow propagation but the lowest set bit is
+ * always exact, which is all fn find_special relies on.
+ */
+fn match_lanes(word: u64, special: &[u8]) -> u64
+{
+    let mut hits = 0;
+
+    for byte in special.iter()
+    {
+        let diff = word ^ (LANE_LO * (*byte as u64));
+        hits |= diff.wrapping_sub(LANE_LO) & !diff & LANE_HI;
+    }
+
+    hits
+}
+
+/* Returns the index of the first byte at or after 'from' that is one of
+ * 'special', or None if there is none. Scans 16 bytes per iteration.
+ */
+pub fn find_special(bytes: &[u8], from: usize, special: &[u8]) -> Option<usize>
+{
+    let mut index = from;
+
+    while index + 16 <= bytes.len()
     {
-    'Y' => 1.0e24,
-    'Z' => 1.0e21,
-    'E' => 1.0e18,
-    'P' => 1.0e15,
-    'T' => 1.0e12,
-    'G' => 1.0e9,
-    'M' => 1.0e6,
-    'k' => 1.0e3,
-    'h' => 1.0e2,
-    'D' => 1.0e1,
-    NO_PREFIX => 1.0,
-    'd' => 1.0e-1,
-    'c' => 1.0e-2,
-    'm' => 1.0e-3,
-    'u' => 1.0e-6,
-    'n' => 1.0e-9,
-    'p' => 1.0e-12,
-    'f' => 1.0e-15,
-    'a' => 1.0e-18,
-    'z' => 1.0e-21,
-    'y' => 1.0e-24,
-    _   => return None, // default
-    };
-
-    Some(num)
-}
\ No newline at end of file
+        let lo = match_lanes(load_word(bytes, index), special);
+        let hi = match_lanes(load_word(bytes, index + 8), special);
+
+        if lo != 0
+        {
+            return Some(index + (lo.trailing_zeros() / 8) as usize);
+        }
+        if hi != 0
+        {
+            return Some(index + 8 + (hi.trailing_zeros() / 8) as usize);
+        }
+        index += 16;
+    }
+
+    if index + 8 <= bytes.len()
+    {
+        let hits = match_lanes(load_word(bytes, index), special);
+
+        if hits != 0
+        {
+            return Some(index + (hits.trailing_zeros() / 8) as usize);
+        }
+        index += 8;
+    }
+
+    while index < bytes.len()
+    {
+        if special.contains(&bytes[index])
+        {
+            return Some(index);
+        }
+        index += 1;
+    }
+
+    None
+}
+
+/* Checks in a single pass that a line is pure ASCII and free of the given
+ * escape byte, ie eligible for the fast path of fn tokenize.
+ */
+pub fn is_plain_ascii(bytes: &[u8], esc: u8) -> bool
+{
+    let esc_set = [esc];
+    let mut index = 0;
+
+    while index + 8 <= bytes.len()
+    {
+        let word = load_word(bytes, index);
+
+        if word & LANE_HI != 0 || match_lanes(word, &esc_set) != 0
+        {
+            return false;
+        }
+        index += 8;
+    }
+
+    bytes[index..].iter().all(|byte| *byte < 0x80 && *byte != esc)
+}
+
+pub use yucon_core::prefix::{NO_PREFIX, AUTO_PREFIX, prefix_as_num};
+
+// output unit standing for every unit of the input unit's type
+pub const ALL_UNITS: &'static str = "*";
+
+#[cfg(test)]
+mod tests
+{
+    use super::*;
+
+    // delimits by spaces and commas, with '#' comments and '\' escapes. records every token fed
+    struct Recorder
+    {
+        fast: bool,
+        esc: bool,
+        fed: Vec<(String, bool, usize)>,
+    }
+
+    impl SyntaxChecker for Recorder
+    {
+        fn feed_token(&mut self, token: &str, delim: bool, index: usize) -> bool
+        {
+            self.fed.push((token.to_string(), delim, index));
+            true
+        }
+
+        fn is_esc(&self, ch: char) -> bool { ch == '\\' }
+        fn is_comment(&self, ch: char) -> bool { ch == '#' }
+        fn is_delim(&self, ch: char) -> bool { ch == ' ' || ch == ',' }
+        fn is_preserved_delim(&self, _ch: char) -> bool { false }
+        fn esc_char(&self) -> char { '\\' }
+        fn valid(&self) -> bool { true }
+        fn assert_valid(&self, _index: usize, _more_tokens: bool) -> Result<(), SyntaxError> { Ok(()) }
+        fn esc_set(&self) -> bool { self.esc }
+        fn set_esc(&mut self, set: bool) { self.esc = set; }
+        fn reset(&mut self) { self.esc = false; self.fed.clear(); }
+
+        // '=' is special to the scanner only, to take the path that skips over it
+        fn special_bytes(&self) -> Option<&'static [u8]>
+        {
+            if self.fast { Some(b" ,#=") } else { None }
+        }
+    }
+
+    // the tokens of a line and the calls made to the checker, on the ASCII path or the char path
+    fn run(line: &str, fast: bool) -> (Vec<(bool, String)>, Vec<(String, bool, usize)>)
+    {
+        let mut checker = Recorder { fast: fast, esc: false, fed: Vec::new() };
+        let tokens = tokenize(line, &mut checker).unwrap().into_iter()
+            .map(|token| match token
+            {
+            TokenType::Delim(token) => (true, token),
+            TokenType::Normal(token) => (false, token),
+            })
+            .collect();
+
+        (tokens, checker.fed)
+    }
+
+    #[test]
+    fn ascii_path_matches_char_path()
+    {
+        let lines = ["1 ft m", "  leading", "trailing  ", "a,,b", ",", " ", "x = y # comment, with delims", "#",
+                     "no_specials_in_a_line_longer_than_sixteen_bytes", "a b c d e f g h i j k l m n o p q r s t",
+                     "exactly 16 bytes", "sixteen_bytes_ab,c", "12345678,", "1234567,8 # tail"];
+
+        for line in lines.iter()
+        {
+            assert!(is_plain_ascii(line.as_bytes(), b'\\'));
+            assert_eq!(run(line, true), run(line, false), "line {:?}", line);
+        }
+
+        // a delimiter or comment in every lane of the words scanned
+        for len in 1..40
+        {
+            for at in 0..len
+            {
+                for special in [',', '#', '='].iter()
+                {
+                    let line: String = (0..len).map(|index| if index == at { *special } else { 'a' }).collect();
+                    assert_eq!(run(&line, true), run(&line, false), "line {:?}", line);
+                }
+            }
+        }
+    }
+
+    #[test]
+    fn find_special_finds_the_first()
+    {
+        let special = b",#";
+
+        for len in 0..40
+        {
+            for at in 0..len
+            {
+                let mut bytes = vec![b'a'; len];
+                bytes[at] = b'#';
+                if at + 3 < len
+                {
+                    bytes[at + 3] = b',';
+                }
+
+                for from in 0..len + 1
+                {
+                    let expected = (from..len).find(|&index| special.contains(&bytes[index]));
+                    assert_eq!(find_special(&bytes, from, special), expected, "{:?} from {}", bytes, from);
+                }
+            }
+        }
+    }
+
+    #[test]
+    fn plain_ascii_rejects_escapes_and_non_ascii()
+    {
+        for len in 1..40
+        {
+            assert!(is_plain_ascii(&vec![b'a'; len], b'\\'));
+
+            for at in 0..len
+            {
+                for byte in [b'\\', 0x80, 0xff].iter()
+                {
+                    let mut bytes = vec![b'a'; len];
+                    bytes[at] = *byte;
+                    assert!(!is_plain_ascii(&bytes, b'\\'), "{:?}", bytes);
+                }
+            }
+        }
+
+        // escapes and multibyte chars take the char path, which handles them
+        assert_eq!(run("a\\ b c", false).0, vec![(false, "a b".to_string()), (true, " ".to_string()), (false, "c".to_string())]);
+        assert_eq!(run("µm,m", true), run("µm,m", false));
+    }
+}
@@ -0,0 +1,137 @@
+/* build.rs
+ * ===
+ * Compiles cfg/units.cfg into the static unit table of table.rs, and its names into the
+ * dictionary of fst.rs, built by the runtime's own builder, src/runtime/units/fst.rs. The file is read by the
+ * runtime's own reader, src/runtime/units/reader.rs, included below with #[path] along with
+ * what it uses, so it is parsed, and conv_factors given in terms of other units resolved, exactly
+ * as when it is loaded at runtime. Anything the runtime would warn about or leave out fails
+ * the build instead, as do tags and units sharing a name, which the table cannot hold. See
+ * table.rs.
+ *
+ * This file is a part of:
+ *
+ * Yucon - General Purpose Unit Converter
+ * Copyright (C) 2016-2017  Blaine Murphy
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+extern crate core; // scalar.rs is written for no_std
+
+use std::collections::BTreeMap;
+use std::env;
+use std::fs::File;
+use std::io::{BufReader, Write};
+use std::path::Path;
+
+// spans are only recorded by the yucon crate
+macro_rules! trace_span
+{
+    ($name:expr) => {};
+}
+
+// the parts of this crate the reader uses, under the paths it uses them by
+#[path = "src/prefix.rs"]
+pub mod prefix;
+#[path = "src/scalar.rs"]
+pub mod scalar;
+#[path = "src/fst.rs"]
+pub mod fst;
+mod yucon_core
+{
+    pub use ::fst;
+    pub use ::prefix;
+    pub use ::scalar;
+}
+
+// warned about where they are compiled into the yucon crate
+#[allow(warnings)]
+#[path = "../src/utils/mod.rs"]
+mod utils;
+#[allow(warnings)]
+#[path = "../src/runtime/units/reader.rs"]
+mod reader;
+#[allow(warnings)]
+#[path = "../src/runtime/units/fst.rs"]
+mod fst_builder;
+
+fn main()
+{
+    let manifest_dir = env::var("CARGO_MANIFEST_DIR").unwrap();
+    let cfg_path = Path::new(&manifest_dir).join("../cfg/units.cfg");
+    println!("cargo:rerun-if-changed={}", cfg_path.display());
+    println!("cargo:rerun-if-changed={}", Path::new(&manifest_dir).join("../src/runtime/units/reader.rs").display());
+    println!("cargo:rerun-if-changed={}", Path::new(&manifest_dir).join("../src/utils/mod.rs").display());
+    println!("cargo:rerun-if-changed={}", Path::new(&manifest_dir).join("../src/runtime/units/fst.rs").display());
+
+    let file = File::open(&cfg_path).expect("could not read cfg/units.cfg");
+    let mut problems: Vec<String> = Vec::new();
+    let units = reader::read_units(BufReader::new(file), &mut |message| problems.push(message.trim().to_string()));
+
+    if !problems.is_empty()
+    {
+        panic!("cfg/units.cfg does not load cleanly:\n{}", problems.join("\n"));
+    }
+
+    let mut names: BTreeMap<String, usize> = BTreeMap::new();
+    let mut table = String::from("const UNIT_TABLE: &'static [StaticUnit] = &[\n");
+
+    for (index, pending) in units.iter().enumerate()
+    {
+        let unit = &pending.init.unit;
+
+        if !pending.init.is_well_formed()
+        {
+            panic!("cfg/units.cfg: unit \'{}\' is missing mandatory properties", unit.common_name);
+        }
+        if unit.has_tags
+        {
+            panic!("cfg/units.cfg: unit \'{}\' has tags, which the static table cannot hold", unit.common_name);
+        }
+
+        let aliases: Vec<&str> = pending.aliases.iter().map(|alias| alias.as_str()).collect();
+
+        for name in Some(unit.common_name.as_str()).into_iter().chain(aliases.iter().cloned())
+        {
+            if names.insert(name.to_string(), index).map_or(false, |other| other != index)
+            {
+                panic!("cfg/units.cfg: unit \'{}\' shares the name \'{}\' with another unit", unit.common_name, name);
+            }
+        }
+
+        // {:?} prints the shortest text that parses back to the same f64
+        table.push_str(&format!(
+            "    StaticUnit {{ name: {:?}, aliases: &{:?}, unit_type: {:?}, factors: Factors {{ \
+             conv_factor: {:?}, zero_point: {:?}, dimensions: {}, inverse: {} }} }},\n",
+            unit.common_name, aliases, unit.unit_type, unit.conv_factor, unit.zero_point, unit.dimensions,
+            unit.inverse));
+    }
+
+    table.push_str("];\n\nconst NAME_TABLE: &'static [(&'static str, usize)] = &[\n");
+
+    for (name, index) in names.iter()
+    {
+        table.push_str(&format!("    ({:?}, {}),\n", name, index));
+    }
+
+    table.push_str("];\n");
+
+    // the names are sorted by bytes, as the builder needs them
+    let names_fst = fst_builder::Fst::from_sorted(names.iter().map(|(name, &index)| (name.as_bytes(), index as u32)));
+    table.push_str(&format!("\nconst LONGEST_NAME: usize = {};\n", names_fst.reader().longest()));
+
+    let out_dir = env::var("OUT_DIR").unwrap();
+    File::create(Path::new(&out_dir).join("units.rs")).and_then(|mut file| file.write_all(table.as_bytes()))
+        .expect("could not write the unit table");
+    File::create(Path::new(&out_dir).join("names.fst")).and_then(|mut file| file.write_all(names_fst.as_bytes()))
+        .expect("could not write the names dictionary");
+}
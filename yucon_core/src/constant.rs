@@ -0,0 +1,121 @@
+/* constant.rs
+ * ===
+ * Conversions between units of the static table resolved during constant evaluation, for
+ * the factor! and yucon! macros. Unknown aliases and mismatched types are compile errors.
+ * Only unprefixed units are supported.
+ *
+ * This file is a part of:
+ *
+ * Yucon - General Purpose Unit Converter
+ * Copyright (C) 2016-2017  Blaine Murphy
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use ::convert::Factors;
+use ::table::{bytes_eq, const_lookup};
+
+/* struct ConstPlan
+ *
+ * Description: a conversion between two units, resolved at compile time
+ */
+#[derive(Debug, Copy, Clone)]
+pub struct ConstPlan
+{
+    pub from: Factors,
+    pub to: Factors,
+}
+
+impl ConstPlan
+{
+    /* Resolves two units by name or alias. See table::const_lookup for how
+     * names are given.
+     */
+    pub const fn between(from: &str, to: &str) -> ConstPlan
+    {
+        let from = const_lookup(from);
+        let to = const_lookup(to);
+        let from_type = from.unit_type.as_bytes();
+
+        if !bytes_eq(to.unit_type.as_bytes(), from_type, 0, from_type.len())
+        {
+            panic!("yucon: input and output units are of different types");
+        }
+
+        ConstPlan { from: from.factors, to: to.factors }
+    }
+
+    /* The number to multiply by to convert. Only linear conversions have one,
+     * ie neither unit has a zero point or is an inverse unit.
+     */
+    pub const fn factor(&self) -> f64
+    {
+        if self.from.inverse || self.to.inverse || self.from.zero_point != 0.0 || self.to.zero_point != 0.0
+        {
+            panic!("yucon: factor! needs a linear conversion; use yucon! for this one");
+        }
+
+        self.from.conv_factor / self.to.conv_factor
+    }
+
+    /* Converts a value. Stages S2 through S6 of convert::apply in the same
+     * order, so results agree with runtime conversions to the bit. No range
+     * check is made.
+     */
+    #[inline(always)]
+    pub const fn apply(&self, input: f64) -> f64
+    {
+        let mut output_val = input;
+
+        if self.from.inverse
+        {
+            output_val = 1.0 / output_val;
+        }
+
+        output_val *= self.from.conv_factor;
+        output_val += self.from.zero_point - self.to.zero_point;
+        output_val /= self.to.conv_factor;
+
+        if self.to.inverse
+        {
+            output_val = 1.0 / output_val;
+        }
+
+        output_val
+    }
+}
+
+/* Expands to the factor converting one unit into another, as a constant. Units
+ * are aliases or names as single tokens, or string literals for those that are
+ * not, eg factor!(in => mm) or factor!("fl oz" => mL).
+ */
+#[macro_export]
+macro_rules! factor {
+    ($from:tt => $to:tt) => {{
+        const FACTOR: f64 = $crate::constant::ConstPlan::between(stringify!($from), stringify!($to)).factor();
+        FACTOR
+    }};
+}
+
+/* Expands to a value converted from one unit into another. The arithmetic is
+ * inlined with the units' numbers as constants, so a literal value folds to a
+ * constant, eg yucon!(25.4 mm => in). Expressions are given in parentheses:
+ * yucon!((depth * 2.0) ft => m). Units are given as for factor!.
+ */
+#[macro_export]
+macro_rules! yucon {
+    ($value:tt $from:tt => $to:tt) => {{
+        const PLAN: $crate::constant::ConstPlan =
+            $crate::constant::ConstPlan::between(stringify!($from), stringify!($to));
+        PLAN.apply($value as f64)
+    }};
+}
@@ -0,0 +1,154 @@
+/* convert.rs
+ * ===
+ * The arithmetic of a unit conversion. A conversion runs in stages:
+ *
+ *   S1 - scale the input by the input unit's prefix
+ *   S2 - invert the value if the input unit is an inverse unit
+ *   S3 - multiply by the input unit's conversion factor, giving the base unit
+ *   S4 - shift by the difference of the zero points
+ *   S5 - divide by the output unit's conversion factor
+ *   S6 - invert the value if the output unit is an inverse unit
+ *   S7 - scale by the output unit's prefix
+ *
+ * The order of the operations is significant; changing it changes results in the last bit.
+ * The stages are carried out by the kernels of kernel.rs, which skip the ones a given pair
+ * of units does not need.
+ *
+ * This file is a part of:
+ *
+ * Yucon - General Purpose Unit Converter
+ * Copyright (C) 2016-2017  Blaine Murphy
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use ::kernel::Kernel;
+use ::prefix::prefix_scale;
+use ::table::{StaticUnit, lookup};
+
+#[derive(Debug, Copy, Clone, PartialEq)]
+pub enum ConversionError
+{
+    OutOfRange(bool),   // input or output value not a valid f64, false: input
+    UnitNotFound(bool), // the unit was not found, false: input
+    TypeMismatch,       // the units' types disagree, ie volume into length
+}
+pub const INPUT: bool = false;
+pub const OUTPUT: bool = true;
+
+/* struct Factors
+ *
+ * Description: the numbers describing a unit relative to the base unit of its
+ *   type. See units.cfg for their meaning.
+ */
+#[derive(Debug, Copy, Clone, PartialEq)]
+pub struct Factors
+{
+    pub conv_factor: f64,
+    pub zero_point: f64,
+    pub dimensions: u8,
+    pub inverse: bool,
+}
+
+// checks that a value is usable: NaN, INF, and subnormals are not but exactly 0 is
+fn in_range(value: f64) -> bool
+{
+    value.is_normal() || value == 0.0
+}
+
+// checks the input value of a conversion. see fn in_range
+pub fn check_input(input: f64) -> Result<(), ConversionError>
+{
+    if in_range(input) { Ok(()) } else { Err(ConversionError::OutOfRange(INPUT)) }
+}
+
+// checks the output value of a conversion. see fn in_range
+#[inline]
+pub fn check_output(output: f64) -> Result<f64, ConversionError>
+{
+    if in_range(output) { Ok(output) } else { Err(ConversionError::OutOfRange(OUTPUT)) }
+}
+
+/* Resolves the kernel converting between two units of the static table.
+ * Prefixes are given as their characters, or NO_PREFIX. Unrecognized prefixes
+ * are treated as missing units.
+ */
+pub fn resolve(from_prefix: char, from: &StaticUnit, to_prefix: char, to: &StaticUnit)
+    -> Result<Kernel<f64>, ConversionError>
+{
+    if from.unit_type != to.unit_type
+    {
+        return Err(ConversionError::TypeMismatch);
+    }
+
+    let from_scale = match prefix_scale(from_prefix, from.factors.dimensions)
+    {
+    Some(scale) => scale,
+    None => return Err(ConversionError::UnitNotFound(INPUT)),
+    };
+    let to_scale = match prefix_scale(to_prefix, to.factors.dimensions)
+    {
+    Some(scale) => scale,
+    None => return Err(ConversionError::UnitNotFound(OUTPUT)),
+    };
+
+    // f64 kernels always build
+    Ok(Kernel::new(from_scale, &from.factors, to_scale, &to.factors).unwrap())
+}
+
+// as fn resolve, looking the units up by name or alias
+pub fn resolve_named(from_prefix: char, from: &str, to_prefix: char, to: &str)
+    -> Result<Kernel<f64>, ConversionError>
+{
+    let from = match lookup(from)
+    {
+    Some(unit) => unit,
+    None => return Err(ConversionError::UnitNotFound(INPUT)),
+    };
+    let to = match lookup(to)
+    {
+    Some(unit) => unit,
+    None => return Err(ConversionError::UnitNotFound(OUTPUT)),
+    };
+
+    resolve(from_prefix, from, to_prefix, to)
+}
+
+/* Converts a value between two units of the static table. See fn resolve.
+ */
+pub fn convert(input: f64, from_prefix: char, from: &StaticUnit, to_prefix: char, to: &StaticUnit)
+    -> Result<f64, ConversionError>
+{
+    check_input(input)?;
+
+    let kernel = resolve(from_prefix, from, to_prefix, to)?;
+
+    check_output(kernel.apply(input).unwrap())
+}
+
+// as fn convert, looking the units up by name or alias
+pub fn convert_named(input: f64, from_prefix: char, from: &str, to_prefix: char, to: &str)
+    -> Result<f64, ConversionError>
+{
+    let from = match lookup(from)
+    {
+    Some(unit) => unit,
+    None => return Err(ConversionError::UnitNotFound(INPUT)),
+    };
+    let to = match lookup(to)
+    {
+    Some(unit) => unit,
+    None => return Err(ConversionError::UnitNotFound(OUTPUT)),
+    };
+
+    convert(input, from_prefix, from, to_prefix, to)
+}
@@ -0,0 +1,305 @@
+/* exact.rs
+ * ===
+ * Exact conversion of integer counts. A count n stands for n * scale of a unit, eg counts
+ * of micrometres are a scale of 1e-6 with metres. Conversions use the exact rational values
+ * of the units' decimal conv_factor and zero_point literals, so the only inexact step is the
+ * final rounding to an integer, made as chosen by Rounding.
+ *
+ * Linear and affine conversions reduce to m = round((n * P + Q) / D) for integers P, Q, and
+ * D fixed by the plan. When P fits 64 bits no product can overflow 128 bits, and the loop
+ * over a slice is straight-line integer arithmetic; when D is 1 it has no division either.
+ * Conversions with inverse units go through the Ratio kernel value by value instead.
+ *
+ * This file is a part of:
+ *
+ * Yucon - General Purpose Unit Converter
+ * Copyright (C) 2016-2017  Blaine Murphy
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use ::kernel::{Kernel, PlanKind, Ratio, Scalar};
+
+/* enum Rounding
+ *
+ * Description: how a result between two integers is rounded
+ */
+#[derive(Debug, Copy, Clone, PartialEq, Eq)]
+pub enum Rounding
+{
+    HalfEven, // to nearest, ties to even
+    HalfAway, // to nearest, ties away from zero
+    Floor,
+    Ceiling,
+    Zero,     // truncate
+}
+
+impl Rounding
+{
+    // parses the name used on the command line
+    pub fn from_name(name: &str) -> Option<Rounding>
+    {
+        match name
+        {
+        "even" => Some(Rounding::HalfEven),
+        "away" => Some(Rounding::HalfAway),
+        "floor" => Some(Rounding::Floor),
+        "ceil" => Some(Rounding::Ceiling),
+        "zero" => Some(Rounding::Zero),
+        _ => None,
+        }
+    }
+}
+
+/* Divides num by a positive den, rounding the quotient as given.
+ */
+#[inline(always)]
+pub fn div_round(num: i128, den: i128, rounding: Rounding) -> i128
+{
+    let quot = num / den;
+    let rem = num % den;
+
+    if rem == 0
+    {
+        return quot;
+    }
+
+    // the direction of the true quotient away from the truncated one
+    let away = if num < 0 { -1 } else { 1 };
+
+    match rounding
+    {
+    Rounding::Zero => quot,
+    Rounding::Floor => if away < 0 { quot - 1 } else { quot },
+    Rounding::Ceiling => if away > 0 { quot + 1 } else { quot },
+    Rounding::HalfAway | Rounding::HalfEven => {
+        // compares the remainder to half of den without overflow
+        let rem = rem.abs();
+        let rest = den - rem;
+        if rem > rest || (rem == rest && (rounding == Rounding::HalfAway || quot & 1 != 0))
+        {
+            quot + away
+        }
+        else
+        {
+            quot
+        }
+    },
+    }
+}
+
+/* struct ExactFactors
+ *
+ * Description: the exact values of a unit's conv_factor and zero_point
+ */
+#[derive(Debug, Copy, Clone)]
+pub struct ExactFactors
+{
+    pub conv_factor: Ratio,
+    pub zero_point: Ratio,
+    pub inverse: bool,
+}
+
+#[derive(Debug, Copy, Clone)]
+enum Method
+{
+    Wide { p: i128, q: i128, d: i128 },    // n * P cannot overflow
+    Checked { p: i128, q: i128, d: i128 }, // it can; check every product
+    Rational(Kernel<Ratio>),
+}
+
+/* struct IntPlan
+ *
+ * Description: an exact conversion of integer counts between two units
+ */
+#[derive(Debug, Copy, Clone)]
+pub struct IntPlan
+{
+    method: Method,
+    rounding: Rounding,
+}
+
+const P_LIMIT: i128 = i64::max_value() as i128;
+const Q_LIMIT: i128 = 1 << 125;
+
+impl IntPlan
+{
+    /* Plans the conversion. The prefix scales are those of the units' prefixes,
+     * see prefix::prefix_exponent, and count_scale is the value of one count
+     * on both sides. None if the numbers involved do not fit 128 bits.
+     */
+    pub fn new(from_scale: Ratio, from: &ExactFactors, to_scale: Ratio, to: &ExactFactors,
+        count_scale: Ratio, rounding: Rounding) -> Option<IntPlan>
+    {
+        let offset = from.zero_point.add(to.zero_point.mul(Ratio::from_int(-1))?)?;
+
+        if from.inverse || to.inverse
+        {
+            let kind = match (from.inverse, to.inverse)
+            {
+            (true, true) => PlanKind::BothInverse,
+            (true, false) => PlanKind::FromInverse,
+            _ => PlanKind::ToInverse,
+            };
+            let kernel = Kernel::from_parts(kind, from_scale.mul(count_scale)?, from.conv_factor, offset,
+                                            to.conv_factor, to_scale.mul(count_scale)?);
+
+            return Some(IntPlan { method: Method::Rational(kernel), rounding: rounding });
+        }
+
+        // m = n * A + B
+        let out_scale = to.conv_factor.mul(to_scale)?;
+        let a = from_scale.mul(from.conv_factor)?.div(out_scale)?;
+        let b = offset.div(out_scale.mul(count_scale)?)?;
+
+        let d = (a.denom() / gcd(a.denom(), b.denom())).checked_mul(b.denom())?;
+        let p = a.numer().checked_mul(d / a.denom())?;
+        let q = b.numer().checked_mul(d / b.denom())?;
+
+        let method = if p.abs() <= P_LIMIT && q.abs() <= Q_LIMIT
+        {
+            Method::Wide { p: p, q: q, d: d }
+        }
+        else
+        {
+            Method::Checked { p: p, q: q, d: d }
+        };
+
+        Some(IntPlan { method: method, rounding: rounding })
+    }
+
+    /* Converts a count. None if the exact result does not fit 128 bits; the
+     * caller checks it against its own integer type.
+     */
+    #[inline]
+    pub fn apply(&self, count: i64) -> Option<i128>
+    {
+        match self.method
+        {
+        Method::Wide { p, q, d } => Some(div_round(count as i128 * p + q, d, self.rounding)),
+        Method::Checked { p, q, d } => {
+            let num = (count as i128).checked_mul(p)?.checked_add(q)?;
+            Some(div_round(num, d, self.rounding))
+        },
+        Method::Rational(ref kernel) => {
+            let result = kernel.apply(Ratio::from_int(count as i128))?;
+            Some(div_round(result.numer(), result.denom(), self.rounding))
+        },
+        }
+    }
+
+    /* Converts every count of inputs into the matching element of outputs.
+     * The method is chosen once for the slice.
+     */
+    pub fn apply_all(&self, inputs: &[i64], outputs: &mut [Option<i128>])
+    {
+        match self.method
+        {
+        Method::Wide { p, q, d } if d == 1 => {
+            for (output, input) in outputs.iter_mut().zip(inputs.iter())
+            {
+                *output = Some(*input as i128 * p + q);
+            }
+        },
+        Method::Wide { p, q, d } => {
+            let rounding = self.rounding;
+            for (output, input) in outputs.iter_mut().zip(inputs.iter())
+            {
+                *output = Some(div_round(*input as i128 * p + q, d, rounding));
+            }
+        },
+        _ => {
+            for (output, input) in outputs.iter_mut().zip(inputs.iter())
+            {
+                *output = self.apply(*input);
+            }
+        },
+        }
+    }
+}
+
+fn gcd(mut a: i128, mut b: i128) -> i128
+{
+    while b != 0
+    {
+        let rem = a % b;
+        a = b;
+        b = rem;
+    }
+
+    if a < 0 { -a } else { a }
+}
+
+#[cfg(test)]
+mod tests
+{
+    use super::*;
+
+    const MODES: [Rounding; 5] = [Rounding::HalfEven, Rounding::HalfAway, Rounding::Floor, Rounding::Ceiling, Rounding::Zero];
+
+    #[test]
+    fn div_round_rounds_by_mode()
+    {
+        // num, den, then the result for each of MODES
+        let cases: [(i128, i128, [i128; 5]); 14] = [
+            (6, 3, [2, 2, 2, 2, 2]),
+            (-6, 3, [-2, -2, -2, -2, -2]),
+            (0, 7, [0, 0, 0, 0, 0]),
+            (7, 2, [4, 4, 3, 4, 3]),
+            (5, 2, [2, 3, 2, 3, 2]),
+            (-5, 2, [-2, -3, -3, -2, -2]),
+            (-7, 2, [-4, -4, -4, -3, -3]),
+            (1, 2, [0, 1, 0, 1, 0]),
+            (-1, 2, [0, -1, -1, 0, 0]),
+            (7, 3, [2, 2, 2, 3, 2]),
+            (8, 3, [3, 3, 2, 3, 2]),
+            (-7, 3, [-2, -2, -3, -2, -2]),
+            (-8, 3, [-3, -3, -3, -2, -2]),
+            (i128::max_value(), 2, [1 << 126, 1 << 126, (1 << 126) - 1, 1 << 126, (1 << 126) - 1]),
+        ];
+
+        for &(num, den, expected) in cases.iter()
+        {
+            for (mode, &result) in MODES.iter().zip(expected.iter())
+            {
+                assert_eq!(div_round(num, den, *mode), result, "{} / {} by {:?}", num, den, mode);
+            }
+        }
+    }
+
+    #[test]
+    fn div_round_matches_exact_comparison()
+    {
+        for num in -60..61
+        {
+            for den in 1..12
+            {
+                // floor of the quotient and twice the remainder over it, to compare against den
+                let floor = if num % den < 0 { num / den - 1 } else { num / den };
+                let twice = 2 * (num - floor * den);
+                let exact = twice == 0;
+
+                let even = if twice > den || (twice == den && floor & 1 != 0) { floor + 1 } else { floor };
+                let away = if twice == den { if num < 0 { floor } else { floor + 1 } }
+                           else if twice > den { floor + 1 } else { floor };
+                let ceiling = if exact { floor } else { floor + 1 };
+                let zero = if num < 0 { ceiling } else { floor };
+
+                assert_eq!(div_round(num, den, Rounding::HalfEven), even, "{} / {}", num, den);
+                assert_eq!(div_round(num, den, Rounding::HalfAway), away, "{} / {}", num, den);
+                assert_eq!(div_round(num, den, Rounding::Floor), floor, "{} / {}", num, den);
+                assert_eq!(div_round(num, den, Rounding::Ceiling), ceiling, "{} / {}", num, den);
+                assert_eq!(div_round(num, den, Rounding::Zero), zero, "{} / {}", num, den);
+            }
+        }
+    }
+}
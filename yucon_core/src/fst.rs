@@ -0,0 +1,250 @@
+/* fst.rs
+ * ===
+ * Reads a compact, read-only dictionary from names to indices, built as a minimized acyclic
+ * finite state transducer by src/runtime/units/fst.rs. Names sharing a beginning share the
+ * states for it and names sharing an ending share the states for that too. The index of a
+ * name is the sum of the outputs along its path.
+ *
+ * The whole dictionary is a single buffer of bytes, so it may be kept in a file or compiled
+ * into a program as is, and read in place: neither lookup nor listing allocates. States are
+ * written after the states they lead to, each as:
+ *
+ *   flags (u8, bit 0: a name ends here) [final output] count { byte output distance }*
+ *
+ * where the numbers are LEB128 and distance is how far back the next state begins. The
+ * buffer ends with a trailer of the address of the first state, the number of names, and the
+ * length of the longest name, each a little endian u64.
+ *
+ * This file is a part of:
+ *
+ * Yucon - General Purpose Unit Converter
+ * Copyright (C) 2016-2017  Blaine Murphy
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+pub const FINAL: u8 = 1;
+pub const TRAILER: usize = 24;
+
+fn read_varint(bytes: &[u8], pos: &mut usize) -> u64
+{
+    let mut value = 0;
+    let mut shift = 0;
+
+    loop
+    {
+        let byte = bytes[*pos];
+        *pos += 1;
+        value |= ((byte & 0x7f) as u64) << shift;
+
+        if byte & 0x80 == 0
+        {
+            return value;
+        }
+        shift += 7;
+    }
+}
+
+fn read_u64(bytes: &[u8], pos: usize) -> u64
+{
+    let mut value = 0;
+
+    for offset in 0..8
+    {
+        value |= (bytes[pos + offset] as u64) << (8 * offset);
+    }
+
+    value
+}
+
+/* struct Fst
+ *
+ * Description: a dictionary read in place from its bytes. See the top of the
+ *   file for their layout.
+ */
+#[derive(Debug, Clone, Copy)]
+pub struct Fst<'a>
+{
+    bytes: &'a [u8],
+    root: usize,
+    count: usize,
+    longest: usize,
+}
+
+// a state as read from the buffer, positioned at its first transition
+struct StateReader
+{
+    address: usize,
+    is_final: bool,
+    final_output: u32,
+    transitions: usize,
+    pos: usize,
+}
+
+impl<'a> Fst<'a>
+{
+    /* Reads a dictionary from the bytes written by a Builder. Fails if they
+     * are too short for the trailer or the first state is not within them.
+     */
+    pub fn from_bytes(bytes: &'a [u8]) -> Option<Fst<'a>>
+    {
+        if bytes.len() < TRAILER
+        {
+            return None;
+        }
+
+        let states = bytes.len() - TRAILER;
+        let root = read_u64(bytes, states) as usize;
+
+        if root >= states
+        {
+            return None;
+        }
+
+        Some(Fst {
+            bytes: bytes,
+            root: root,
+            count: read_u64(bytes, states + 8) as usize,
+            longest: read_u64(bytes, states + 16) as usize,
+        })
+    }
+
+    pub fn as_bytes(&self) -> &'a [u8]
+    {
+        self.bytes
+    }
+
+    // the number of names
+    pub fn len(&self) -> usize
+    {
+        self.count
+    }
+
+    // the length of the longest name, which a buffer for starting_with needs to hold every name
+    pub fn longest(&self) -> usize
+    {
+        self.longest
+    }
+
+    fn state(&self, address: usize) -> StateReader
+    {
+        let mut pos = address;
+        let is_final = self.bytes[pos] & FINAL != 0;
+        pos += 1;
+
+        let final_output = if is_final { read_varint(self.bytes, &mut pos) as u32 } else { 0 };
+        let transitions = read_varint(self.bytes, &mut pos) as usize;
+
+        StateReader {
+            address: address,
+            is_final: is_final,
+            final_output: final_output,
+            transitions: transitions,
+            pos: pos,
+        }
+    }
+
+    // reads the next transition of a state: its byte, output, and next state
+    fn transition(&self, state: &mut StateReader) -> (u8, u32, usize)
+    {
+        let byte = self.bytes[state.pos];
+        state.pos += 1;
+        let output = read_varint(self.bytes, &mut state.pos) as u32;
+        let target = state.address - read_varint(self.bytes, &mut state.pos) as usize;
+
+        (byte, output, target)
+    }
+
+    // follows a path of bytes from the first state. the state reached and the outputs so far
+    fn walk(&self, path: &[u8]) -> Option<(usize, u32)>
+    {
+        let mut address = self.root;
+        let mut output = 0u32;
+
+        for byte in path.iter()
+        {
+            let mut state = self.state(address);
+            let mut next = None;
+
+            for _ in 0..state.transitions
+            {
+                let (label, label_output, target) = self.transition(&mut state);
+
+                // transitions are written in byte order
+                if label >= *byte
+                {
+                    if label == *byte
+                    {
+                        next = Some((target, label_output));
+                    }
+                    break;
+                }
+            }
+
+            let (target, label_output) = next?;
+            address = target;
+            output += label_output;
+        }
+
+        Some((address, output))
+    }
+
+    // the index of a name, if it is in the dictionary
+    pub fn get(&self, name: &[u8]) -> Option<u32>
+    {
+        let (address, output) = self.walk(name)?;
+        let state = self.state(address);
+
+        if state.is_final { Some(output + state.final_output) } else { None }
+    }
+
+    /* Calls 'found' with every name beginning with 'prefix' and its index, in
+     * byte order, as for completing a name. Names are spelled out in 'name',
+     * and those longer than it are left out; see longest().
+     */
+    pub fn starting_with<F>(&self, prefix: &[u8], name: &mut [u8], mut found: F) where F: FnMut(&[u8], u32)
+    {
+        if prefix.len() > name.len()
+        {
+            return;
+        }
+
+        if let Some((address, output)) = self.walk(prefix)
+        {
+            name[..prefix.len()].copy_from_slice(prefix);
+            self.collect(address, output, name, prefix.len(), &mut found);
+        }
+    }
+
+    fn collect<F>(&self, address: usize, output: u32, name: &mut [u8], len: usize, found: &mut F)
+        where F: FnMut(&[u8], u32)
+    {
+        let mut state = self.state(address);
+
+        if state.is_final
+        {
+            found(&name[..len], output + state.final_output);
+        }
+
+        if len == name.len()
+        {
+            return;
+        }
+
+        for _ in 0..state.transitions
+        {
+            let (byte, label_output, target) = self.transition(&mut state);
+            name[len] = byte;
+            self.collect(target, output + label_output, name, len + 1, found);
+        }
+    }
+}
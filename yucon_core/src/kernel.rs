@@ -0,0 +1,180 @@
+/* kernel.rs
+ * ===
+ * Conversion kernels. A resolved pair of units is classified once into a PlanKind naming
+ * which of the stages of a conversion it needs (see convert.rs), and each kind has its own
+ * straight-line kernel. Kernels are generic over the number type and so are specialized at
+ * compile time for each of f64 and the exact Ratio. Converting a slice dispatches on
+ * the kind once, outside the loop, leaving no per-value branches.
+ *
+ * This file is a part of:
+ *
+ * Yucon - General Purpose Unit Converter
+ * Copyright (C) 2016-2017  Blaine Murphy
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use ::convert::Factors;
+pub use ::scalar::{Ratio, Scalar};
+
+/* enum PlanKind
+ *
+ * Description: which stages a conversion needs. Linear conversions only scale;
+ *   affine ones also shift by the difference of the zero points. The inverse
+ *   kinds are used whenever either unit is an inverse unit, zero points or not.
+ */
+#[derive(Debug, Copy, Clone, PartialEq, Eq)]
+pub enum PlanKind
+{
+    Linear,
+    Affine,
+    FromInverse,
+    ToInverse,
+    BothInverse,
+}
+
+impl PlanKind
+{
+    pub fn classify(from: &Factors, to: &Factors) -> PlanKind
+    {
+        match (from.inverse, to.inverse)
+        {
+        (true, true) => PlanKind::BothInverse,
+        (true, false) => PlanKind::FromInverse,
+        (false, true) => PlanKind::ToInverse,
+        (false, false) if from.zero_point - to.zero_point != 0.0 => PlanKind::Affine,
+        (false, false) => PlanKind::Linear,
+        }
+    }
+}
+
+/* struct Kernel
+ *
+ * Description: the numbers of a resolved conversion in a given number type,
+ *   with its kind.
+ */
+#[derive(Debug, Copy, Clone)]
+pub struct Kernel<T: Scalar>
+{
+    pub kind: PlanKind,
+    from_scale: T,  // S1
+    from_factor: T, // S3
+    offset: T,      // S4
+    to_factor: T,   // S5
+    to_scale: T,    // S7
+}
+
+// the kernel of each kind. stages not listed are skipped
+#[inline(always)]
+fn linear<T: Scalar>(k: &Kernel<T>, x: T) -> Option<T>
+{
+    x.mul(k.from_scale)?.mul(k.from_factor)?.div(k.to_factor)?.div(k.to_scale)
+}
+
+#[inline(always)]
+fn affine<T: Scalar>(k: &Kernel<T>, x: T) -> Option<T>
+{
+    x.mul(k.from_scale)?.mul(k.from_factor)?.add(k.offset)?.div(k.to_factor)?.div(k.to_scale)
+}
+
+#[inline(always)]
+fn from_inverse<T: Scalar>(k: &Kernel<T>, x: T) -> Option<T>
+{
+    T::one().div(x.mul(k.from_scale)?)?.mul(k.from_factor)?.add(k.offset)?.div(k.to_factor)?.div(k.to_scale)
+}
+
+#[inline(always)]
+fn to_inverse<T: Scalar>(k: &Kernel<T>, x: T) -> Option<T>
+{
+    T::one().div(x.mul(k.from_scale)?.mul(k.from_factor)?.add(k.offset)?.div(k.to_factor)?)?.div(k.to_scale)
+}
+
+#[inline(always)]
+fn both_inverse<T: Scalar>(k: &Kernel<T>, x: T) -> Option<T>
+{
+    let base = T::one().div(x.mul(k.from_scale)?)?.mul(k.from_factor)?.add(k.offset)?.div(k.to_factor)?;
+    T::one().div(base)?.div(k.to_scale)
+}
+
+// runs one kernel over a slice. a function per kind and type after inlining
+#[inline(always)]
+fn run<T: Scalar, F>(k: &Kernel<T>, inputs: &[T], outputs: &mut [Option<T>], kernel: F)
+    where F: Fn(&Kernel<T>, T) -> Option<T>
+{
+    for (output, input) in outputs.iter_mut().zip(inputs.iter())
+    {
+        *output = kernel(k, *input);
+    }
+}
+
+impl<T: Scalar> Kernel<T>
+{
+    /* Builds the kernel converting between two units with the given prefix
+     * scales. None if a number does not fit the type.
+     */
+    pub fn new(from_scale: f64, from: &Factors, to_scale: f64, to: &Factors) -> Option<Kernel<T>>
+    {
+        Some(Kernel {
+            kind: PlanKind::classify(from, to),
+            from_scale: T::from_f64(from_scale)?,
+            from_factor: T::from_f64(from.conv_factor)?,
+            offset: T::from_f64(from.zero_point - to.zero_point)?,
+            to_factor: T::from_f64(to.conv_factor)?,
+            to_scale: T::from_f64(to_scale)?,
+        })
+    }
+
+    // as fn new, with the numbers already in the kernel's type
+    pub const fn from_parts(kind: PlanKind, from_scale: T, from_factor: T, offset: T, to_factor: T, to_scale: T)
+        -> Kernel<T>
+    {
+        Kernel {
+            kind: kind,
+            from_scale: from_scale,
+            from_factor: from_factor,
+            offset: offset,
+            to_factor: to_factor,
+            to_scale: to_scale,
+        }
+    }
+
+    /* Converts a single value. Floats always give Some; range checks are left
+     * to the caller.
+     */
+    #[inline]
+    pub fn apply(&self, input: T) -> Option<T>
+    {
+        match self.kind
+        {
+        PlanKind::Linear => linear(self, input),
+        PlanKind::Affine => affine(self, input),
+        PlanKind::FromInverse => from_inverse(self, input),
+        PlanKind::ToInverse => to_inverse(self, input),
+        PlanKind::BothInverse => both_inverse(self, input),
+        }
+    }
+
+    /* Converts every value of inputs into the matching element of outputs,
+     * choosing the kernel once for the whole slice.
+     */
+    pub fn apply_all(&self, inputs: &[T], outputs: &mut [Option<T>])
+    {
+        match self.kind
+        {
+        PlanKind::Linear => run(self, inputs, outputs, linear),
+        PlanKind::Affine => run(self, inputs, outputs, affine),
+        PlanKind::FromInverse => run(self, inputs, outputs, from_inverse),
+        PlanKind::ToInverse => run(self, inputs, outputs, to_inverse),
+        PlanKind::BothInverse => run(self, inputs, outputs, both_inverse),
+        }
+    }
+}
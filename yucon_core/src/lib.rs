@@ -0,0 +1,42 @@
+/* lib.rs
+ * ===
+ * Yucon's conversion core. Holds the arithmetic of a unit conversion, the metric prefix
+ * table, and a read-only table of the default units compiled from cfg/units.cfg. It uses
+ * neither the standard library nor the heap so that it may be built into firmware and other
+ * tools without an allocator, and so the conversion hot path can never allocate.
+ *
+ * The factor! and yucon! macros resolve conversions between the default units at compile
+ * time. See constant.rs. Conversions may be composed into other iterators lazily, a block at
+ * a time. See stream.rs.
+ *
+ * Config loading, the interpreter, and everything else that needs std live in the yucon
+ * crate on top of this one.
+ *
+ * This file is a part of:
+ *
+ * Yucon - General Purpose Unit Converter
+ * Copyright (C) 2016-2017  Blaine Murphy
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#![no_std]
+
+pub mod constant;
+pub mod convert;
+pub mod exact;
+pub mod fst;
+pub mod kernel;
+pub mod prefix;
+pub mod scalar;
+pub mod stream;
+pub mod table;
@@ -0,0 +1,179 @@
+/* prefix.rs
+ * ===
+ * Metric prefixes and their values.
+ *
+ * This file is a part of:
+ *
+ * Yucon - General Purpose Unit Converter
+ * Copyright (C) 2016-2017  Blaine Murphy
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+pub const NO_PREFIX: char = '\0';
+
+// stands in for the prefix of an output unit that is chosen for each value
+pub const AUTO_PREFIX: char = '*';
+
+// prefixes a power of one thousand apart, smallest first. yocto is at index 0
+static ENGINEERING: [char; 17] = ['y', 'z', 'a', 'f', 'p', 'n', 'u', 'm', NO_PREFIX,
+                                  'k', 'M', 'G', 'T', 'P', 'E', 'Z', 'Y'];
+
+pub fn prefix_as_num(prefix: char) -> Option<f64>
+{
+    let num: f64 = match prefix
+    {
+    'Y' => 1.0e24,
+    'Z' => 1.0e21,
+    'E' => 1.0e18,
+    'P' => 1.0e15,
+    'T' => 1.0e12,
+    'G' => 1.0e9,
+    'M' => 1.0e6,
+    'k' => 1.0e3,
+    'h' => 1.0e2,
+    'D' => 1.0e1,
+    NO_PREFIX => 1.0,
+    'd' => 1.0e-1,
+    'c' => 1.0e-2,
+    'm' => 1.0e-3,
+    'u' => 1.0e-6,
+    'n' => 1.0e-9,
+    'p' => 1.0e-12,
+    'f' => 1.0e-15,
+    'a' => 1.0e-18,
+    'z' => 1.0e-21,
+    'y' => 1.0e-24,
+    _   => return None, // default
+    };
+
+    Some(num)
+}
+
+// the power of ten of a prefix, eg -3 for milli. None if it is not recognized
+pub fn prefix_exponent(prefix: char) -> Option<i32>
+{
+    let exp = match prefix
+    {
+    'Y' => 24,
+    'Z' => 21,
+    'E' => 18,
+    'P' => 15,
+    'T' => 12,
+    'G' => 9,
+    'M' => 6,
+    'k' => 3,
+    'h' => 2,
+    'D' => 1,
+    NO_PREFIX => 0,
+    'd' => -1,
+    'c' => -2,
+    'm' => -3,
+    'u' => -6,
+    'n' => -9,
+    'p' => -12,
+    'f' => -15,
+    'a' => -18,
+    'z' => -21,
+    'y' => -24,
+    _   => return None,
+    };
+
+    Some(exp)
+}
+
+/* Returns the scale a prefix applies to a unit of the given dimensions, eg
+ * 1e-6 for a milli prefixed square unit. None if the prefix is not recognized.
+ */
+pub fn prefix_scale(prefix: char, dimensions: u8) -> Option<f64>
+{
+    match prefix_as_num(prefix)
+    {
+    Some(num) => Some(powi(num, dimensions as i32)),
+    None => None,
+    }
+}
+
+/* Raises a number to an integer power. f64::powi lives in std, so this is the
+ * same square-and-multiply the compiler's runtime library uses for it, giving
+ * bit-identical results.
+ */
+pub fn powi(mut base: f64, exp: i32) -> f64
+{
+    let recip = exp < 0;
+    let mut exp = exp;
+    let mut result = 1.0;
+
+    loop
+    {
+        if exp & 1 != 0
+        {
+            result *= base;
+        }
+
+        exp /= 2;
+
+        if exp == 0
+        {
+            break;
+        }
+
+        base *= base;
+    }
+
+    if recip { 1.0 / result } else { result }
+}
+
+/* Picks the prefix a power of one thousand apart which scales a value of a unit
+ * of the given dimensions into [1, 1000^dimensions), ie [1, 1000) for plain
+ * units. Values past yotta or yocto take those prefixes. Zero and values which
+ * are not normal take no prefix.
+ *
+ * The decimal exponent is estimated from the binary exponent of the value,
+ * floor(e2 * log10(2)) computed in fixed point, which is never more than one
+ * below the true exponent. The scales of the prefixes are rounded powers of ten,
+ * so the estimate is corrected by comparing against the scale of the prefix it
+ * gives and the next one up rather than searched for. Within rounding of a
+ * boundary the quotient may still come out as exactly 1000^dimensions, where the
+ * next prefix up would give just under 1.
+ */
+pub fn best_prefix(value: f64, dimensions: u8) -> char
+{
+    let magnitude = value.abs();
+
+    if !magnitude.is_normal() || dimensions == 0
+    {
+        return NO_PREFIX;
+    }
+
+    let exp2 = ((magnitude.to_bits() >> 52) & 0x7ff) as i32 - 1023;
+    // 78913 / 2^18 is log10(2) to within 1e-6, exact enough for |e2| < 1100
+    let exp10 = (exp2 * 78913) >> 18;
+    let step = 3 * dimensions as i32;
+
+    // floored division, then clamped to the index range of the table
+    let mut index = exp10 / step - ((exp10 % step < 0) as i32) + 8;
+    index = if index < 0 { 0 } else if index > 16 { 16 } else { index };
+
+    if index > 0
+    {
+        let scale = prefix_scale(ENGINEERING[index as usize], dimensions).unwrap();
+        index -= (magnitude < scale) as i32;
+    }
+    if index < 16
+    {
+        let next = prefix_scale(ENGINEERING[(index + 1) as usize], dimensions).unwrap();
+        index += (magnitude >= next) as i32;
+    }
+
+    ENGINEERING[index as usize]
+}
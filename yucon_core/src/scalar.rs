@@ -0,0 +1,283 @@
+/* scalar.rs
+ * ===
+ * The number types conversion kernels run on: f64, and Ratio, an exact rational used for
+ * integer conversions and for the exact values of the decimal literals in units.cfg. It
+ * uses nothing but core, so build.rs includes it as well to compute factors the same way the
+ * runtime does.
+ *
+ * This file is a part of:
+ *
+ * Yucon - General Purpose Unit Converter
+ * Copyright (C) 2016-2017  Blaine Murphy
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use core::fmt;
+
+/* trait Scalar
+ *
+ * Description: a number type kernels can run on. Operations return None when
+ *   the result cannot be represented, which only happens for exact types;
+ *   floats report overflow as INF or NaN instead.
+ */
+pub trait Scalar: Copy
+{
+    fn one() -> Self;
+    fn from_f64(value: f64) -> Option<Self>;
+    fn to_f64(self) -> f64;
+    fn add(self, other: Self) -> Option<Self>;
+    fn mul(self, other: Self) -> Option<Self>;
+    fn div(self, other: Self) -> Option<Self>;
+}
+
+impl Scalar for f64
+{
+    #[inline(always)]
+    fn one() -> f64 { 1.0 }
+    #[inline(always)]
+    fn from_f64(value: f64) -> Option<f64> { Some(value) }
+    #[inline(always)]
+    fn to_f64(self) -> f64 { self }
+    #[inline(always)]
+    fn add(self, other: f64) -> Option<f64> { Some(self + other) }
+    #[inline(always)]
+    fn mul(self, other: f64) -> Option<f64> { Some(self * other) }
+    #[inline(always)]
+    fn div(self, other: f64) -> Option<f64> { Some(self / other) }
+}
+
+/* struct Ratio
+ *
+ * Description: an exact rational number, always in lowest terms with a
+ *   positive denominator. Arithmetic that would overflow gives None.
+ */
+#[derive(Debug, Copy, Clone, PartialEq, Eq)]
+pub struct Ratio
+{
+    num: i128,
+    den: i128,
+}
+
+fn gcd(mut a: i128, mut b: i128) -> i128
+{
+    while b != 0
+    {
+        let rem = a % b;
+        a = b;
+        b = rem;
+    }
+
+    if a < 0 { -a } else { a }
+}
+
+impl Ratio
+{
+    // None if the denominator is 0
+    pub fn new(num: i128, den: i128) -> Option<Ratio>
+    {
+        if den == 0
+        {
+            return None;
+        }
+
+        let divisor = gcd(num, den);
+        let (num, den) = (num / divisor, den / divisor);
+
+        if den < 0
+        {
+            Some(Ratio { num: num.checked_neg()?, den: den.checked_neg()? })
+        }
+        else
+        {
+            Some(Ratio { num: num, den: den })
+        }
+    }
+
+    pub fn from_int(value: i128) -> Ratio
+    {
+        Ratio { num: value, den: 1 }
+    }
+
+    // 10^exp. None if it does not fit
+    pub fn pow10(exp: i32) -> Option<Ratio>
+    {
+        let power = 10i128.checked_pow(exp.unsigned_abs())?;
+
+        if exp >= 0 { Some(Ratio::from_int(power)) } else { Ratio::new(1, power) }
+    }
+
+    /* Parses a decimal literal exactly, eg '25.4', '-273.15', or '1e-3'. None
+     * if it is malformed or does not fit.
+     */
+    pub fn from_decimal(text: &str) -> Option<Ratio>
+    {
+        let text = text.trim();
+        let (mantissa, exp) = match text.find(|ch| ch == 'e' || ch == 'E')
+        {
+        Some(at) => (&text[..at], text[at + 1..].parse::<i32>().ok()?),
+        None => (text, 0),
+        };
+        let (negative, mantissa) = match mantissa.as_bytes().first()
+        {
+        Some(&b'-') => (true, &mantissa[1..]),
+        Some(&b'+') => (false, &mantissa[1..]),
+        _ => (false, mantissa),
+        };
+
+        let mut num: i128 = 0;
+        let mut frac_digits: i32 = 0;
+        let mut seen_point = false;
+        let mut seen_digit = false;
+
+        for byte in mantissa.bytes()
+        {
+            match byte
+            {
+            b'0' ..= b'9' => {
+                num = num.checked_mul(10)?.checked_add((byte - b'0') as i128)?;
+                seen_digit = true;
+                if seen_point
+                {
+                    frac_digits += 1;
+                }
+            },
+            b'.' if !seen_point => seen_point = true,
+            _ => return None,
+            };
+        }
+
+        if !seen_digit
+        {
+            return None;
+        }
+        if negative
+        {
+            num = -num;
+        }
+
+        Ratio::from_int(num).mul(Ratio::pow10(exp.checked_sub(frac_digits)?)?)
+    }
+
+    pub fn numer(&self) -> i128
+    {
+        self.num
+    }
+
+    pub fn denom(&self) -> i128
+    {
+        self.den
+    }
+}
+
+impl Scalar for Ratio
+{
+    fn one() -> Ratio
+    {
+        Ratio { num: 1, den: 1 }
+    }
+
+    /* Every finite f64 is a binary fraction, m * 2^e. It is exact as a Ratio
+     * when both parts fit.
+     */
+    fn from_f64(value: f64) -> Option<Ratio>
+    {
+        if !value.is_finite()
+        {
+            return None;
+        }
+        if value == 0.0
+        {
+            return Some(Ratio { num: 0, den: 1 });
+        }
+
+        let bits = value.to_bits();
+        let sign: i128 = if bits >> 63 == 0 { 1 } else { -1 };
+        let biased_exp = ((bits >> 52) & 0x7ff) as i32;
+        let fraction = (bits & 0xf_ffff_ffff_ffff) as i128;
+        let (mantissa, exp) = if biased_exp == 0
+        {
+            (fraction, -1074)
+        }
+        else
+        {
+            (fraction | (1 << 52), biased_exp - 1075)
+        };
+
+        if exp >= 0
+        {
+            if exp > 126 - 53
+            {
+                return None;
+            }
+            Ratio::new(sign * (mantissa << exp), 1)
+        }
+        else
+        {
+            if -exp > 126
+            {
+                // the denominator does not fit unless the mantissa cancels enough of it
+                let shift = mantissa.trailing_zeros() as i32;
+                if -exp - shift > 126
+                {
+                    return None;
+                }
+                return Ratio::new(sign * (mantissa >> shift), 1 << (-exp - shift));
+            }
+            Ratio::new(sign * mantissa, 1 << -exp)
+        }
+    }
+
+    fn to_f64(self) -> f64
+    {
+        self.num as f64 / self.den as f64
+    }
+
+    fn add(self, other: Ratio) -> Option<Ratio>
+    {
+        let divisor = gcd(self.den, other.den);
+        let left = self.num.checked_mul(other.den / divisor)?;
+        let right = other.num.checked_mul(self.den / divisor)?;
+
+        Ratio::new(left.checked_add(right)?, (self.den / divisor).checked_mul(other.den)?)
+    }
+
+    fn mul(self, other: Ratio) -> Option<Ratio>
+    {
+        let cross_a = gcd(self.num, other.den).max(1);
+        let cross_b = gcd(other.num, self.den).max(1);
+        let num = (self.num / cross_a).checked_mul(other.num / cross_b)?;
+        let den = (self.den / cross_b).checked_mul(other.den / cross_a)?;
+
+        Ratio::new(num, den)
+    }
+
+    fn div(self, other: Ratio) -> Option<Ratio>
+    {
+        self.mul(Ratio::new(other.den, other.num)?)
+    }
+}
+
+impl fmt::Display for Ratio
+{
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result
+    {
+        if self.den == 1
+        {
+            write!(f, "{}", self.num)
+        }
+        else
+        {
+            write!(f, "{}/{}", self.num, self.den)
+        }
+    }
+}
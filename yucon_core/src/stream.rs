@@ -0,0 +1,182 @@
+/* stream.rs
+ * ===
+ * Lazy conversion for embedding. Converted wraps any iterator of values together with the
+ * kernel of a resolved pair of units (see fn resolve in convert.rs) and yields each value
+ * converted, with the same range checks as a single conversion. Nothing is collected: values
+ * are pulled from the wrapped iterator a block at a time into a fixed buffer and the block
+ * is run through the kernel's slice form, so the kernel is chosen once per block rather
+ * than once per value. Whole blocks may be taken at once with fn next_chunk.
+ *
+ * Values parses lines of text into values for Converted, eg the lines of a reader.
+ *
+ * This file is a part of:
+ *
+ * Yucon - General Purpose Unit Converter
+ * Copyright (C) 2016-2017  Blaine Murphy
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use core::f64;
+
+use ::convert::{ConversionError, check_input, check_output};
+use ::kernel::Kernel;
+
+// values converted together
+pub const BLOCK: usize = 64;
+
+/* struct Converted
+ *
+ * Description: an iterator converting the values of another. The block last
+ *   converted is held in 'results', of which 'next' is the first not yet taken.
+ */
+pub struct Converted<I>
+{
+    values: I,
+    kernel: Kernel<f64>,
+    inputs: [f64; BLOCK],
+    outputs: [Option<f64>; BLOCK],
+    results: [Result<f64, ConversionError>; BLOCK],
+    len: usize,
+    next: usize,
+}
+
+impl<I: Iterator<Item = f64>> Converted<I>
+{
+    pub fn new(values: I, kernel: Kernel<f64>) -> Converted<I>
+    {
+        Converted {
+            values: values,
+            kernel: kernel,
+            inputs: [0.0; BLOCK],
+            outputs: [None; BLOCK],
+            results: [Ok(0.0); BLOCK],
+            len: 0,
+            next: 0,
+        }
+    }
+
+    // pulls and converts the next block. false once the values have run out
+    fn refill(&mut self) -> bool
+    {
+        let mut len = 0;
+
+        while len < BLOCK
+        {
+            match self.values.next()
+            {
+            Some(value) => self.inputs[len] = value,
+            None => break,
+            };
+            len += 1;
+        }
+
+        self.kernel.apply_all(&self.inputs[..len], &mut self.outputs[..len]);
+
+        for index in 0..len
+        {
+            self.results[index] = check_input(self.inputs[index]).and_then(|_| check_output(self.outputs[index].unwrap()));
+        }
+
+        self.len = len;
+        self.next = 0;
+        len > 0
+    }
+
+    /* The rest of the block being taken, or the next whole block if it has all
+     * been taken. Values come out in order however they are taken. None once
+     * the values have run out.
+     */
+    pub fn next_chunk(&mut self) -> Option<&[Result<f64, ConversionError>]>
+    {
+        if self.next == self.len && !self.refill()
+        {
+            return None;
+        }
+
+        let start = self.next;
+        self.next = self.len;
+        Some(&self.results[start..self.len])
+    }
+}
+
+impl<I: Iterator<Item = f64>> Iterator for Converted<I>
+{
+    type Item = Result<f64, ConversionError>;
+
+    #[inline]
+    fn next(&mut self) -> Option<Result<f64, ConversionError>>
+    {
+        if self.next == self.len && !self.refill()
+        {
+            return None;
+        }
+
+        self.next += 1;
+        Some(self.results[self.next - 1])
+    }
+
+    fn size_hint(&self) -> (usize, Option<usize>)
+    {
+        let (low, high) = self.values.size_hint();
+        let held = self.len - self.next;
+        (low.saturating_add(held), high.and_then(|high| high.checked_add(held)))
+    }
+}
+
+/* struct Values
+ *
+ * Description: an iterator parsing lines of text, one value each. Space around
+ *   a value is ignored. A line that is not a number gives NaN, which converts
+ *   to an error for the input, so results stay line for line with the text.
+ */
+pub struct Values<I>
+{
+    lines: I,
+}
+
+impl<I, S> Iterator for Values<I> where I: Iterator<Item = S>, S: AsRef<str>
+{
+    type Item = f64;
+
+    #[inline]
+    fn next(&mut self) -> Option<f64>
+    {
+        self.lines.next().map(|line| line.as_ref().trim().parse::<f64>().unwrap_or(f64::NAN))
+    }
+
+    fn size_hint(&self) -> (usize, Option<usize>)
+    {
+        self.lines.size_hint()
+    }
+}
+
+// parses lines of text into values. see struct Values
+pub fn values<I, S>(lines: I) -> Values<I> where I: Iterator<Item = S>, S: AsRef<str>
+{
+    Values { lines: lines }
+}
+
+/* trait Convert
+ *
+ * Description: adds fn converted to every iterator of values, eg
+ *   'readings.iter().cloned().converted(kernel)'.
+ */
+pub trait Convert: Iterator<Item = f64> + Sized
+{
+    fn converted(self, kernel: Kernel<f64>) -> Converted<Self>
+    {
+        Converted::new(self, kernel)
+    }
+}
+
+impl<I: Iterator<Item = f64>> Convert for I {}
@@ -0,0 +1,133 @@
+/* table.rs
+ * ===
+ * The default units, compiled from cfg/units.cfg by build.rs into static tables. Every name
+ * and alias is also compiled into a dictionary of fst.rs, which lookup reads in place and
+ * which lists names by their beginning for completion. The tables are also available to const
+ * fns, see const_lookup.
+ *
+ * The file is read by the same reader as at runtime, so the table holds the same units with
+ * the same factors as a database loaded from it. The table has a single namespace, though,
+ * so it cannot hold what the runtime sorts out with namespaces: a unit with tags, or two units
+ * sharing a name, where the runtime would keep the first and report the second. Rather than
+ * differ from the runtime, build.rs fails on both, as it does on anything the runtime would
+ * warn about.
+ *
+ * This file is a part of:
+ *
+ * Yucon - General Purpose Unit Converter
+ * Copyright (C) 2016-2017  Blaine Murphy
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use core::str;
+use ::convert::Factors;
+use ::fst::Fst;
+
+/* struct StaticUnit
+ *
+ * Description: a unit of the static table
+ */
+#[derive(Debug)]
+pub struct StaticUnit
+{
+    pub name: &'static str,
+    pub aliases: &'static [&'static str],
+    pub unit_type: &'static str,
+    pub factors: Factors,
+}
+
+// generated: UNIT_TABLE, NAME_TABLE of every name and alias in sorted order, and LONGEST_NAME
+include!(concat!(env!("OUT_DIR"), "/units.rs"));
+
+pub static UNITS: &'static [StaticUnit] = UNIT_TABLE;
+static NAME_FST: &'static [u8] = include_bytes!(concat!(env!("OUT_DIR"), "/names.fst"));
+
+// the dictionary of every name and alias to its unit's index in UNITS
+pub fn names() -> Fst<'static>
+{
+    Fst::from_bytes(NAME_FST).expect("build.rs writes a whole dictionary")
+}
+
+// finds a unit of the static table by its name or one of its aliases
+pub fn lookup(name: &str) -> Option<&'static StaticUnit>
+{
+    names().get(name.as_bytes()).map(|index| &UNITS[index as usize])
+}
+
+/* Calls 'found' with every name and alias beginning with 'prefix' and its unit,
+ * in byte order, as for completing a unit name.
+ */
+pub fn names_starting_with<F>(prefix: &str, mut found: F) where F: FnMut(&str, &'static StaticUnit)
+{
+    let mut name = [0u8; LONGEST_NAME];
+
+    names().starting_with(prefix.as_bytes(), &mut name, |name, index| {
+        // whole names are spelled out, so they are whole in UTF-8 too
+        if let Ok(name) = str::from_utf8(name)
+        {
+            found(name, &UNITS[index as usize]);
+        }
+    });
+}
+
+/* Finds a unit by name or alias during constant evaluation. The name may be
+ * wrapped in double quotes, as stringify! leaves a string literal. Fails to
+ * compile if there is no such unit.
+ */
+pub const fn const_lookup(name: &str) -> &'static StaticUnit
+{
+    let name = name.as_bytes();
+    let (start, end) = if name.len() >= 2 && name[0] == b'"' && name[name.len() - 1] == b'"'
+    {
+        (1, name.len() - 1)
+    }
+    else
+    {
+        (0, name.len())
+    };
+
+    let mut index = 0;
+
+    while index < NAME_TABLE.len()
+    {
+        if bytes_eq(NAME_TABLE[index].0.as_bytes(), name, start, end)
+        {
+            return &UNIT_TABLE[NAME_TABLE[index].1];
+        }
+        index += 1;
+    }
+
+    panic!("yucon: no unit with this name or alias in cfg/units.cfg");
+}
+
+// compares a string to wanted[start..end] in a const fn
+pub const fn bytes_eq(candidate: &[u8], wanted: &[u8], start: usize, end: usize) -> bool
+{
+    if candidate.len() != end - start
+    {
+        return false;
+    }
+
+    let mut index = 0;
+
+    while index < candidate.len()
+    {
+        if candidate[index] != wanted[start + index]
+        {
+            return false;
+        }
+        index += 1;
+    }
+
+    true
+}